@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// @brief Alokator blokowy dla węzłów frontu kompilatora (identyfikatory, operandy, wywołania procedur).
+/// Alokacja to przesunięcie wskaźnika w bieżącym bloku; obiekty żyją do clear() albo końca kompilacji,
+/// więc parser nie musi ich zwalniać pojedynczo
+class Arena {
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+    };
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* next = nullptr;              // pierwszy wolny bajt bieżącego bloku
+    size_t left = 0;                   // ile bajtów zostało w bieżącym bloku
+    std::vector<Finalizer> finalizers; // destruktory obiektów, które ich potrzebują (np. z std::vector)
+
+    static size_t padding(const char* p, size_t align) {
+        return (align - reinterpret_cast<uintptr_t>(p) % align) % align;
+    }
+
+    void* allocate(size_t size, size_t align) {
+        if (!next || padding(next, align) + size > left) {
+            size_t blockSize = std::max(BLOCK_SIZE, size + align);
+            blocks.emplace_back(new char[blockSize]);
+            next = blocks.back().get();
+            left = blockSize;
+        }
+        size_t pad = padding(next, align);
+        void* p = next + pad;
+        next += pad + size;
+        left -= pad + size;
+        return p;
+    }
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { clear(); }
+
+    /// @brief Tworzy obiekt T w arenie, np. make<Identifier>(pid, line)
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            finalizers.push_back({[](void* p) { static_cast<T*>(p)->~T(); }, object});
+        return object;
+    }
+
+    /// @brief Kopiuje tekst do areny (z zerem na końcu)
+    const char* copy(std::string_view text) {
+        char* p = static_cast<char*>(allocate(text.size() + 1, 1));
+        std::memcpy(p, text.data(), text.size());
+        p[text.size()] = '\0';
+        return p;
+    }
+
+    /// @brief Niszczy wszystkie obiekty i zwalnia bloki
+    void clear() {
+        for (auto it = finalizers.rbegin(); it != finalizers.rend(); ++it) it->destroy(it->object);
+        finalizers.clear();
+        blocks.clear();
+        next = nullptr;
+        left = 0;
+    }
+};
+
+/// Numer zinternowanej nazwy: równe nazwy mają ten sam numer, więc porównanie i hash to operacje na liczbie
+enum class NameId : unsigned {};
+
+/// @brief Pula nazw (internowanie). Każdy tekst jest przechowywany raz, a jego wskaźnik i numer są stałe do końca kompilacji
+class StringPool {
+    Arena storage;
+    std::unordered_map<std::string_view, NameId> ids; // widoki na teksty w storage
+    std::vector<const char*> texts;                   // numer -> tekst
+
+public:
+    StringPool() {
+        id(""); // numer 0 (NameId{}) to pusta nazwa - zakres maina
+    }
+
+    /// @brief Zwraca numer nazwy, dodając ją do puli przy pierwszym użyciu
+    NameId id(std::string_view text) {
+        if (auto it = ids.find(text); it != ids.end()) return it->second;
+        const char* stored = storage.copy(text);
+        NameId id = static_cast<NameId>(texts.size());
+        texts.push_back(stored);
+        ids.emplace(std::string_view(stored, text.size()), id);
+        return id;
+    }
+
+    /// @brief Zwraca stały wskaźnik na tekst z puli: równe teksty dają ten sam wskaźnik
+    const char* intern(std::string_view text) {
+        return texts[static_cast<unsigned>(id(text))];
+    }
+
+    const char* text(NameId id) const {
+        return texts[static_cast<unsigned>(id)];
+    }
+
+    size_t size() const {
+        return texts.size();
+    }
+};
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Benchmark czasu kompilacji: generuje syntetyczne programy z coraz większą liczbą bloków IF/WHILE/FOR
+# i wywołań procedur, kompiluje je i wypisuje czas na blok. Przy liniowej złożoności czas na blok jest stały.
+# Sposób użycia: bench/compileScaling.sh [kompilator] [rozmiary...]
+KOMPILATOR=${1:-./kompilator}
+shift
+SIZES=${@:-1000 2000 4000 8000 16000 32000 64000}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+generate() {
+    awk -v n="$1" 'BEGIN {
+        print "PROCEDURE step(x, I y) IS\nIN\n  x := x + y;\nEND\n"
+        print "PROGRAM IS\n  a, b, c, t[0:99]\nIN\n  READ a;\n  b := 0;\n  c := 1;"
+        for (i = 0; i < n; i++) {
+            k = i % 4
+            if (k == 0) printf "  IF a > %d THEN b := b + %d; ELSE b := b - 1; ENDIF\n", i, i % 97
+            else if (k == 1) printf "  WHILE c < %d DO c := c * 2; ENDWHILE\n", i + 2
+            else if (k == 2) printf "  FOR i FROM 0 TO %d DO t[i] := a + i; ENDFOR\n", i % 100
+            else print "  step(b, a);"
+        }
+        print "  WRITE b;\n  WRITE c;\nEND"
+    }'
+}
+
+printf "%8s %12s %10s %14s\n" blocks instructions time_ms us_per_block
+for n in $SIZES; do
+    generate "$n" > "$TMP/prog.imp"
+    start=$(date +%s%N)
+    "$KOMPILATOR" "$TMP/prog.imp" "$TMP/prog.mr" || exit 1
+    end=$(date +%s%N)
+    ns=$((end - start))
+    printf "%8d %12d %10.1f %14.2f\n" "$n" "$(wc -l < "$TMP/prog.mr")" "$(echo "$ns" | awk '{print $1 / 1e6}')" "$(echo "$ns $n" | awk '{print $1 / 1e3 / $2}')"
+done
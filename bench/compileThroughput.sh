@@ -0,0 +1,52 @@
+#!/bin/bash
+# Benchmark przepustowości kompilatora: generuje wielomegabajtowe programy z wieloma procedurami o długich listach
+# zmiennych (duże tablice symboli, dużo identyfikatorów) i wypisuje czas kompilacji, MB/s oraz szczytowe zużycie pamięci.
+# Sposób użycia: bench/compileThroughput.sh [kompilator] [rozmiary w MB...]
+KOMPILATOR=${1:-./kompilator}
+shift
+SIZES=${@:-1 2 4 8}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# procedura ma ok. 4 KB, więc n MB to ok. 256 * n procedur
+generate() {
+    awk -v n="$1" 'BEGIN {
+        procs = 256 * n
+        for (p = 0; p < procs; p++) {
+            printf "PROCEDURE proc_%s(T tab, I limit, result) IS\n  ", name(p)
+            for (v = 0; v < 24; v++) printf "%svariable_%s", (v ? ", " : ""), name(v)
+            printf ", buffer[0:63]\nIN\n  result := 0;\n"
+            for (v = 0; v < 24; v++) printf "  variable_%s := limit + %d;\n", name(v), v
+            for (s = 0; s < 16; s++) {
+                a = name(s); b = name(s + 5)
+                printf "  IF variable_%s > variable_%s THEN result := result + variable_%s; ELSE result := result - 1; ENDIF\n", a, b, a
+                printf "  FOR index_%s FROM 0 TO 63 DO buffer[index_%s] := tab[index_%s]; ENDFOR\n", a, a, a
+            }
+            if (p > 0) printf "  proc_%s(tab, limit, result);\n", name(p - 1)
+            print "END\n"
+        }
+        print "PROGRAM IS\n  value, total, data[0:63]\nIN\n  READ value;\n  total := 0;"
+        print "  FOR i FROM 0 TO 63 DO data[i] := value + i; ENDFOR"
+        printf "  proc_%s(data, value, total);\n", name(procs - 1)
+        print "  WRITE total;\nEND"
+    }
+    function name(k,   s) { s = ""; do { s = s sprintf("%c", 97 + k % 26); k = int(k / 26) } while (k > 0); return s }'
+}
+
+printf "%8s %12s %10s %10s %12s\n" MB lines time_ms MB_per_s peak_rss_MB
+for n in $SIZES; do
+    generate "$n" > "$TMP/prog.imp"
+    bytes=$(wc -c < "$TMP/prog.imp")
+    start=$(date +%s%N)
+    if [ -x /usr/bin/time ]; then
+        /usr/bin/time -f "%M" -o "$TMP/rss" "$KOMPILATOR" --no-inline "$TMP/prog.imp" "$TMP/prog.mr" || exit 1
+        rss=$(awk '{printf "%.1f", $1 / 1024}' "$TMP/rss")
+    else
+        "$KOMPILATOR" --no-inline "$TMP/prog.imp" "$TMP/prog.mr" || exit 1
+        rss=-
+    fi
+    end=$(date +%s%N)
+    ns=$((end - start))
+    printf "%8.2f %12d %10.1f %10.2f %12s\n" "$(echo "$bytes" | awk '{print $1 / 1048576}')" "$(wc -l < "$TMP/prog.imp")" \
+        "$(echo "$ns" | awk '{print $1 / 1e6}')" "$(echo "$bytes $ns" | awk '{print $1 / 1048576 / ($2 / 1e9)}')" "$rss"
+done
@@ -0,0 +1,100 @@
+#!/bin/bash
+# Benchmark kodu wynikowego na korpusie bench/corpus: kompiluje każdy program, uruchamia go na symulatorze
+# dla wszystkich przypadków z bench/corpus/tests (format test.sh: "? wejście", "> oczekiwane wyjście"),
+# sprawdza wyniki i zapisuje wiersz na program do pliku TSV:
+#   program  instructions  cost  cases  compile_ms  status
+# (cost to suma kosztów wszystkich przypadków, status: OK, FAIL, TIMEOUT albo COMPILE_ERR).
+# Jeśli istnieje plik bazowy, porównuje z nim liczbę instrukcji i koszt każdego programu.
+# Kończy się błędem, gdy któryś program dał zły wynik albo się nie skompilował.
+# Sposób użycia: bench/runCorpus.sh [kompilator] [symulator] [wyniki.tsv] [bazowe.tsv] [opcje kompilatora...]
+KOMPILATOR=${1:-./kompilator}
+SYMULATOR=${2:-./symulator}
+RESULTS=${3:-bench/results.tsv}
+BASELINE=${4:-bench/baseline.tsv}
+shift 4 2>/dev/null || shift $#
+CORPUS=$(dirname "$0")/corpus
+TIMEOUT_SEC=20s
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# uruchamia program dla jednego przypadku; dopisuje koszt do $TMP/cost, zwraca 1 przy złym wyniku
+run_case() {
+    local program=$1 inputs=$2 expected=$3
+    local output
+    output=$(echo "$inputs" | tr ' ' '\n' | timeout "$TIMEOUT_SEC" "$SYMULATOR" "$program" 2>&1)
+    [ $? -eq 124 ] && return 2
+    local actual cost
+    actual=$(echo "$output" | grep -oP ">\s*\K[0-9]+" | tr '\n' ' ' | xargs)
+    cost=$(echo "$output" | sed -n 's/.*koszt: \([0-9]*\);.*/\1/p')
+    echo "${cost:-0}" >> "$TMP/cost"
+    [ "$actual" == "$(echo "$expected" | xargs)" ]
+}
+
+printf "program\tinstructions\tcost\tcases\tcompile_ms\tstatus\n" > "$RESULTS"
+for test_file in "$CORPUS"/tests/*.txt; do
+    src=$(head -n 1 "$test_file" | tr -d '\r' | xargs)
+    name=${src%.imp}
+    compiled="$TMP/$name.mr"
+    start=$(date +%s%N)
+    if ! "$KOMPILATOR" "$@" "$CORPUS/programs/$src" "$compiled" > "$TMP/$name.log" 2>&1; then
+        printf "%s\t0\t0\t0\t0\tCOMPILE_ERR\n" "$name" >> "$RESULTS"
+        continue
+    fi
+    end=$(date +%s%N)
+    compile_ms=$(echo "$start $end" | awk '{printf "%.1f", ($2 - $1) / 1e6}')
+
+    : > "$TMP/cost"
+    status=OK cases=0 inputs="" expected=""
+    finish_case() {
+        [ -z "$expected" ] && [ -z "$inputs" ] && return # przypadek może nic nie wypisywać
+        cases=$((cases + 1))
+        run_case "$compiled" "$inputs" "$expected"
+        case $? in
+            0) ;;
+            2) status=TIMEOUT ;;
+            *) [ "$status" == OK ] && status=FAIL ;;
+        esac
+        inputs="" expected=""
+    }
+    while IFS= read -r line; do
+        line=${line%$'\r'}
+        if [[ "$line" == "? "* ]]; then
+            [ -n "$expected" ] && finish_case
+            inputs="$inputs ${line#? }"
+        elif [[ "$line" == "> "* ]]; then
+            expected="$expected ${line#> }"
+        elif [ -z "$line" ]; then
+            finish_case
+        fi
+    done < <(tail -n +2 "$test_file")
+    finish_case
+
+    cost=$(awk '{ s += $1 } END { print s + 0 }' "$TMP/cost")
+    printf "%s\t%d\t%s\t%d\t%s\t%s\n" "$name" "$(grep -c . "$compiled")" "$cost" "$cases" "$compile_ms" "$status" >> "$RESULTS"
+done
+
+# porównanie z wynikami bazowymi (programy spoza bazy są wypisywane bez porównania)
+awk -F'\t' -v baseline="$BASELINE" '
+    function change(old, new) { return old > 0 ? sprintf("%+.2f%%", 100 * (new - old) / old) : "" }
+    BEGIN {
+        if (baseline != "" && (getline line < baseline) > 0)
+            while ((getline line < baseline) > 0) { split(line, f, "\t"); base_len[f[1]] = f[2]; base_cost[f[1]] = f[3] }
+        printf "%-14s %22s %9s %32s %9s %10s  %s\n", "program", "instructions", "", "cost", "", "compile_ms", "status"
+    }
+    NR > 1 {
+        bad += $6 != "OK"
+        len += $2; cost += $3; ms += $5
+        if ($1 in base_len) {
+            blen += base_len[$1]; bcost += base_cost[$1]
+            printf "%-14s %10d -> %8d %9s %14d -> %14d %9s %10.1f  %s\n", $1, base_len[$1], $2, change(base_len[$1], $2),
+                   base_cost[$1], $3, change(base_cost[$1], $3), $5, $6
+        } else {
+            printf "%-14s %22d %9s %32d %9s %10.1f  %s\n", $1, $2, "", $3, "", $5, $6
+            blen += $2; bcost += $3
+        }
+    }
+    END {
+        printf "%-14s %10d -> %8d %9s %14d -> %14d %9s %10.1f  %s\n", "TOTAL", blen, len, change(blen, len),
+               bcost, cost, change(bcost, cost), ms, bad ? bad " FAILED" : "OK"
+        exit bad > 0
+    }' "$RESULTS"
@@ -1,65 +1,235 @@
 #pragma once
 #include <vector>
+#include <algorithm>
 #include <string>
-#include <unordered_map>
 #include <iostream>
+#include <stdexcept>
 
-struct Fixup {
-    int instr_index; // indeks instrukcji w code (pozycja do uzupełnienia)
-    int lable; // id etykiety, którą ma wskazywać
-    std::string op; // instrukcja np JZERO
-    };
+#include "instruction.hh"
+#include "helperSequences.hh"
+#include "options.hh"
+
+// Szacowana liczba bitów wartości nieznanej w czasie kompilacji. Używana do porównania kosztu pętli (zależnego od danych)
+// z kodem rozwiniętym przy mnożeniu i dzieleniu przez stałą
+const int ESTIMATED_OPERAND_BITS = 32;
+
+// Wyrażenie policzone wcześniej w tym samym bloku kodu bez etykiet (numeracja wartości)
+struct ValueNumber {
+    std::string key;                // postać wyrażenia, np. "x/y", "t[i]", "&t[i]"; pusty gdy brak
+    std::vector<std::string> deps;  // zmienne, od których zależy wartość; "*" - pamięć osiągalna przez parametry
+};
+
+// Zawartość rejestru znana w czasie kompilacji (śledzona między etykietami)
+struct RegisterValue {
+    bool known = false;
+    unsigned long long value = 0;
+    ValueNumber expr; // wyrażenie, którego wartość jest w rejestrze
+};
+
+// Wybrany sposób wygenerowania stałej w rejestrze
+struct ConstantPlan {
+    enum Kind { FRESH, DELTA, SHIFT, COPY } kind; // od zera / INC, DEC od wartości rejestru / dopisanie bitów / skopiowanie innego rejestru do ra
+    unsigned long long cost;
+    int shift = 0;   // SHIFT: liczba dopisywanych bitów
+    char source = 0; // COPY: rejestr źródłowy
+};
+
+// Etykieta skoku: adres po zdefiniowaniu i skoki czekające na ten adres
+struct Lable {
+    int address = -1;           // indeks instrukcji w code albo -1 gdy etykieta nie jest jeszcze zdefiniowana
+    std::vector<int> fixups;    // indeksy instrukcji skoku do uzupełnienia przy defineLable
+};
 
 class CodeGenerator {
-    std::vector<std::string>* code = nullptr;
+    std::vector<Instr>* code = nullptr;
+    const int* source_line = nullptr; // wskaźnik na numer linii leksera, zapisywany w każdej instrukcji
 
-    int next_lable_id; // generuje nowe id etykiet
-    std::unordered_map<int,int> lable_address; // lable_id -> code index (adres)
-    std::vector<Fixup> pending_fixups; // zapisuje skoki do backpatchowania
+    std::vector<Lable> lables; // etykiety indeksowane id z newLable
+    int pending_fixups = 0; // liczba skoków czekających na zdefiniowanie etykiety
     std::vector<int> lable_stack; // stack na lable skoków
+    bool in_arithmetic_loop = false; // emitowany jest kod generateMult / generateDiv
+    Origin origin = Origin::STATEMENT; // część generatora, której instrukcje są teraz emitowane (OriginScope)
+    int dead_until = -1; // kod martwy (nieosiągalny) aż do zdefiniowania tej etykiety, -1 gdy kod jest osiągalny
+    RegisterValue registers[8]; // znane wartości rejestrów a-h w obecnym miejscu kodu
+    std::vector<std::pair<unsigned long long, ValueNumber>> storedValues; // adres zmiennej i wyrażenie, którego wartość zawiera
+
+    /// @brief Czy wartość v zależy od zmiennej name
+    static bool dependsOn(const ValueNumber& v, const std::string& name) {
+        return std::find(v.deps.begin(), v.deps.end(), name) != v.deps.end();
+    }
+
+    /// @brief Uaktualnia znane wartości rejestrów po wykonaniu instrukcji
+    void trackInstruction(const Instr& instr) {
+        RegisterValue& a = registers[0];
+        RegisterValue* r = instr.reg ? &registers[instr.reg - 'a'] : nullptr;
+        switch (instr.op) { // nadpisany rejestr nie zawiera już policzonego wyrażenia
+        case Op::READ: case Op::LOAD: case Op::RLOAD: case Op::ADD: case Op::SUB:
+            a.expr = {};
+            break;
+        case Op::INC: case Op::DEC: case Op::SHL: case Op::SHR:
+            r->expr = {};
+            break;
+        default:
+            break;
+        }
+        switch (instr.op) {
+        case Op::READ: case Op::LOAD: case Op::RLOAD:
+            a.known = false;
+            break;
+        case Op::RST:
+            *r = {true, 0, {}};
+            break;
+        case Op::INC:
+            if (r->value == ~0ULL) r->known = false;
+            else r->value++;
+            break;
+        case Op::DEC:
+            if (r->value > 0) r->value--;
+            break;
+        case Op::SHL:
+            if (r->value >> 63) r->known = false;
+            else r->value <<= 1;
+            break;
+        case Op::SHR:
+            r->value >>= 1;
+            break;
+        case Op::ADD:
+            if (a.known && r->known && a.value + r->value >= a.value) a.value += r->value;
+            else a.known = false;
+            break;
+        case Op::SUB:
+            if (r == &a) a = {true, 0, {}};
+            else if (a.known && r->known) a.value = a.value > r->value ? a.value - r->value : 0;
+            else a.known = false;
+            break;
+        case Op::SWP:
+            std::swap(a, *r);
+            break;
+        case Op::CALL:
+            forgetRegisters();
+            break;
+        default:
+            break;
+        }
+    }
+
+    /// @brief koszt budowania stałej cyframi digits od zera (RST, INC, potem SHL i ewentualnie INC/DEC na cyfrę)
+    static unsigned long long digitsConstantCost(const std::vector<int>& digits){
+        unsigned long long cost = 2;
+        for(size_t i = 1; i < digits.size(); i++) cost += 1 + (digits[i] != 0);
+        return cost;
+    }
+
+    /// @brief Wybiera najtańszy sposób wygenerowania n w rejestrze reg przy obecnej zawartości rejestrów
+    ConstantPlan planConstant(char reg, unsigned long long n){
+        ConstantPlan best{ConstantPlan::FRESH, constantCost(n)};
+        auto distance = [](unsigned long long x, unsigned long long y) { return x > y ? x - y : y - x; };
+        const RegisterValue& cur = registers[reg - 'a'];
+        if(cur.known){
+            if(distance(cur.value, n) < best.cost) best = {ConstantPlan::DELTA, distance(cur.value, n)};
+            for(int j = 1; j < 64 && cur.value > 0 && (n >> j) > 0; j++){
+                if((n >> j) != cur.value) continue;
+                unsigned long long cost = j + __builtin_popcountll(n & ((1ULL << j) - 1));
+                if(cost < best.cost) best = {ConstantPlan::SHIFT, cost, j};
+            }
+        }
+        if(reg == 'a'){ // ADD działa tylko na ra
+            for(char src = 'b'; src <= 'h'; src++){
+                const RegisterValue& other = registers[src - 'a'];
+                if(!other.known) continue;
+                unsigned long long cost = 6 + distance(other.value, n);
+                if(cost < best.cost) best = {ConstantPlan::COPY, cost, 0, src};
+            }
+        }
+        return best;
+    }
 
 public:
+    /// @brief Oznacza instrukcje emitowane w czasie życia obiektu jako kod danej części generatora (--stats).
+    /// Zagnieżdżony zasięg wygrywa, np. stała budowana w save_to_reg liczy się do generateConstant
+    class OriginScope {
+        CodeGenerator& gen;
+        Origin saved;
+    public:
+        OriginScope(CodeGenerator& gen, Origin origin) : gen(gen), saved(gen.origin) { gen.origin = origin; }
+        ~OriginScope() { gen.origin = saved; }
+        OriginScope(const OriginScope&) = delete;
+        OriginScope& operator=(const OriginScope&) = delete;
+    };
+
+    ArithmeticKernel kernel = ArithmeticKernel::ADAPTIVE; // pętle generateMult i generateDiv
 
     CodeGenerator(){
-        next_lable_id = 0;
-        lable_address.clear();
-        pending_fixups.clear();
+        lables.clear();
+        pending_fixups = 0;
     }
 
     /// @brief ustawia referencje kodu i emituje lable skoku do main
     /// @param codeRef referencja do kodu z programu main
-    void setCode(std::vector<std::string> & codeRef) {
+    /// @param lineRef wskaźnik na numer aktualnej linii kodu źródłowego (Compilation::line)
+    void setCode(std::vector<Instr> & codeRef, const int* lineRef) {
         code = &codeRef;
+        source_line = lineRef;
         int L_end  = newLable();
         pushLable(L_end);
-        emitLable(L_end, "JUMP");
+        emitLable(L_end, Op::JUMP);
     }
-    
+
     /// @brief dodaje instrukcje do wektora kodu
-    /// @param instruction 
-    void emit(std::string instruction) {
-        code->push_back(instruction);
+    /// @param instr gotowa instrukcja
+    void emit(Instr instr) {
+        if (dead_until >= 0) return; // martwy kod nie trafia do programu
+        instr.line = source_line ? *source_line : 0;
+        instr.inner_loop = instr.inner_loop || in_arithmetic_loop;
+        instr.origin = origin;
+        trackInstruction(instr);
+        code->push_back(instr);
+    }
+
+    /// @brief emituje instrukcje bez argumentu np. READ, HALT
+    /// @param op 
+    /// @param comment komentarz ignorowany przez maszynę wirtualną
+    void emit(Op op, const char* comment = nullptr) {
+        Instr instr{op};
+        instr.comment = comment;
+        emit(instr);
     }
-    
-    /// @brief emituje instrukcje z argumentem np. LOAD 4
-    /// @param instruction 
-    /// @param arg 
-    void emit(std::string instruction, unsigned long long arg){
-        code->push_back(instruction + " " + std::to_string(arg));
+
+    /// @brief emituje instrukcje z argumentem rejestrowym np. SWP b
+    /// @param op 
+    /// @param reg rejestr ('a','b',..., 'h')
+    /// @param comment komentarz ignorowany przez maszynę wirtualną
+    void emit(Op op, char reg, const char* comment = nullptr) {
+        Instr instr{op};
+        instr.reg = reg;
+        instr.comment = comment;
+        emit(instr);
+    }
+
+    /// @brief emituje instrukcje z argumentem liczbowym np. LOAD 4
+    /// @param op 
+    /// @param arg adres pamięci albo numer linii skoku
+    /// @param comment komentarz ignorowany przez maszynę wirtualną
+    void emit(Op op, unsigned long long arg, const char* comment = nullptr){
+        Instr instr{op};
+        instr.arg = arg;
+        instr.comment = comment;
+        emit(instr);
     }
 
-    /// @brief emituje instrukcje z argumentem i komentarzem na końcu, który jest ignorowanym przez maszynę wirtualną
-    /// @param instruction 
-    /// @param arg 
-    /// @param comment 
-    void emit(std::string instruction, unsigned long long arg, std::string comment){
-        code->push_back(instruction + " " + std::to_string(arg) + " #" + comment);
+    /// @brief emituje sekwencję pomocniczą z tabeli wygenerowanej przez superopt (helperSequences.hh)
+    /// @param helper sekwencja
+    /// @param comment komentarz przy pierwszej instrukcji
+    void emitHelper(Helper helper, const char* comment = nullptr) {
+        const HelperSequence& seq = helperSequence(helper);
+        for (unsigned i = 0; i < seq.length; i++) emit(seq.steps[i].op, seq.steps[i].reg, i == 0 ? comment : nullptr);
     }
 
     /// @brief Tworzy nową etykietę
     /// @return id nowej etykiety
     int newLable() {
-        return next_lable_id++;
+        lables.emplace_back();
+        return (int)lables.size() - 1;
     }
 
     /// @brief dodaje lable skoku na stos
@@ -80,17 +250,21 @@ public:
         return v;
     }
 
-    /// @brief Emituje string j_lable i dopisuje do pending_fixups. Jeśli poprzez defineLable lable ma już numer linii skoku to go dopisuje.
+    /// @brief Emituje skok j_lable i dopisuje go do skoków czekających na etykietę. Jeśli poprzez defineLable lable ma już numer linii skoku to go dopisuje.
     /// @param lable numer lable z newLable
     /// @param j_lable instrukcja skoku np. JZERO
-    void emitLable(int lable, std::string j_lable) {
-        auto it = lable_address.find(lable);
-        if (it != lable_address.end()) { // lable already known -> emit direct
-            code->push_back(j_lable + " " + std::to_string(it->second));
+    void emitLable(int lable, Op j_lable) {
+        if (dead_until >= 0) return;
+        Instr instr{j_lable};
+        instr.lable = lable;
+        Lable& l = lables.at(lable);
+        if (l.address >= 0) { // lable already known -> emit direct
+            instr.arg = l.address;
+            emit(instr);
         } else {
-            int idx = (int)code->size();
-            code->push_back(j_lable);  // placeholder
-            pending_fixups.push_back({idx, lable, j_lable});
+            l.fixups.push_back((int)code->size());
+            emit(instr);  // placeholder
+            pending_fixups++;
         }
     }
 
@@ -98,56 +272,220 @@ public:
     /// @param lable instrukcja skoku do zdefiniowania
     void defineLable(int lable) {
         int addr = (int)code->size();
-        if (lable_address.find(lable) != lable_address.end()) {
+        Lable& l = lables.at(lable);
+        if (l.address >= 0) {
             std::cerr << "Lable " << lable << " already defined\n";
             return;
         }
-        lable_address[lable] = addr;
+        l.address = addr;
+        if (lable == dead_until) dead_until = -1; // tu kod znowu staje się osiągalny
+        forgetRegisters(); // do etykiety można doskoczyć z miejsc o innej zawartości rejestrów
 
-        // backpatchuj wszystkie pending_fixups, które celują w ten lable
-        for (auto it = pending_fixups.begin(); it != pending_fixups.end(); ) {
-            if (it->lable == lable) {
-                std::string new_instr = it->op + " " + std::to_string(addr);
-                code->at(it->instr_index) = new_instr;
-                it = pending_fixups.erase(it);
-            } else {
-                ++it;
+        // backpatchuj skoki, które celują w ten lable
+        for (int idx : l.fixups) (*code)[idx].arg = addr;
+        pending_fixups -= (int)l.fixups.size();
+        l.fixups.clear();
+        l.fixups.shrink_to_fit();
+    }
+
+    /// @brief Linia kodu źródłowego, z której powstała instrukcja o numerze address
+    int sourceLine(unsigned long long address) const {
+        return (*code)[address].line;
+    }
+
+    /// @brief Adres etykiety albo -1, jeśli nie jest jeszcze zdefiniowana
+    int lableAddress(int lable) const {
+        return lables.at(lable).address;
+    }
+
+    /// @brief Definiuje etykietę lable pod tym samym adresem co wcześniej zdefiniowana etykieta target
+    /// (np. skok warunku UNTIL na początek pętli)
+    void defineLableAs(int lable, int target) {
+        Lable& l = lables.at(lable);
+        l.address = lables.at(target).address;
+        for (int idx : l.fixups) (*code)[idx].arg = l.address;
+        pending_fixups -= (int)l.fixups.size();
+        l.fixups.clear();
+    }
+
+    /// @brief Pomija emitowanie kodu aż do zdefiniowania etykiety lable (np. gałąź IF, której warunek jest zawsze fałszywy).
+    /// Skoki do etykiet w pominiętym kodzie mogą pochodzić tylko z tego kodu, więc nie czekają na backpatchowanie
+    /// @param lable etykieta, od której kod jest znowu osiągalny
+    void skipUntil(int lable) {
+        if (dead_until < 0) dead_until = lable; // zagnieżdżony martwy kod kończy się wcześniej niż zewnętrzny
+    }
+
+    /// @brief Czy kod jest teraz emitowany (poza martwym fragmentem)
+    bool isLive() const {
+        return dead_until < 0;
+    }
+
+    /// @brief Dopisuje na końcu kodu kopię instrukcji [begin, end), np. ciała rozwijanej pętli. Skoki do miejsc
+    /// w kopiowanym fragmencie i na jego koniec są przesuwane do kopii. Etykiety we fragmencie muszą być już zdefiniowane
+    void duplicate(unsigned long long begin, unsigned long long end) {
+        if (dead_until >= 0) return;
+        unsigned long long shift = code->size() - begin;
+        for (unsigned long long i = begin; i < end; i++) {
+            Instr instr = (*code)[i];
+            if (isJump(instr.op) && instr.op != Op::CALL && instr.arg >= begin && instr.arg <= end) instr.arg += shift;
+            code->push_back(instr);
+        }
+        forgetRegisters();
+    }
+
+    /// @brief Dopisuje kopię kodu warunku [begin, end) z odwróconym sensem skoku: kopia skacze do target, gdy warunek
+    /// jest prawdziwy, a gdy jest fałszywy, przechodzi dalej (albo skacze do falseLable zdefiniowanej zaraz za nią).
+    /// Oryginał skacze do falseLable, gdy warunek jest fałszywy, i kończy się skokiem warunkowym do falseLable
+    /// @return false, gdy kodu nie da się odwrócić - wtedy nic nie jest emitowane
+    bool emitInvertedCondition(unsigned long long begin, unsigned long long end, int falseLable, int target) {
+        if (dead_until >= 0) return true;
+        if (end <= begin || lables.at(target).address < 0) return false;
+        const Instr& last = (*code)[end - 1];
+        if ((last.op != Op::JPOS && last.op != Op::JZERO) || last.lable != falseLable) return false;
+
+        unsigned long long shift = code->size() - begin;
+        for (unsigned long long i = begin; i < end; i++) {
+            Instr instr = (*code)[i];
+            if (i + 1 == end) { // ostatni skok: odwrócony, do target
+                instr.op = instr.op == Op::JPOS ? Op::JZERO : Op::JPOS;
+                instr.lable = target;
+                instr.arg = lables[target].address;
+            } else if (isJump(instr.op) && instr.lable == falseLable) { // wcześniejsze wyjście, gdy warunek jest fałszywy
+                lables[falseLable].fixups.push_back((int)code->size());
+                pending_fixups++;
+            } else if (isJump(instr.op) && instr.op != Op::CALL && instr.arg == end) { // wyjście, gdy warunek jest prawdziwy
+                instr.lable = target;
+                instr.arg = lables[target].address;
+            } else if (isJump(instr.op) && instr.op != Op::CALL && instr.arg >= begin && instr.arg < end) {
+                instr.arg += shift;
             }
+            code->push_back(instr);
         }
+        forgetRegisters();
+        return true;
     }
 
     /// @brief Na końcu parsowania upewnia się, że wszystkie etykiety skoku zdefiniowano
     void backpatchAllCheck() {
-        if (!pending_fixups.empty()) {
-            for (const auto &f : pending_fixups) {
-                throw std::domain_error("Unresolved jump to lable " + std::to_string(f.lable) + " at instr " + std::to_string(f.instr_index));
+        if (pending_fixups == 0) return;
+        for (size_t lable = 0; lable < lables.size(); lable++) {
+            if (!lables[lable].fixups.empty()) {
+                throw std::domain_error("Unresolved jump to lable " + std::to_string(lable) + " at instr " + std::to_string(lables[lable].fixups.front()));
             }
         }
     }
 
-    /// @brief generuje w danym rejestrze stałą wartość n
+    /// @brief Zapomina zawartość wszystkich rejestrów (miejsce, do którego można doskoczyć, np. początek procedury)
+    void forgetRegisters() {
+        for (RegisterValue& r : registers) r = {};
+        storedValues.clear();
+    }
+
+    /// @brief Zapamiętuje, że rejestr reg zawiera wartość wyrażenia value (wywoływane zaraz po kodzie, który ją policzył)
+    void bindValue(char reg, const ValueNumber& value) {
+        if (dead_until < 0) registers[reg - 'a'].expr = value;
+    }
+
+    /// @brief Rejestr, który zawiera wartość wyrażenia key, albo 0
+    char findValue(const std::string& key) const {
+        for (int i = 0; i < 8; i++)
+            if (registers[i].expr.key == key) return (char)('a' + i);
+        return 0;
+    }
+
+    /// @brief Jeśli wartość wyrażenia key jest w rejestrze (albo, gdy fromMemory, w zmiennej w pamięci), przenosi ją do ra
+    /// @return false, gdy wartość trzeba policzyć
+    bool reuseValue(const std::string& key, bool fromMemory) {
+        if (dead_until >= 0 || key.empty()) return false;
+        if (char r = findValue(key)) {
+            if (r == 'a') return true;
+            ValueNumber value = registers[r - 'a'].expr;
+            emit(Op::RST, 'a');
+            emit(Op::ADD, r);
+            registers[0].expr = value;
+            return true;
+        }
+        if (!fromMemory) return false;
+        for (const auto& [address, value] : storedValues) {
+            if (value.key != key) continue;
+            ValueNumber copy = value;
+            emit(Op::LOAD, address);
+            registers[0].expr = copy;
+            return true;
+        }
+        return false;
+    }
+
+    /// @brief Zmienna name została zmieniona: zapomina wyrażenia, które od niej zależą
+    void invalidateValues(const std::string& name) {
+        for (RegisterValue& r : registers)
+            if (dependsOn(r.expr, name)) r.expr = {};
+        storedValues.erase(std::remove_if(storedValues.begin(), storedValues.end(),
+            [&](const auto& stored) { return dependsOn(stored.second, name); }), storedValues.end());
+    }
+
+    /// @brief Po zapisaniu ra do zmiennej skalarnej name (w pamięci pod address albo w rejestrze, gdy address < 0):
+    /// zapomina wyrażenia zależne od name i zapamiętuje, że zmienna zawiera wartość wyrażenia z ra
+    void assignValue(const std::string& name, long long address) {
+        ValueNumber value = registers[0].expr;
+        invalidateValues(name);
+        if (dead_until >= 0 || address < 0 || value.key.empty() || dependsOn(value, name)) return;
+        value.deps.push_back(name);
+        storedValues.push_back({(unsigned long long)address, value});
+    }
+
+    /// @brief koszt zbudowania stałej n od zera: RST, INC i po jednym SHL oraz INC/DEC na każdą kolejną cyfrę
+    /// zapisu binarnego albo NAF (DEC zastępuje ciągi jedynek, np. 2^k - 1)
+    static unsigned long long constantCost(unsigned long long n){
+        if(n == 0) return 1;
+        return std::min(digitsConstantCost(signedDigits(n, false)), digitsConstantCost(signedDigits(n, true)));
+    }
+
+    /// @brief koszt najtańszego sposobu wygenerowania n w rejestrze reg przy obecnej zawartości rejestrów
+    unsigned long long constantCost(char reg, unsigned long long n){
+        return planConstant(reg, n).cost;
+    }
+
+    /// @brief generuje w danym rejestrze stałą wartość n najtańszym sposobem: nic, gdy rejestr już ją zawiera,
+    /// INC/DEC od znanej wartości rejestru, dopisanie bitów (SHL, INC) do wartości rejestru będącej prefiksem n,
+    /// skopiowanie do ra innego rejestru o znanej bliskiej wartości albo zbudowanie od zera
     /// @param reg rejestr ('a','b',..., 'h')
     /// @param n wartość do wygenerowania w rejestrze
-    void generateConstant(std::string reg, unsigned long long n){
-        emit("RST " + reg); //0
-        if(n == 0) return;
-        emit("INC " + reg); // 1
-        if(n == 1) return;
-
-        // oblicza odwróconą wartość binarną n w stringu
-        std::string n_bin = "";
-        while(n > 0){
-            int bit = n%2;
-            n_bin.push_back('0' + bit);
-            n /= 2;
+    void generateConstant(char reg, unsigned long long n){
+        OriginScope scope(*this, Origin::CONSTANT);
+        ConstantPlan plan = planConstant(reg, n);
+        unsigned long long start = n;
+        switch(plan.kind){
+        case ConstantPlan::FRESH: {
+            emit(Op::RST, reg); //0
+            if(n == 0) return;
+            std::vector<int> binary = signedDigits(n, false), naf = signedDigits(n, true);
+            const std::vector<int>& digits = digitsConstantCost(naf) < digitsConstantCost(binary) ? naf : binary;
+            emit(Op::INC, reg); // 1
+            for(size_t i = 1; i < digits.size(); i++){
+                emit(Op::SHL, reg); // *=2
+                if(digits[i] == 1) emit(Op::INC, reg);
+                else if(digits[i] == -1) emit(Op::DEC, reg);
+            }
+            return;
         }
-        
-        // idziemy po n_bin od lewej do prawej, bo jest odwrócony
-        for(int i = ((int)n_bin.length()-2); i >= 0; i--)
-        {
-            emit("SHL " + reg); // *=2
-            if(n_bin[i] == '1') emit("INC " + reg);
+        case ConstantPlan::SHIFT: // rejestr zawiera n >> plan.shift
+            for(int i = plan.shift - 1; i >= 0; i--){
+                emit(Op::SHL, reg);
+                if((n >> i) & 1) emit(Op::INC, reg);
+            }
+            return;
+        case ConstantPlan::COPY: // ra = plan.source
+            emit(Op::RST, 'a');
+            emit(Op::ADD, plan.source);
+            start = registers[plan.source - 'a'].value;
+            break;
+        case ConstantPlan::DELTA:
+            start = registers[reg - 'a'].value;
+            break;
         }
+        for(; start < n; start++) emit(Op::INC, reg);
+        for(; start > n; start--) emit(Op::DEC, reg);
     }
 
     /// @brief 
@@ -157,89 +495,287 @@ public:
         return (unsigned long long)code->size();
     }
 
+    /// @brief liczba bitów n (0 dla n = 0)
+    static int bitLength(unsigned long long n){
+        int bits = 0;
+        for(; n > 0; n /= 2) bits++;
+        return bits;
+    }
+
+    /// @brief Zapis c cyframi -1, 0, 1 od najstarszej. Dla naf = true w postaci NAF (bez sąsiednich niezerowych cyfr),
+    /// która zastępuje ciągi jedynek jednym odejmowaniem, dla naf = false zwykły zapis binarny
+    static std::vector<int> signedDigits(unsigned long long c, bool naf){
+        std::vector<int> digits; // od najmłodszej
+        bool high = false; // n ma dodatkowy bit 2^64 (po przeniesieniu z 2^64 - 1)
+        while(c > 0 || high){
+            int d = (int)(c % 2);
+            if(naf && d == 1 && (c & 2)) d = -1;
+            if(d == 1) c -= 1;
+            else if(d == -1 && ++c == 0) high = true;
+            digits.push_back(d);
+            c = (c >> 1) | (high ? (1ULL << 63) : 0);
+            high = false;
+        }
+        return std::vector<int>(digits.rbegin(), digits.rend());
+    }
+
+    /// @brief koszt kodu generateMultByConstant dla cyfr digits
+    /// @param copy_needed czy mnożna musi być najpierw skopiowana z ra do rb
+    static unsigned long long digitsCost(const std::vector<int>& digits, bool copy_needed){
+        unsigned long long cost = 0;
+        bool adds = false;
+        for(size_t i = 1; i < digits.size(); i++){
+            cost += 1; // SHL
+            if(digits[i] != 0){ cost += 5; adds = true; } // ADD / SUB
+        }
+        if(adds && copy_needed) cost += 11; // SWP b, RST a, ADD b
+        return cost;
+    }
+
+    /// @brief koszt mnożenia ra przez stałą c kodem bez pętli (generateMultByConstant)
+    /// @param copy_needed czy mnożna jest tylko w ra (a nie w rejestrze zmiennej)
+    unsigned long long multByConstantCost(unsigned long long c, bool copy_needed){
+        return std::min(digitsCost(signedDigits(c, false), copy_needed), digitsCost(signedDigits(c, true), copy_needed));
+    }
+
+    /// @brief szacowany koszt generateMult, gdy stała c jest w rb (pętla wykonuje się raz dla każdego bitu c,
+    /// a w ArithmeticKernel::ADAPTIVE raz dla każdych dwóch bitów)
+    unsigned long long multLoopCost(unsigned long long c){
+        if(kernel == ArithmeticKernel::ADAPTIVE){
+            unsigned long long add = helperSequence(Helper::MULT_ADD).cost;
+            unsigned long long cost = constantCost(c) + 1 + 7 + 3 + 5; // RST d, test 0, test 1, SWP d na końcu
+            for(; c > 0; c /= 4){
+                unsigned long long digit = c % 4;
+                cost += helperSequence(Helper::MULT_DIGIT).cost + 1 + 9; // cyfra, przesunięcie mnożnika i test końca
+                if(digit > 0) cost += digit * add + 2 * (digit - (digit == 3)); // dodawania rozdzielone DEC a, JZERO
+                if(c >= 4) cost += 3; // SHL c, SHL c, JUMP
+            }
+            return cost;
+        }
+        unsigned long long cost = constantCost(c) + 1 + helperSequence(Helper::MULT_END).cost; // stała w rb, RST a
+        unsigned long long turn = helperSequence(Helper::MULT_BIT_TEST).cost + helperSequence(Helper::MULT_SHIFT).cost
+                                + helperSequence(Helper::MULT_NEXT).cost + 3; // obrót pętli z trzema skokami
+        for(; c > 0; c /= 2) cost += turn + helperSequence(Helper::MULT_ADD).cost * (c % 2); // dodawanie dla bitu 1
+        return cost;
+    }
+
+    /// @brief szacowany koszt generateDiv przez stałą d dla dzielnej o ESTIMATED_OPERAND_BITS bitach
+    unsigned long long divLoopCost(unsigned long long d){
+        unsigned long long q = (unsigned long long)std::max(ESTIMATED_OPERAND_BITS - bitLength(d), 0); // bity ilorazu
+        unsigned long long scale = helperSequence(Helper::DIV_SCALE_TEST).cost + helperSequence(Helper::DIV_DOUBLE).cost + 2;
+        if(kernel == ArithmeticKernel::ADAPTIVE){
+            unsigned long long step = 7 + 1 + 12 + helperSequence(Helper::DIV_HALVE).cost // test rd, SHL h, porównanie
+                                    + helperSequence(Helper::DIV_QUOTIENT_BIT).cost / 2;
+            unsigned long long init = 1 + 12 + 2; // RST h, test dzielnej mniejszej od dzielnika, rd = 1
+            return constantCost(d) + init + (q + 1) * scale + (q + 1) * step + 7 + (q + 1) / 2;
+        }
+        unsigned long long step = helperSequence(Helper::DIV_BIT_TEST).cost + helperSequence(Helper::DIV_COMPARE).cost
+                                + helperSequence(Helper::DIV_HALVE).cost + 3 + helperSequence(Helper::DIV_SUBTRACT).cost / 2;
+        unsigned long long init = helperSequence(Helper::DIV_INIT).cost + 1; // i skok do wyniku
+        return constantCost(d) + init + (q + 1) * scale + (q + 2) * step; // podwajanie dzielnika, odejmowanie i połowienie
+    }
+
+    /// @brief generuje ra = ra * c bez pętli: schemat Hornera na cyfrach c (przesunięcia i dodawania lub odejmowania mnożnej).
+    /// Wybiera tańszy z zapisu binarnego i NAF. Pośrednie wyniki NAF są zawsze dodatnie, więc SUB nie obcina do 0
+    /// @param c stała różna od 0
+    /// @param src rejestr zmiennej, w którym jest mnożna, albo 0 gdy mnożna jest tylko w ra (wtedy kopiowana do rb)
+    void generateMultByConstant(unsigned long long c, char src){
+        OriginScope scope(*this, Origin::MULT);
+        std::vector<int> binary = signedDigits(c, false), naf = signedDigits(c, true);
+        const std::vector<int>& digits = digitsCost(naf, src == 0) < digitsCost(binary, src == 0) ? naf : binary;
+        bool adds = false;
+        for(size_t i = 1; i < digits.size(); i++) adds = adds || digits[i] != 0;
+        if(adds && src == 0){
+            emit(Op::SWP, 'b');
+            emit(Op::RST, 'a');
+            emit(Op::ADD, 'b');
+            src = 'b';
+        }
+        for(size_t i = 1; i < digits.size(); i++){
+            emit(Op::SHL, 'a');
+            if(digits[i] == 1) emit(Op::ADD, src);
+            else if(digits[i] == -1) emit(Op::SUB, src);
+        }
+    }
+
     /// @brief generuje kod do podzielenia wartości rejestru b przez c. W rejestrze h przechowywana jest wartość rb div rc, a w rb reszta z dzielenia
-    void generateDiv(){
+    /// @param check_zero czy sprawdzać dzielenie przez 0 (niepotrzebne dla stałego dzielnika)
+    void generateDiv(bool check_zero = true){
+        OriginScope scope(*this, Origin::DIV);
+        if(kernel == ArithmeticKernel::ADAPTIVE) generateDivAdaptive(check_zero);
+        else generateDivBasic(check_zero);
+    }
+
+    /// @brief generuje ra = rb * rc
+    /// @param order_operands czy pętla ma iść po mniejszym z czynników (dla stałej w rb wybrał ją już parser)
+    void generateMult(bool order_operands = true){
+        OriginScope scope(*this, Origin::MULT);
+        if(kernel == ArithmeticKernel::ADAPTIVE) generateMultAdaptive(order_operands);
+        else generateMultBasic();
+    }
+
+    /// @brief dzielenie ArithmeticKernel::BASIC: podwajanie dzielnika od 1, potem jeden bit ilorazu na obrót
+    void generateDivBasic(bool check_zero){
         int L_zero_div = newLable();
-        emit("RST a");
-        emit("ADD c");
-        emitLable(L_zero_div, "JZERO");
+        if(check_zero){
+            emitHelper(Helper::DIV_ZERO_CHECK);
+            emitLable(L_zero_div, Op::JZERO);
+        }
 
-        emit("RST d"); emit("INC d"); // rd = 1
-        emit("RST h"); 
+        emitHelper(Helper::DIV_INIT); // rd = 1, rh = 0
+        in_arithmetic_loop = true;
 
         int L_start = newLable();
         defineLable(L_start);
-        emit("RST a #Starting DIV"); //start
-        emit("ADD c"); emit("SHL a"); emit("SUB b"); //ra = 2*rc-rb
+        emitHelper(Helper::DIV_SCALE_TEST, "Starting DIV"); //ra = 2*rc-rb
         int L_loop_two = newLable();
-        emitLable(L_loop_two, "JPOS"); //if 2*rc-rb > 0 jump to loop_two
+        emitLable(L_loop_two, Op::JPOS); //if 2*rc-rb > 0 jump to loop_two
 
-        emit("SHL c"); //rc = 2*rc
-        emit("SHL d"); //rd = 2*rd
-        emitLable(L_start, "JUMP");
+        emitHelper(Helper::DIV_DOUBLE); //rc = 2*rc, rd = 2*rd
+        emitLable(L_start, Op::JUMP);
 
         defineLable(L_loop_two);
-        emit("RST a"); //loop_two
-        emit("ADD d"); //ra = rd
+        emitHelper(Helper::DIV_BIT_TEST); //ra = rd
         int L_return = newLable();
-        emitLable(L_return, "JZERO"); //if(rd == 0) jump to the end
+        emitLable(L_return, Op::JZERO); //if(rd == 0) jump to the end
 
-        emit("RST a"); emit("ADD c"); emit("SUB b"); // ra = rc-rb
+        emitHelper(Helper::DIV_COMPARE); // ra = rc-rb
         int L_VI = newLable();
-        emitLable(L_VI, "JPOS"); // if(rc-rb > 0) jump to VI
+        emitLable(L_VI, Op::JPOS); // if(rc-rb > 0) jump to VI
+
+        emitHelper(Helper::DIV_SUBTRACT); //rb = rb-rc, rh = rh+rd
 
-        emit("SWP b"); emit("SUB c"); emit("SWP b"); //rb = rb-rc
-        emit("SWP h"); emit("ADD d"); emit("SWP h"); //rh = rh+rd
- 
         defineLable(L_VI);
-        emit("SHR c"); //VI
-        emit("SHR d");
-        emitLable(L_loop_two, "JUMP");
-        emitLable(L_return, "JUMP");
-        defineLable(L_zero_div);
-        emit("RST b");
-        emit("RST h");
+        emitHelper(Helper::DIV_HALVE); //rc = rc/2, rd = rd/2
+        emitLable(L_loop_two, Op::JUMP);
+        in_arithmetic_loop = false;
+        if(check_zero){
+            emitLable(L_return, Op::JUMP);
+            defineLable(L_zero_div);
+            emit(Op::RST, 'b');
+            emit(Op::RST, 'h');
+        }
+        defineLable(L_return);
+        //rh jako iloraz, a rb to reszta
+    }
+
+    /// @brief mnożenie ArithmeticKernel::BASIC metodą rosyjskich chłopów: jeden bit rb na obrót
+    void generateMultBasic(){
+        emit(Op::RST, 'a', "MULT START"); //ra = 0
+        in_arithmetic_loop = true;
+        int L_loop = newLable();
+        defineLable(L_loop);
+        emitHelper(Helper::MULT_BIT_TEST); //rd = suma, ra = rb%2
+        int L_even = newLable();
+        emitLable(L_even, Op::JZERO); // jeśli rb%2==0 jump
+        emitHelper(Helper::MULT_ADD); //rd += rc
+        defineLable(L_even);
+        emitHelper(Helper::MULT_SHIFT); //rc = 2*rc, ra = rb/2, rb = suma
+        int L_end = newLable();
+        emitLable(L_end, Op::JZERO); // jeśli rb==0 end
+        emitHelper(Helper::MULT_NEXT);
+        emitLable(L_loop, Op::JUMP); // while(rb)
+        in_arithmetic_loop = false;
+        defineLable(L_end);
+        emitHelper(Helper::MULT_END, "MULT END");
+    }
+
+    /// @brief dzielenie ArithmeticKernel::ADAPTIVE. Kończy się od razu, gdy dzielna jest mniejsza od dzielnika
+    /// (iloraz 0, reszta rb) albo dzielnik jest równy 1. Iloraz jest przesuwany w lewo i zwiększany o bit,
+    /// zamiast dodawać do niego rd, a pętla ilorazu liczy dwa bity na obrót
+    void generateDivAdaptive(bool check_zero){
+        int L_zero_div = newLable(), L_one = newLable(), L_return = newLable();
+        if(check_zero){
+            emitHelper(Helper::DIV_ZERO_CHECK);
+            emitLable(L_zero_div, Op::JZERO);
+            emit(Op::DEC, 'a');
+            emitLable(L_one, Op::JZERO); // rc == 1
+        }
+        emit(Op::RST, 'h');
+        emitHelper(Helper::DIV_COMPARE, "Starting DIV"); // ra = rc-rb
+        emitLable(L_return, Op::JPOS); // rb < rc: iloraz 0, reszta rb
+        emit(Op::RST, 'd'); emit(Op::INC, 'd'); // rd = 1
+        in_arithmetic_loop = true;
+
+        int L_start = newLable();
+        defineLable(L_start);
+        emitHelper(Helper::DIV_SCALE_TEST); //ra = 2*rc-rb
+        int L_loop = newLable();
+        emitLable(L_loop, Op::JPOS);
+        emitHelper(Helper::DIV_DOUBLE); //rc = 2*rc, rd = 2*rd
+        emitLable(L_start, Op::JUMP);
+
+        defineLable(L_loop);
+        for(int i = 0; i < 2; i++){
+            emitHelper(Helper::DIV_BIT_TEST); //ra = rd
+            emitLable(L_return, Op::JZERO);
+            emit(Op::SHL, 'h');
+            emitHelper(Helper::DIV_COMPARE); // ra = rc-rb
+            int L_skip = newLable();
+            emitLable(L_skip, Op::JPOS);
+            emitHelper(Helper::DIV_QUOTIENT_BIT); //rb = rb-rc, rh = rh+1
+            defineLable(L_skip);
+            emitHelper(Helper::DIV_HALVE); //rc = rc/2, rd = rd/2
+        }
+        emitLable(L_loop, Op::JUMP);
+        in_arithmetic_loop = false;
+        if(check_zero){
+            defineLable(L_one); // ra = 0
+            emit(Op::SWP, 'b'); // rb = 0
+            emit(Op::SWP, 'h'); // rh = dzielna
+            emitLable(L_return, Op::JUMP);
+            defineLable(L_zero_div);
+            emit(Op::RST, 'b');
+            emit(Op::RST, 'h');
+        }
         defineLable(L_return);
         //rh jako iloraz, a rb to reszta
     }
 
-    /// @brief generuje kod mnożenia ra = rb * rc.
-    /// @param jump_lable aktualny numer lini by statycznie uzupełnić instrukcje skoku (zaprogramowane przed generowaniem skoków i backpatchingiem)
-    void generateMult(unsigned long long jump_lable ){
-        emit("RST a #MULT START"); //ra = 0
-        emit("SWP d"); //ra <-> rd
-        emit("RST a"); //ra = 0
-        emit("ADD b"); //ra += b
-        emit("SHR a"); //ra = ra/2
-        emit("SHL a"); //ra = ra*2
-        emit("SWP b"); //ra <-> rb
-        emit("SUB b"); //ra = ra-rb
-        emit("JZERO", jump_lable+12); // jeśli rb%2==0 jump
-        emit("SWP d");
-        emit("ADD c");
-        emit("SWP d");
-        emit("SWP d");
-        emit("SHL c");
-        emit("SHR b");
-        emit("SWP b");
-        emit("JZERO", jump_lable+19); // jeśli rb==0 end
-        emit("SWP b");
-        emit("JUMP", jump_lable+1); // while(rb)
-        emit("SWP b #MULT END");
-    }
-
-    /// @brief generuje kod ra = (rb - rc) + (rc - rb) do sprawdzania czy rc == rb instrukcją JPOS
-    void generateIsEqual(){
-        emit("RST a");
-        emit("ADD b");
-        emit("SUB c"); // ra = val1 - val2
-        emit("SWP d"); // schowaj wynik w rd
-    
-        emit("RST a");
-        emit("ADD c");
-        emit("SUB b"); // ra = val2 - val1
-        
-        emit("ADD d"); // ra = (val2-val1) + (val1-val2)
+    /// @brief mnożenie ArithmeticKernel::ADAPTIVE: pętla po mniejszym czynniku, dwa bity (cyfra rb % 4) na obrót,
+    /// wczesne wyjście, gdy czynnik jest równy 0 albo 1. Suma częściowa jest w rd
+    void generateMultAdaptive(bool order_operands){
+        emit(Op::RST, 'd', "MULT START");
+        if(order_operands){
+            emitHelper(Helper::DIV_COMPARE); // ra = rc-rb
+            int L_ordered = newLable();
+            emitLable(L_ordered, Op::JPOS);
+            emit(Op::SWP, 'b'); emit(Op::SWP, 'c'); emit(Op::SWP, 'b'); // rb <-> rc
+            defineLable(L_ordered);
+        }
+        int L_end = newLable(), L_one = newLable();
+        emit(Op::RST, 'a'); emit(Op::ADD, 'b');
+        emitLable(L_end, Op::JZERO); // rb == 0
+        emit(Op::DEC, 'a');
+        emitLable(L_one, Op::JZERO); // rb == 1
+        emit(Op::INC, 'a');
+        in_arithmetic_loop = true;
+
+        int L_loop = newLable();
+        defineLable(L_loop); // ra = rb > 0
+        emitHelper(Helper::MULT_DIGIT); //ra = rb%4
+        int L_next = newLable();
+        emitLable(L_next, Op::JZERO);
+        for(int digit = 1; digit <= 3; digit++){ // rd += cyfra * rc
+            if(digit > 1){
+                emit(Op::DEC, 'a');
+                emitLable(L_next, Op::JZERO);
+            }
+            emitHelper(Helper::MULT_ADD);
+        }
+        defineLable(L_next);
+        emit(Op::SHR, 'b'); emit(Op::SHR, 'b');
+        emit(Op::RST, 'a'); emit(Op::ADD, 'b');
+        emitLable(L_end, Op::JZERO); // while(rb)
+        emit(Op::SHL, 'c'); emit(Op::SHL, 'c');
+        emitLable(L_loop, Op::JUMP);
+        in_arithmetic_loop = false;
+
+        defineLable(L_one); // ra = 0, rd = 0
+        emit(Op::ADD, 'c');
+        emit(Op::SWP, 'd');
+        defineLable(L_end);
+        emit(Op::SWP, 'd', "MULT END");
     }
 
 };
\ No newline at end of file
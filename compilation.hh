@@ -0,0 +1,46 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "arena.hh"
+#include "codeGenerator.hh"
+#include "symbolTable.hh"
+#include "tokenStream.hh"
+#include "registerAllocator.hh"
+#include "knownValues.hh"
+#include "options.hh"
+#include "stats.hh"
+
+/// @brief Błąd w kompilowanym programie (składniowy albo semantyczny), z komunikatem gotowym do wypisania,
+/// np. "Error on line 3: Variable "x" not declared"
+class CompileError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/// @brief Stan jednej kompilacji. Parser i lekser są wielowejściowe (api.pure, reentrant) i dostają ten obiekt
+/// zamiast zmiennych globalnych, więc kilka kompilacji może działać jednocześnie w różnych wątkach.
+/// Obiekt musi żyć, dopóki używany jest wygenerowany kod: komentarze instrukcji wskazują na nazwy procedur z tablicy symboli
+struct Compilation {
+    Arena arena;        // identyfikatory i węzły parsera żyją do końca kompilacji
+    StringPool names;   // nazwy zmiennych i procedur
+    CompilerOptions options;
+    CodeGenerator codeGen;
+    SymbolTable symbolTable{names, arena};
+    TokenStream tokenStream;
+    RegisterAllocator registerAllocator;
+    int for_counter = 0;                          // numer kolejnej pętli FOR w obecnym zakresie (zgodny z kolejnością w RegisterAllocator)
+    KnownValues knownValues;                      // zmienne o wartości znanej w czasie kompilacji
+    std::vector<KnownValues::State> known_stack;  // stany propagacji stałych zapamiętane na początku IF i pętli
+    std::vector<signed char> if_known;            // znane wartości warunków otwartych IF (-1 gdy nieznany)
+    int inline_depth = 0;                         // zagnieżdżenie w ciałach wstawionych procedur
+    int line = 1;                                 // linia ostatniego tokenu podanego parserowi
+    CompilerStats stats;                          // czas faz (--stats)
+
+    explicit Compilation(const CompilerOptions& options) : options(options) {
+        codeGen.kernel = options.kernel;
+    }
+    Compilation(const Compilation&) = delete;
+    Compilation& operator=(const Compilation&) = delete;
+};
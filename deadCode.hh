@@ -0,0 +1,310 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include "instruction.hh"
+#include "symbolTable.hh"
+
+/// Limit kroków przeszukiwania martwych zapisów w jednym przebiegu, na instrukcję programu
+const size_t DEAD_STORE_SEARCH_STEPS = 16;
+
+/// @brief Usuwanie martwego kodu na gotowym programie (skoki mają już numery linii), przed optymalizacją przez szparkę.
+/// Buduje graf przepływu sterowania razem z wywołaniami procedur (CALL prowadzi do początku procedury, RTRN do miejsc
+/// za jej wywołaniami) i usuwa:
+/// - skoki warunkowe o znanym wyniku (JZERO/JPOS po RST a) i kod, do którego nic nie prowadzi, w tym niewywoływane procedury,
+/// - STORE do komórek dostępnych tylko bezpośrednio, gdy zapisana wartość nie jest potem odczytana (LOAD) przed
+///   kolejnym zapisem albo końcem programu,
+/// - instrukcje bez efektów ubocznych, których wynik (rejestr) nie jest potem użyty.
+class DeadCodeEliminator {
+    unsigned long long foldedBranches = 0;
+    unsigned long long removedUnreachable = 0;
+    unsigned long long removedStores = 0;
+    unsigned long long removedDead = 0;
+    unsigned long long removedInstructions = 0;
+    unsigned long long savedCost = 0; // suma kosztów usuniętych instrukcji (statycznie)
+
+    std::vector<std::vector<unsigned>> succ, pred; // graf przepływu sterowania na instrukcjach
+
+    static unsigned bit(char reg) {
+        return 1u << (reg - 'a');
+    }
+
+    /// @brief rejestry czytane przez instrukcję
+    static unsigned uses(const Instr& in) {
+        const unsigned a = bit('a');
+        switch (in.op) {
+            case Op::WRITE: case Op::STORE: case Op::JPOS: case Op::JZERO: case Op::RTRN:
+                return a;
+            case Op::RLOAD: case Op::INC: case Op::DEC: case Op::SHL: case Op::SHR:
+                return bit(in.reg);
+            case Op::RSTORE: case Op::ADD: case Op::SUB: case Op::SWP:
+                return a | bit(in.reg);
+            default:
+                return 0;
+        }
+    }
+
+    /// @brief rejestry zapisywane przez instrukcję
+    static unsigned defines(const Instr& in) {
+        const unsigned a = bit('a');
+        switch (in.op) {
+            case Op::READ: case Op::LOAD: case Op::RLOAD: case Op::ADD: case Op::SUB: case Op::CALL:
+                return a;
+            case Op::SWP:
+                return a | bit(in.reg);
+            case Op::RST: case Op::INC: case Op::DEC: case Op::SHL: case Op::SHR:
+                return bit(in.reg);
+            default:
+                return 0;
+        }
+    }
+
+    /// @brief czy instrukcja zmienia tylko rejestry (można ją usunąć, gdy jej wynik nie jest potrzebny)
+    static bool pure(Op op) {
+        switch (op) {
+            case Op::LOAD: case Op::RLOAD: case Op::ADD: case Op::SUB: case Op::SWP:
+            case Op::RST: case Op::INC: case Op::DEC: case Op::SHL: case Op::SHR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /// @brief Buduje graf przepływu sterowania. RTRN należy do procedury o najbliższym wcześniejszym początku
+    /// (celu CALL) i prowadzi za każde jej wywołanie
+    void buildGraph(const std::vector<Instr>& code) {
+        size_t n = code.size();
+        std::map<unsigned long long, std::vector<unsigned>> returnSites; // początek procedury -> miejsca powrotu
+        for (size_t i = 0; i < n; i++)
+            if (code[i].op == Op::CALL && code[i].arg < n) returnSites[code[i].arg].push_back((unsigned)i + 1);
+
+        succ.assign(n, {});
+        pred.assign(n, {});
+        for (size_t i = 0; i < n; i++) {
+            const Instr& in = code[i];
+            std::vector<unsigned>& s = succ[i];
+            switch (in.op) {
+                case Op::HALT:
+                    break;
+                case Op::JUMP: case Op::CALL:
+                    if (in.arg < n) s.push_back((unsigned)in.arg);
+                    break;
+                case Op::JPOS: case Op::JZERO:
+                    if (in.arg < n) s.push_back((unsigned)in.arg);
+                    if (i + 1 < n && in.arg != i + 1) s.push_back((unsigned)i + 1);
+                    break;
+                case Op::RTRN: {
+                    auto proc = returnSites.upper_bound(i);
+                    if (proc != returnSites.begin())
+                        for (unsigned site : std::prev(proc)->second) if (site < n) s.push_back(site);
+                    break;
+                }
+                default:
+                    if (i + 1 < n) s.push_back((unsigned)i + 1);
+            }
+            for (unsigned t : s) pred[t].push_back((unsigned)i);
+        }
+    }
+
+    /// @brief Usuwa zaznaczone instrukcje i przelicza cele skoków (skok do usuniętej instrukcji trafia do następnej)
+    void compact(std::vector<Instr>& code, const std::vector<bool>& removed) {
+        std::vector<unsigned long long> newIndex(code.size() + 1);
+        unsigned long long kept = 0;
+        for (size_t i = 0; i < code.size(); i++) {
+            newIndex[i] = kept;
+            if (!removed[i]) kept++;
+            else savedCost += instrCost(code[i].op);
+        }
+        newIndex[code.size()] = kept;
+
+        std::vector<Instr> result;
+        result.reserve(kept);
+        for (size_t i = 0; i < code.size(); i++) {
+            if (removed[i]) continue;
+            Instr in = code[i];
+            if (isJump(in.op) && in.arg <= code.size()) in.arg = newIndex[in.arg];
+            result.push_back(in);
+        }
+        removedInstructions += code.size() - result.size();
+        code.swap(result);
+    }
+
+    /// @brief Skoki warunkowe, przed którymi w tym samym bloku ustalono wartość ra (RST a, INC a, ...):
+    /// wykonywany zawsze staje się JUMP, niewykonywany jest usuwany
+    bool foldBranches(std::vector<Instr>& code, std::vector<bool>& removed) {
+        std::vector<bool> target(code.size() + 1, false);
+        for (size_t i = 0; i < code.size(); i++) {
+            if (isJump(code[i].op) && code[i].arg < target.size()) target[code[i].arg] = true;
+            if (code[i].op == Op::CALL) target[i + 1] = true;
+        }
+        bool changed = false;
+        long long a = -1; // znana wartość ra (ograniczona do małych liczb) albo -1
+        for (size_t i = 0; i < code.size(); i++) {
+            Instr& in = code[i];
+            if (target[i]) a = -1;
+            if ((in.op == Op::JZERO || in.op == Op::JPOS) && a >= 0) {
+                bool taken = in.op == Op::JZERO ? a == 0 : a > 0;
+                if (taken) in.op = Op::JUMP;
+                else removed[i] = true;
+                foldedBranches++;
+                changed = true;
+            }
+            if (in.op == Op::RST && in.reg == 'a') a = 0;
+            else if (in.op == Op::INC && in.reg == 'a' && a >= 0 && a < (1 << 20)) a++;
+            else if (in.op == Op::DEC && in.reg == 'a' && a > 0) a--;
+            else if (defines(in) & bit('a')) a = -1;
+            if (in.op == Op::JUMP || in.op == Op::RTRN || in.op == Op::HALT) a = -1;
+        }
+        return changed;
+    }
+
+    /// @brief Zaznacza instrukcje, do których nie prowadzi żadna ścieżka od początku programu
+    bool markUnreachable(const std::vector<Instr>& code, std::vector<bool>& removed) {
+        std::vector<bool> reached(code.size(), false);
+        std::vector<unsigned> stack;
+        if (!code.empty()) {
+            reached[0] = true;
+            stack.push_back(0);
+        }
+        while (!stack.empty()) {
+            unsigned i = stack.back();
+            stack.pop_back();
+            for (unsigned s : succ[i]) {
+                if (reached[s]) continue;
+                reached[s] = true;
+                stack.push_back(s);
+            }
+        }
+        bool changed = false;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (reached[i] || removed[i]) continue;
+            removed[i] = true;
+            removedUnreachable++;
+            changed = true;
+        }
+        return changed;
+    }
+
+    /// @brief Zaznacza martwe STORE do komórek dostępnych tylko bezpośrednio. Żywotność każdej komórki liczona jest
+    /// osobno, przeszukiwaniem wstecz od jej odczytów (LOAD) do zapisów, więc koszt zależy od zasięgu zmiennej.
+    /// Zmienne procedur na końcu długich łańcuchów wywołań sięgają wstecz przez wszystkie miejsca wywołań, dlatego
+    /// przeszukiwania mają wspólny limit kroków: komórki, których nie zdążono przejrzeć, zachowują wszystkie zapisy
+    bool markDeadStores(const std::vector<Instr>& code, const IndirectMemory& indirect, std::vector<bool>& removed) {
+        std::unordered_map<unsigned long long, unsigned> ids; // adres -> numer komórki
+        std::vector<std::vector<unsigned>> loads, stores;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i].op != Op::STORE || indirect.contains(code[i].arg)) continue;
+            if (ids.emplace(code[i].arg, (unsigned)ids.size()).second) {
+                loads.emplace_back();
+                stores.emplace_back();
+            }
+            stores[ids[code[i].arg]].push_back((unsigned)i);
+        }
+        for (size_t i = 0; i < code.size(); i++) {
+            if (code[i].op != Op::LOAD) continue;
+            auto it = ids.find(code[i].arg);
+            if (it != ids.end()) loads[it->second].push_back((unsigned)i);
+        }
+
+        bool changed = false;
+        std::vector<unsigned> liveBefore(code.size(), 0); // numer komórki + 1, gdy żyje tuż przed instrukcją
+        std::vector<unsigned> stack;
+        size_t budget = DEAD_STORE_SEARCH_STEPS * code.size();
+        for (const auto& [address, id] : ids) {
+            unsigned mark = id + 1;
+            for (unsigned load : loads[id]) {
+                if (liveBefore[load] == mark) continue;
+                liveBefore[load] = mark;
+                stack.push_back(load);
+            }
+            while (!stack.empty() && budget > 0) {
+                unsigned i = stack.back();
+                stack.pop_back();
+                budget--;
+                for (unsigned p : pred[i]) {
+                    if (liveBefore[p] == mark || (code[p].op == Op::STORE && code[p].arg == address)) continue;
+                    liveBefore[p] = mark;
+                    stack.push_back(p);
+                }
+            }
+            if (!stack.empty()) break; // limit wyczerpany w trakcie - żywotność tej komórki nieznana
+            for (unsigned store : stores[id]) {
+                bool live = false;
+                for (unsigned s : succ[store]) live = live || liveBefore[s] == mark;
+                if (live || removed[store]) continue;
+                removed[store] = true;
+                removedStores++;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    /// @brief Zaznacza instrukcje bez efektów ubocznych, których wynik nie jest użyty. Żywotność rejestrów pomija
+    /// odczyty w instrukcjach, które same są martwe, więc cały łańcuch obliczeń martwej wartości znika za jednym razem
+    bool markDeadInstructions(const std::vector<Instr>& code, std::vector<bool>& removed) {
+        size_t n = code.size();
+        std::vector<unsigned char> liveIn(n, 0), liveOut(n, 0);
+        std::vector<unsigned> worklist;
+        std::vector<bool> queued(n, true);
+        for (size_t i = 0; i < n; i++) worklist.push_back((unsigned)i); // od końca programu (stos)
+        while (!worklist.empty()) {
+            unsigned i = worklist.back();
+            worklist.pop_back();
+            queued[i] = false;
+            unsigned out = 0;
+            for (unsigned s : succ[i]) out |= liveIn[s];
+            liveOut[i] = (unsigned char)out;
+            const Instr& in = code[i];
+            unsigned def = defines(in);
+            unsigned live = pure(in.op) && !(def & out) ? out : (uses(in) | (out & ~def));
+            if (live == liveIn[i]) continue;
+            liveIn[i] = (unsigned char)live;
+            for (unsigned p : pred[i]) {
+                if (queued[p]) continue;
+                queued[p] = true;
+                worklist.push_back(p);
+            }
+        }
+        bool changed = false;
+        for (size_t i = 0; i < n; i++) {
+            if (removed[i] || !pure(code[i].op) || (defines(code[i]) & liveOut[i])) continue;
+            removed[i] = true;
+            removedDead++;
+            changed = true;
+        }
+        return changed;
+    }
+
+public:
+    /// @brief Usuwa martwy kod aż do punktu stałego
+    /// @param indirect komórki pamięci dostępne pośrednio (ich zapisy nie są usuwane)
+    void run(std::vector<Instr>& code, const IndirectMemory& indirect) {
+        for (int iteration = 0; iteration < 100 && !code.empty(); iteration++) {
+            std::vector<bool> removed(code.size(), false);
+            bool changed = foldBranches(code, removed);
+            buildGraph(code);
+            changed = markUnreachable(code, removed) || changed;
+            if (changed) { // martwe zapisy liczymy na grafie bez usuniętego kodu
+                compact(code, removed);
+                continue;
+            }
+            changed = markDeadStores(code, indirect, removed);
+            changed = markDeadInstructions(code, removed) || changed;
+            if (!changed) break;
+            compact(code, removed);
+        }
+    }
+
+    /// @brief Wypisuje, ile instrukcji i kosztu (statycznie) usunięto
+    void report(std::ostream& out) const {
+        out << "dead code: removed " << removedInstructions << " instructions, saved " << savedCost << " cost units\n"
+            << "  unreachable: " << removedUnreachable << "\n"
+            << "  dead stores: " << removedStores << "\n"
+            << "  dead computations: " << removedDead << "\n"
+            << "  folded branches: " << foldedBranches << "\n";
+    }
+};
@@ -0,0 +1,89 @@
+// Plik wygenerowany przez superopt (make helpers) - nie edytować ręcznie.
+#pragma once
+#include "instruction.hh"
+
+/// @brief Instrukcja sekwencji pomocniczej
+struct HelperStep {
+    Op op;
+    char reg;
+};
+
+/// @brief Sekwencja pomocnicza generatora kodu znaleziona przez superoptymalizator (superopt.cc)
+struct HelperSequence {
+    const char* name;
+    const HelperStep* steps;
+    unsigned length;
+    unsigned cost;
+    bool optimal; // przeszukano wszystkie tańsze ciągi
+};
+
+enum class Helper {
+    MULT_BIT_TEST,
+    MULT_ADD,
+    MULT_SHIFT,
+    MULT_NEXT,
+    MULT_END,
+    MULT_DIGIT,
+    DIV_ZERO_CHECK,
+    DIV_INIT,
+    DIV_SCALE_TEST,
+    DIV_DOUBLE,
+    DIV_BIT_TEST,
+    DIV_COMPARE,
+    DIV_SUBTRACT,
+    DIV_QUOTIENT_BIT,
+    DIV_HALVE,
+};
+
+// ra = 0 gdy rb parzyste; suma częściowa z ra do rd; rc i rb >> 1 bez zmian
+inline constexpr HelperStep MULT_BIT_TEST_STEPS[] = {{Op::SWP, 'd'}, {Op::RST, 'a'}, {Op::ADD, 'b'}, {Op::SHR, 'a'}, {Op::SHL, 'a'}, {Op::SWP, 'b'}, {Op::SUB, 'b'}};
+// rd = rd + rc; ra, rc i rb >> 1 bez zmian
+inline constexpr HelperStep MULT_ADD_STEPS[] = {{Op::SWP, 'd'}, {Op::ADD, 'c'}, {Op::SWP, 'd'}};
+// rc = 2 * rc, ra = rb >> 1 (warunek końca pętli), rb = suma częściowa z rd
+inline constexpr HelperStep MULT_SHIFT_STEPS[] = {{Op::SWP, 'd'}, {Op::SHL, 'c'}, {Op::SHR, 'b'}, {Op::SWP, 'b'}};
+// zamiana ra i rb przed kolejnym obrotem (ra = suma częściowa, rb = mnożnik)
+inline constexpr HelperStep MULT_NEXT_STEPS[] = {{Op::SWP, 'b'}};
+// wynik mnożenia z rb do ra, gdy ra = 0
+inline constexpr HelperStep MULT_END_STEPS[] = {{Op::SWP, 'b'}};
+// ra = rb % 4, rb >> 2 bez zmian, gdy ra = rb; rc, rd bez zmian
+inline constexpr HelperStep MULT_DIGIT_STEPS[] = {{Op::SHR, 'b'}, {Op::SHR, 'b'}, {Op::SHL, 'b'}, {Op::SHL, 'b'}, {Op::SUB, 'b'}};
+// ra = 0 gdy rc = 0; rb i rc bez zmian
+inline constexpr HelperStep DIV_ZERO_CHECK_STEPS[] = {{Op::RST, 'a'}, {Op::ADD, 'c'}};
+// rd = 1, rh = 0; rb i rc bez zmian
+inline constexpr HelperStep DIV_INIT_STEPS[] = {{Op::RST, 'd'}, {Op::INC, 'd'}, {Op::RST, 'h'}};
+// ra > 0 gdy 2 * rc > rb; rb, rc, rd, rh bez zmian
+inline constexpr HelperStep DIV_SCALE_TEST_STEPS[] = {{Op::RST, 'a'}, {Op::ADD, 'c'}, {Op::SHL, 'a'}, {Op::SUB, 'b'}};
+// rc = 2 * rc, rd = 2 * rd; rb, rh bez zmian
+inline constexpr HelperStep DIV_DOUBLE_STEPS[] = {{Op::SHL, 'c'}, {Op::SHL, 'd'}};
+// ra = 0 gdy rd = 0; rb, rc, rd, rh bez zmian
+inline constexpr HelperStep DIV_BIT_TEST_STEPS[] = {{Op::RST, 'a'}, {Op::ADD, 'd'}};
+// ra > 0 gdy rc > rb; rb, rc, rd, rh bez zmian
+inline constexpr HelperStep DIV_COMPARE_STEPS[] = {{Op::RST, 'a'}, {Op::ADD, 'c'}, {Op::SUB, 'b'}};
+// rb = rb - rc, rh = rh + rd, gdy ra = 0 i rb >= rc; rc, rd bez zmian
+inline constexpr HelperStep DIV_SUBTRACT_STEPS[] = {{Op::SWP, 'b'}, {Op::SUB, 'c'}, {Op::SWP, 'b'}, {Op::SWP, 'h'}, {Op::ADD, 'd'}, {Op::SWP, 'h'}};
+// rb = rb - rc, rh = rh + 1, gdy ra = 0 i rb >= rc; rc, rd bez zmian
+inline constexpr HelperStep DIV_QUOTIENT_BIT_STEPS[] = {{Op::SWP, 'b'}, {Op::SUB, 'c'}, {Op::SWP, 'b'}, {Op::INC, 'h'}};
+// rc = rc >> 1, rd = rd >> 1; rb, rh bez zmian
+inline constexpr HelperStep DIV_HALVE_STEPS[] = {{Op::SHR, 'c'}, {Op::SHR, 'd'}};
+
+inline constexpr HelperSequence HELPER_SEQUENCES[] = {
+    {"MULT_BIT_TEST", MULT_BIT_TEST_STEPS, 7, 23, false},
+    {"MULT_ADD", MULT_ADD_STEPS, 3, 15, false},
+    {"MULT_SHIFT", MULT_SHIFT_STEPS, 4, 12, false},
+    {"MULT_NEXT", MULT_NEXT_STEPS, 1, 5, true},
+    {"MULT_END", MULT_END_STEPS, 1, 5, true},
+    {"MULT_DIGIT", MULT_DIGIT_STEPS, 5, 9, false},
+    {"DIV_ZERO_CHECK", DIV_ZERO_CHECK_STEPS, 2, 6, true},
+    {"DIV_INIT", DIV_INIT_STEPS, 3, 3, true},
+    {"DIV_SCALE_TEST", DIV_SCALE_TEST_STEPS, 4, 12, false},
+    {"DIV_DOUBLE", DIV_DOUBLE_STEPS, 2, 2, true},
+    {"DIV_BIT_TEST", DIV_BIT_TEST_STEPS, 2, 6, true},
+    {"DIV_COMPARE", DIV_COMPARE_STEPS, 3, 11, false},
+    {"DIV_SUBTRACT", DIV_SUBTRACT_STEPS, 6, 30, false},
+    {"DIV_QUOTIENT_BIT", DIV_QUOTIENT_BIT_STEPS, 4, 16, false},
+    {"DIV_HALVE", DIV_HALVE_STEPS, 2, 2, true},
+};
+
+inline const HelperSequence& helperSequence(Helper helper) {
+    return HELPER_SEQUENCES[(int)helper];
+}
@@ -0,0 +1,258 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tokenStream.hh"
+#include "options.hh"
+
+// Progi heurystyki wstawiania, w tokenach ciała procedury (już po wstawieniu wywołań w tym ciele)
+const int INLINE_SMALL_TOKENS = 40;   // ciało niewiele większe od przekazania argumentów i CALL - wstawiamy zawsze
+const int INLINE_LOOP_TOKENS = 200;   // wywołanie w pętli opłaca się wstawić dla większego ciała
+const int INLINE_GROWTH_TOKENS = 600; // dopuszczalny przyrost kodu: rozmiar ciała * (liczba wywołań - 1)
+
+/// @brief Wstawia ciała procedur w miejsca wywołań na poziomie tokenów, przed analizą rejestrów i parsowaniem.
+/// Wywołanie p(a, b); zamieniane jest na INLINE_BEGIN <ciało p> INLINE_END, gdzie parametry p są zastąpione
+/// argumentami wywołania, a zmienne lokalne i iteratory p nowymi nazwami z cyfrą (nie kolidują z nazwami z programu).
+/// Parametry są przekazywane przez referencję, więc podstawienie nazw zachowuje znaczenie wywołania,
+/// również gdy ten sam argument jest przekazany kilka razy. Każde miejsce wstawienia ma własną kopię zmiennych lokalnych.
+/// Definicje procedur zostają - parser dalej je sprawdza, a nieużywane ciała usuwa usuwanie martwego kodu.
+class Inliner {
+    struct Procedure {
+        std::vector<std::string> params;
+        std::vector<char> types;            // 'T', 'I', 'O' albo 'N' dla każdego parametru
+        std::vector<InlineLocal> locals;    // zmienne lokalne z deklaracji
+        std::set<std::string> bound;        // nazwy do przemianowania: lokalne, iteratory i lokalne wstawionych procedur
+        std::vector<Token> body;            // tokeny ciała (bez IN i END) po wstawieniu wywołań
+    };
+
+    CompilerOptions options;
+    Arena& arena;                                // miejsca wstawienia i nowe identyfikatory
+    StringPool& names;
+    std::map<std::string, Procedure> procedures; // procedury zdefiniowane przed obecnym miejscem
+    std::map<std::string, int> calls;            // liczba wywołań każdej procedury w programie
+    int sites = 0;                               // licznik miejsc wstawienia (do unikalnych nazw)
+
+    /// @brief Czy wstawić wywołanie callee(args)
+    /// @param loopDepth zagnieżdżenie wywołania w pętlach
+    /// @param iterators iteratory pętli FOR otwartych w miejscu wywołania
+    /// @param line linia wywołania. Z profilem (--profile-use) wywołanie powtarzane traktujemy jak wywołanie w pętli,
+    /// a wywołanie, które się nie wykonało, wstawiamy tylko gdy procedura jest mała albo wywołana raz
+    bool shouldInline(const std::string& callee, const std::vector<std::string>& args, int loopDepth,
+                      const std::vector<std::string>& iterators, int line) const {
+        auto found = procedures.find(callee);
+        if (found == procedures.end()) return false; // nieznana procedura albo rekurencja - błąd zgłosi parser
+        const Procedure& proc = found->second;
+        if (proc.params.size() != args.size()) return false;
+        for (size_t k = 0; k < args.size(); k++) {
+            // po podstawieniu iterator mógłby zostać zmieniony w ciele procedury
+            if (proc.types[k] == 'I') continue;
+            for (const std::string& it : iterators)
+                if (it == args[k]) return false;
+        }
+        if (options.inlineMode == InlineMode::ALWAYS || options.forceInline.count(callee)) return true;
+
+        int size = (int)proc.body.size();
+        int count = calls.count(callee) ? calls.at(callee) : 0;
+        if (count <= 1 || size <= INLINE_SMALL_TOKENS) return true;
+        unsigned long long executions;
+        bool profiled = options.profile.count(line, executions);
+        if (profiled && executions == 0) return false; // wywołanie, które się nie wykonało, nie jest warte przyrostu kodu
+        if ((loopDepth > 0 || (profiled && executions > 1)) && size <= INLINE_LOOP_TOKENS) return true;
+        return size * (count - 1) <= INLINE_GROWTH_TOKENS;
+    }
+
+    /// @brief Dopisuje do out ciało callee z podstawionymi argumentami
+    void emitInlined(std::vector<Token>& out, const std::string& callee, const std::vector<std::string>& args, int line) {
+        const Procedure& proc = procedures.at(callee);
+        std::string prefix = callee + std::to_string(++sites) + "_";
+
+        std::map<std::string, std::string> rename; // nazwa w ciele -> nazwa w miejscu wywołania
+        for (const std::string& name : proc.bound) rename[name] = prefix + name;
+        for (size_t k = 0; k < args.size(); k++) rename[proc.params[k]] = args[k];
+
+        InlineSite* site = arena.make<InlineSite>(callee, args, proc.locals);
+        for (InlineLocal& local : site->locals) local.name = rename[local.name];
+        Token begin{INLINE_BEGIN, {}, line};
+        begin.value.inline_site = site;
+        out.push_back(begin);
+
+        std::map<std::string, Identifier*> created; // jeden identyfikator na nową nazwę
+        const std::vector<Token>& body = proc.body;
+        for (size_t i = 0; i < body.size(); i++) {
+            Token t = body[i];
+            bool isCall = i + 1 < body.size() && body[i + 1].kind == LPAREN;
+            if (t.kind == PIDENTIFIER && !isCall) {
+                auto r = rename.find(t.value.id->pid);
+                if (r != rename.end()) {
+                    Identifier*& id = created[r->second];
+                    if (!id) id = arena.make<Identifier>(names.intern(r->second), (unsigned long long)t.line, names.id(r->second));
+                    t.value.id = id;
+                }
+            } else if (t.kind == INLINE_BEGIN) { // procedura wstawiona wcześniej w ciało callee
+                InlineSite* nested = arena.make<InlineSite>(*t.value.inline_site);
+                for (std::string& arg : nested->args)
+                    if (auto r = rename.find(arg); r != rename.end()) arg = r->second;
+                for (InlineLocal& local : nested->locals) local.name = rename[local.name];
+                t.value.inline_site = nested;
+            }
+            out.push_back(t);
+        }
+        out.push_back(Token{INLINE_END, {}, line});
+    }
+
+    /// @brief Przepisuje do out komendy ciała zaczynające się od tokenu begin, wstawiając wywołania procedur
+    /// @return indeks tokenu END kończącego ciało
+    int expandBody(const std::vector<Token>& tokens, int begin, std::vector<Token>& out) {
+        int n = (int)tokens.size();
+        int loopDepth = 0;
+        bool inUntil = false;
+        std::vector<std::string> iterators;
+        int i = begin;
+        for (; i < n && tokens[i].kind != END; i++) {
+            const Token& t = tokens[i];
+            switch (t.kind) {
+            case FOR:
+                if (i + 1 < n && tokens[i + 1].kind == PIDENTIFIER) iterators.push_back(tokens[i + 1].value.id->pid);
+                loopDepth++;
+                break;
+            case ENDFOR:
+                if (!iterators.empty()) iterators.pop_back();
+                loopDepth--;
+                break;
+            case WHILE: case REPEAT:
+                loopDepth++;
+                break;
+            case ENDWHILE:
+                loopDepth--;
+                break;
+            case UNTIL:
+                inUntil = true;
+                break;
+            case SEMICOLON:
+                if (inUntil) {
+                    loopDepth--;
+                    inUntil = false;
+                }
+                break;
+            case PIDENTIFIER:
+                if (i + 1 < n && tokens[i + 1].kind == LPAREN) { // wywołanie: p ( a , b ) ;
+                    std::vector<std::string> args;
+                    int j = i + 2;
+                    bool wellFormed = true;
+                    for (; j < n && tokens[j].kind != RPAREN; j++) {
+                        if (tokens[j].kind == PIDENTIFIER) args.push_back(tokens[j].value.id->pid);
+                        else if (tokens[j].kind != COMMA) wellFormed = false;
+                    }
+                    if (wellFormed && j + 1 < n && tokens[j + 1].kind == SEMICOLON
+                        && shouldInline(t.value.id->pid, args, loopDepth, iterators, t.line)) {
+                        emitInlined(out, t.value.id->pid, args, t.line);
+                        i = j + 1;
+                        continue;
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+            out.push_back(t);
+        }
+        return i;
+    }
+
+    /// @brief Zbiera nazwy związane w ciele procedury: lokalne, iteratory i lokalne wstawionych w nie procedur
+    static void collectBound(Procedure& proc) {
+        for (const InlineLocal& local : proc.locals) proc.bound.insert(local.name);
+        const std::vector<Token>& body = proc.body;
+        for (size_t i = 0; i < body.size(); i++) {
+            if (body[i].kind == FOR && i + 1 < body.size() && body[i + 1].kind == PIDENTIFIER)
+                proc.bound.insert(body[i + 1].value.id->pid);
+            else if (body[i].kind == INLINE_BEGIN)
+                for (const InlineLocal& local : body[i].value.inline_site->locals) proc.bound.insert(local.name);
+        }
+    }
+
+    /// @brief Przepisuje nagłówek i deklaracje procedury (od PROCEDURE do IN włącznie), zapisując parametry i zmienne lokalne
+    /// @return indeks tokenu IN
+    static int readHead(const std::vector<Token>& tokens, int begin, std::vector<Token>& out, Procedure& proc) {
+        int n = (int)tokens.size();
+        int i = begin;
+        char type = 'N';
+        bool inParams = false;
+        for (; i < n && tokens[i].kind != IS; i++) { // PROCEDURE name ( [T|I|O] p , ... )
+            out.push_back(tokens[i]);
+            switch (tokens[i].kind) {
+            case LPAREN: inParams = true; break;
+            case T: type = 'T'; break;
+            case I_CONST: type = 'I'; break;
+            case O_VAR: type = 'O'; break;
+            case PIDENTIFIER:
+                if (inParams) {
+                    proc.params.push_back(tokens[i].value.id->pid);
+                    proc.types.push_back(type);
+                    type = 'N';
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        for (; i < n && tokens[i].kind != IN; i++) { // IS x , t [ a : b ] , ...
+            out.push_back(tokens[i]);
+            if (tokens[i].kind != PIDENTIFIER) continue;
+            InlineLocal local{tokens[i].value.id->pid, false, 0, 0};
+            if (i + 5 < n && tokens[i + 1].kind == LBRACKET && tokens[i + 2].kind == NUM && tokens[i + 4].kind == NUM) {
+                local.is_array = true;
+                local.start = tokens[i + 2].value.num;
+                local.end = tokens[i + 4].value.num;
+            }
+            proc.locals.push_back(local);
+        }
+        if (i < n) out.push_back(tokens[i]);
+        return i;
+    }
+
+public:
+    Inliner(const CompilerOptions& options, Arena& arena, StringPool& names) : options(options), arena(arena), names(names) {}
+
+    /// @brief Liczba miejsc, w które wstawiono ciało procedury
+    int inlinedCalls() const {
+        return sites;
+    }
+
+    /// @brief Przepisuje tokeny programu, wstawiając ciała procedur w miejsca wywołań
+    void run(std::vector<Token>& tokens) {
+        if (options.inlineMode == InlineMode::NEVER) return;
+        procedures.clear();
+        calls.clear();
+        int n = (int)tokens.size();
+        for (int i = 0; i + 1 < n; i++) {
+            if (tokens[i].kind == PIDENTIFIER && tokens[i + 1].kind == LPAREN && (i == 0 || tokens[i - 1].kind != PROCEDURE))
+                calls[tokens[i].value.id->pid]++;
+        }
+
+        std::vector<Token> out;
+        out.reserve(tokens.size());
+        for (int i = 0; i < n; ) {
+            if (tokens[i].kind == PROCEDURE && i + 1 < n && tokens[i + 1].kind == PIDENTIFIER) {
+                std::string name = tokens[i + 1].value.id->pid;
+                Procedure proc;
+                int in = readHead(tokens, i, out, proc);
+                if (in >= n) break;
+                size_t bodyStart = out.size();
+                int end = expandBody(tokens, in + 1, out);
+                proc.body.assign(out.begin() + bodyStart, out.end());
+                collectBound(proc);
+                if (!procedures.count(name)) procedures[name] = proc; // powtórną definicję zgłosi parser
+                i = end;
+            } else if (tokens[i].kind == IN) { // ciało programu głównego
+                out.push_back(tokens[i]);
+                i = expandBody(tokens, i + 1, out);
+            } else {
+                out.push_back(tokens[i++]);
+            }
+        }
+        tokens.swap(out);
+    }
+};
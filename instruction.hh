@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+
+/// @brief Kody operacji maszyny wirtualnej
+enum class Op : uint8_t {
+    READ, WRITE,
+    LOAD, STORE, RLOAD, RSTORE,
+    ADD, SUB, SWP,
+    RST, INC, DEC, SHL, SHR,
+    JUMP, JPOS, JZERO,
+    CALL, RTRN,
+    HALT
+};
+
+/// @brief Część generatora kodu, która wyemitowała instrukcję (statystyki --stats)
+enum class Origin : uint8_t {
+    STATEMENT, // kod komend i wyrażeń emitowany wprost przez parser
+    CONSTANT,  // CodeGenerator::generateConstant
+    MULT,      // CodeGenerator::generateMult i mnożenie przez stałą
+    DIV,       // CodeGenerator::generateDiv
+    ADDRESS    // save_to_reg: wartości i adresy zmiennych, parametrów i elementów tablic
+};
+
+/// @brief Pojedyncza instrukcja kodu pośredniego. Tekst powstaje dopiero przy zapisie do pliku wyjściowego
+struct Instr {
+    Op op;
+    char reg = 0;                // rejestr argumentu ('a', ..., 'h') albo 0 gdy instrukcja go nie ma
+    int lable = -1;              // id etykiety celu skoku albo -1
+    unsigned long long arg = 0;  // adres pamięci (LOAD, STORE) albo numer linii skoku (JUMP, JPOS, JZERO, CALL)
+    int line = 0;                // linia kodu źródłowego, z której powstała instrukcja
+    bool inner_loop = false;     // instrukcja pętli mnożenia albo dzielenia, wykonywana wielokrotnie w jednym wykonaniu linii
+    Origin origin = Origin::STATEMENT; // część generatora kodu, która ją wyemitowała
+    const char* comment = nullptr; // komentarz dopisywany za '#', ignorowany przez maszynę wirtualną
+};
+
+/// @brief Zwraca mnemonik instrukcji
+inline const char* opName(Op op) {
+    static const char* names[] = {
+        "READ", "WRITE",
+        "LOAD", "STORE", "RLOAD", "RSTORE",
+        "ADD", "SUB", "SWP",
+        "RST", "INC", "DEC", "SHL", "SHR",
+        "JUMP", "JPOS", "JZERO",
+        "CALL", "RTRN",
+        "HALT"
+    };
+    return names[(int)op];
+}
+
+/// @brief Nazwa części generatora kodu
+inline const char* originName(Origin origin) {
+    static const char* names[] = {"komendy", "generateConstant", "generateMult", "generateDiv", "save_to_reg"};
+    return names[(int)origin];
+}
+
+/// @brief Czy argumentem instrukcji jest rejestr (np. ADD b)
+inline bool hasRegArg(Op op) {
+    switch (op) {
+        case Op::RLOAD: case Op::RSTORE: case Op::ADD: case Op::SUB: case Op::SWP:
+        case Op::RST: case Op::INC: case Op::DEC: case Op::SHL: case Op::SHR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// @brief Czy argumentem instrukcji jest liczba - adres pamięci lub numer linii (np. LOAD 4, JUMP 10)
+inline bool hasNumArg(Op op) {
+    switch (op) {
+        case Op::LOAD: case Op::STORE: case Op::JUMP: case Op::JPOS: case Op::JZERO: case Op::CALL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// @brief Czy instrukcja jest skokiem do numeru linii (JUMP, JPOS, JZERO, CALL)
+inline bool isJump(Op op) {
+    return op == Op::JUMP || op == Op::JPOS || op == Op::JZERO || op == Op::CALL;
+}
+
+/// @brief Koszt wykonania instrukcji na maszynie wirtualnej
+inline unsigned long long instrCost(Op op) {
+    switch (op) {
+        case Op::READ: case Op::WRITE:
+            return 100;
+        case Op::LOAD: case Op::STORE: case Op::RLOAD: case Op::RSTORE:
+            return 50;
+        case Op::ADD: case Op::SUB: case Op::SWP:
+            return 5;
+        case Op::HALT:
+            return 0;
+        default:
+            return 1;
+    }
+}
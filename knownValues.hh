@@ -0,0 +1,98 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tokenStream.hh"
+
+/// @brief Zmienne skalarne obecnego zakresu, których wartość jest znana w czasie kompilacji (propagacja stałych).
+/// Śledzimy tylko zmienne lokalne - parametry są przekazywane przez referencję i mogą się nawzajem przesłaniać.
+/// Wartość przestaje być znana po READ, przypisaniu nieznanej wartości, przekazaniu do procedury i na początku pętli,
+/// w której zmienna jest modyfikowana.
+class KnownValues {
+public:
+    using State = std::map<std::string, unsigned long long>;
+
+private:
+    State values; // nazwa zmiennej -> znana wartość
+
+public:
+    /// @brief Sprawdza, czy wartość zmiennej jest znana
+    /// @param name nazwa zmiennej
+    /// @param value tu zapisywana jest znana wartość
+    bool get(const std::string& name, unsigned long long& value) const {
+        auto it = values.find(name);
+        if (it == values.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+    void set(const std::string& name, unsigned long long value) {
+        values[name] = value;
+    }
+
+    void forget(const std::string& name) {
+        values.erase(name);
+    }
+
+    void forget(const std::set<std::string>& names) {
+        for (const std::string& name : names) values.erase(name);
+    }
+
+    void clear() {
+        values.clear();
+    }
+
+    /// @brief Zwraca kopię obecnego stanu (np. przed gałęzią IF)
+    const State& state() const {
+        return values;
+    }
+
+    void restore(const State& state) {
+        values = state;
+    }
+
+    /// @brief Złączenie dwóch ścieżek sterowania: zostają tylko wartości, które są takie same na obu ścieżkach
+    /// @param other stan na końcu drugiej ścieżki
+    void merge(const State& other) {
+        for (auto it = values.begin(); it != values.end(); ) {
+            auto found = other.find(it->first);
+            if (found == other.end() || found->second != it->second) it = values.erase(it);
+            else ++it;
+        }
+    }
+
+    /// @brief Zbiera nazwy zmiennych, które mogą być zmienione w pętli zaczynającej się tokenem start
+    /// (WHILE, REPEAT albo FOR): cele przypisań, READ i argumenty wywołań procedur
+    /// @param tokens wszystkie tokeny programu
+    /// @param start indeks tokenu otwierającego pętlę
+    static std::set<std::string> modifiedInLoop(const std::vector<Token>& tokens, int start) {
+        std::set<std::string> names;
+        int depth = 0;
+        int n = (int)tokens.size();
+        for (int i = start; i < n; i++) {
+            switch (tokens[i].kind) {
+            case WHILE: case REPEAT: case FOR:
+                depth++;
+                break;
+            case ENDWHILE: case UNTIL: case ENDFOR:
+                if (--depth == 0) return names;
+                break;
+            case READ:
+                if (i + 1 < n && tokens[i + 1].kind == PIDENTIFIER) names.insert(tokens[i + 1].value.id->pid);
+                break;
+            case PIDENTIFIER:
+                if (i + 1 < n && tokens[i + 1].kind == ASSIGN) names.insert(tokens[i].value.id->pid);
+                else if (i + 1 < n && tokens[i + 1].kind == LPAREN) { // wywołanie procedury
+                    for (i += 2; i < n && tokens[i].kind != RPAREN; i++)
+                        if (tokens[i].kind == PIDENTIFIER) names.insert(tokens[i].value.id->pid);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return names;
+    }
+};
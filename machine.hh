@@ -0,0 +1,266 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "instruction.hh"
+
+/// @brief Liczba maszyny wirtualnej (nieograniczona). Wartości do 128 bitów są trzymane w jednym słowie,
+/// większe jako cyfry o podstawie 2^64 (najmłodsza pierwsza, bez zer wiodących, zawsze więcej niż dwie)
+class Word {
+    __extension__ typedef unsigned __int128 Small;
+    Small small = 0;                        // wartość, gdy big jest puste
+    std::vector<unsigned long long> big;
+
+    std::vector<unsigned long long> limbs() const {
+        if (!big.empty()) return big;
+        std::vector<unsigned long long> l{(unsigned long long)small, (unsigned long long)(small >> 64)};
+        while (!l.empty() && l.back() == 0) l.pop_back();
+        return l;
+    }
+
+    static Word fromLimbs(std::vector<unsigned long long> l) {
+        while (!l.empty() && l.back() == 0) l.pop_back();
+        Word w;
+        if (l.size() > 2) w.big = std::move(l);
+        else for (size_t i = l.size(); i-- > 0; ) w.small = (w.small << 64) | l[i];
+        return w;
+    }
+
+public:
+    Word() = default;
+    Word(unsigned long long v) : small(v) {}
+
+    bool isZero() const {
+        return big.empty() && small == 0;
+    }
+
+    /// @brief Adres komórki pamięci albo instrukcji; false, gdy liczba nie mieści się w 64 bitach
+    bool toAddress(unsigned long long& address) const {
+        if (!big.empty() || (small >> 64)) return false;
+        address = (unsigned long long)small;
+        return true;
+    }
+
+    bool operator<(const Word& other) const {
+        if (big.empty() && other.big.empty()) return small < other.small;
+        std::vector<unsigned long long> x = limbs(), y = other.limbs();
+        if (x.size() != y.size()) return x.size() < y.size();
+        for (size_t i = x.size(); i-- > 0; )
+            if (x[i] != y[i]) return x[i] < y[i];
+        return false;
+    }
+
+    Word& operator+=(const Word& other) {
+        if (big.empty() && other.big.empty() && small + other.small >= small) {
+            small += other.small;
+            return *this;
+        }
+        std::vector<unsigned long long> x = limbs(), y = other.limbs();
+        if (x.size() < y.size()) x.swap(y);
+        unsigned long long carry = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            Small sum = (Small)x[i] + (i < y.size() ? y[i] : 0) + carry;
+            x[i] = (unsigned long long)sum;
+            carry = (unsigned long long)(sum >> 64);
+        }
+        if (carry) x.push_back(carry);
+        return *this = fromLimbs(std::move(x));
+    }
+
+    /// @brief Odejmowanie obcięte do zera (jak SUB i DEC maszyny)
+    Word& saturatingSub(const Word& other) {
+        if (!(other < *this)) return *this = Word();
+        if (big.empty()) {
+            small -= other.small;
+            return *this;
+        }
+        std::vector<unsigned long long> x = limbs(), y = other.limbs();
+        unsigned long long borrow = 0;
+        for (size_t i = 0; i < x.size(); i++) {
+            unsigned long long sub = i < y.size() ? y[i] : 0;
+            unsigned long long next = (x[i] < sub || (x[i] == sub && borrow)) ? 1 : 0;
+            x[i] = x[i] - sub - borrow;
+            borrow = next;
+        }
+        return *this = fromLimbs(std::move(x));
+    }
+
+    Word& shiftLeft() {
+        if (big.empty() && !(small >> 127)) {
+            small <<= 1;
+            return *this;
+        }
+        std::vector<unsigned long long> x = limbs();
+        x.push_back(0);
+        for (size_t i = x.size(); i-- > 0; ) x[i] = (x[i] << 1) | (i ? x[i - 1] >> 63 : 0);
+        return *this = fromLimbs(std::move(x));
+    }
+
+    Word& shiftRight() {
+        if (big.empty()) {
+            small >>= 1;
+            return *this;
+        }
+        std::vector<unsigned long long> x = big;
+        for (size_t i = 0; i < x.size(); i++) x[i] = (x[i] >> 1) | (i + 1 < x.size() ? x[i + 1] << 63 : 0);
+        return *this = fromLimbs(std::move(x));
+    }
+
+    /// @brief this = this * 10 + digit (wczytywanie liczby dziesiętnej)
+    Word& appendDigit(unsigned digit) {
+        std::vector<unsigned long long> x = limbs();
+        unsigned long long carry = digit;
+        for (unsigned long long& limb : x) {
+            Small product = (Small)limb * 10 + carry;
+            limb = (unsigned long long)product;
+            carry = (unsigned long long)(product >> 64);
+        }
+        if (carry) x.push_back(carry);
+        return *this = fromLimbs(std::move(x));
+    }
+
+    /// @brief Zapis dziesiętny
+    std::string toString() const {
+        std::vector<unsigned long long> x = limbs();
+        if (x.empty()) return "0";
+        std::string digits;
+        const unsigned long long CHUNK = 1000000000000000000ull; // 10^18
+        while (!x.empty()) {
+            unsigned long long rest = 0;
+            for (size_t i = x.size(); i-- > 0; ) {
+                Small cur = ((Small)rest << 64) | x[i];
+                x[i] = (unsigned long long)(cur / CHUNK);
+                rest = (unsigned long long)(cur % CHUNK);
+            }
+            while (!x.empty() && x.back() == 0) x.pop_back();
+            for (int d = 0; d < 18 && (rest > 0 || !x.empty()); d++, rest /= 10) digits.push_back((char)('0' + rest % 10));
+        }
+        return std::string(digits.rbegin(), digits.rend());
+    }
+};
+
+/// @brief Symulator maszyny wirtualnej z tym samym modelem kosztów co kompilator (instrCost).
+/// Wykonuje program tekstowy (wynik kompilatora) i zlicza wykonania oraz koszt każdej instrukcji
+class Machine {
+    std::vector<Instr> program;
+    std::vector<unsigned long long> executed; // liczba wykonań każdej instrukcji
+    Word registers[8] = {};
+    std::unordered_map<unsigned long long, Word> memory;
+    unsigned long long totalCost = 0;
+    unsigned long long ioCost = 0;
+
+    /// @brief Rozpoznaje mnemonik instrukcji
+    static Op parseOp(const std::string& name, int lineNo) {
+        for (int op = (int)Op::READ; op <= (int)Op::HALT; op++)
+            if (name == opName((Op)op)) return (Op)op;
+        throw std::runtime_error("linia " + std::to_string(lineNo) + ": nieznana instrukcja " + name);
+    }
+
+    static unsigned long long address(const Word& w) {
+        unsigned long long result;
+        if (!w.toAddress(result)) throw std::runtime_error("adres poza zakresem pamięci");
+        return result;
+    }
+
+public:
+    /// @brief Wczytuje program w postaci tekstowej ("LOAD 4", "SWP b #komentarz")
+    /// @throws std::runtime_error przy błędzie składni
+    void load(std::istream& in) {
+        program.clear();
+        std::string line;
+        for (int lineNo = 1; std::getline(in, line); lineNo++) {
+            size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            std::istringstream words(line);
+            std::string name, arg;
+            if (!(words >> name)) continue;
+            Instr instr{parseOp(name, lineNo)};
+            if (hasRegArg(instr.op) || hasNumArg(instr.op)) {
+                if (!(words >> arg)) throw std::runtime_error("linia " + std::to_string(lineNo) + ": brak argumentu " + name);
+                if (hasRegArg(instr.op)) {
+                    if (arg.size() != 1 || arg[0] < 'a' || arg[0] > 'h')
+                        throw std::runtime_error("linia " + std::to_string(lineNo) + ": zły rejestr " + arg);
+                    instr.reg = arg[0];
+                }
+                else instr.arg = std::stoull(arg);
+            }
+            program.push_back(instr);
+        }
+        if (program.empty()) throw std::runtime_error("pusty program");
+        executed.assign(program.size(), 0);
+    }
+
+    /// @brief Wykonuje program od instrukcji 0 do HALT. READ czyta liczby z in, WRITE wypisuje "> wartość" do out
+    /// @throws std::runtime_error przy błędzie wykonania (skok poza program, adres poza pamięcią, brak danych)
+    void run(std::istream& in, std::ostream& out) {
+        unsigned long long k = 0;
+        for (;;) {
+            if (k >= program.size()) throw std::runtime_error("skok poza program: " + std::to_string(k));
+            const Instr& instr = program[k];
+            Word& a = registers[0];
+            Word* r = instr.reg ? &registers[instr.reg - 'a'] : nullptr;
+            executed[k]++;
+            totalCost += instrCost(instr.op);
+            unsigned long long next = k + 1;
+            switch (instr.op) {
+            case Op::READ: {
+                out << "? " << std::flush;
+                std::string text;
+                if (!(in >> text)) throw std::runtime_error("brak danych wejściowych dla READ");
+                a = Word();
+                for (char c : text) {
+                    if (c < '0' || c > '9') throw std::runtime_error("niepoprawna liczba na wejściu: " + text);
+                    a.appendDigit((unsigned)(c - '0'));
+                }
+                ioCost += instrCost(instr.op);
+                break;
+            }
+            case Op::WRITE:
+                out << "> " << a.toString() << "\n";
+                ioCost += instrCost(instr.op);
+                break;
+            case Op::LOAD:   a = memory[instr.arg]; break;
+            case Op::STORE:  memory[instr.arg] = a; break;
+            case Op::RLOAD:  a = memory[address(*r)]; break;
+            case Op::RSTORE: memory[address(*r)] = a; break;
+            case Op::ADD:    a += *r; break;
+            case Op::SUB:    a.saturatingSub(*r); break;
+            case Op::SWP:    std::swap(a, *r); break;
+            case Op::RST:    *r = Word(); break;
+            case Op::INC:    *r += Word(1); break;
+            case Op::DEC:    r->saturatingSub(Word(1)); break;
+            case Op::SHL:    r->shiftLeft(); break;
+            case Op::SHR:    r->shiftRight(); break;
+            case Op::JUMP:   next = instr.arg; break;
+            case Op::JPOS:   if (!a.isZero()) next = instr.arg; break;
+            case Op::JZERO:  if (a.isZero()) next = instr.arg; break;
+            case Op::CALL:   a = k + 1; next = instr.arg; break;
+            case Op::RTRN:   next = address(a); break;
+            case Op::HALT:   return;
+            }
+            k = next;
+        }
+    }
+
+    const std::vector<Instr>& instructions() const {
+        return program;
+    }
+
+    /// @brief Liczba wykonań każdej instrukcji w ostatnim uruchomieniu
+    const std::vector<unsigned long long>& counts() const {
+        return executed;
+    }
+
+    unsigned long long cost() const {
+        return totalCost;
+    }
+
+    unsigned long long inputOutputCost() const {
+        return ioCost;
+    }
+};
@@ -1,47 +1,256 @@
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <cstdio>
+#include <memory>
+#include <thread>
+#include <atomic>
 
+#include "instruction.hh"
 #include "symbolTable.hh"
+#include "peephole.hh"
+#include "deadCode.hh"
+#include "options.hh"
+#include "compilation.hh"
 
 using namespace std;
 
-extern void parse_code(vector<string>& program, FILE* data);
+extern void parse_code(Compilation& ctx, vector<Instr>& program, FILE* data);
 
-/// @brief łączy kompilator w całość. Czyta kod, wywołuje parser i zapisuje kod maszyny wirtualnej
-/// @param argv [1] plik wejściowy kodu, [2] plik wyjściowy do zapisania kodu vm
-int main(int argc, char const* argv[]) {
-    vector<string> program;
-    FILE* input = nullptr;
-    FILE* output = nullptr;
+/// @brief ustawienia z linii poleceń, wspólne dla wszystkich kompilowanych plików
+struct Settings {
+    CompilerOptions options;
+    PeepholeOptimizer peephole;
+    bool use_peephole = true;
+    bool peephole_report = false;
+    bool use_dce = true;
+    bool dce_report = false;
+    string line_map;
+    bool stats = false;
+};
 
-    if (argc != 3) {
-        cerr << "Sposób użycia: kompilator plik_wejściowy plik_wyjściowy\n";
-        return 1;
+/// @brief wynik kompilacji jednego pliku
+enum class CompileResult { OK, PROGRAM_ERROR, IO_ERROR };
+
+/// @brief zapisuje pojedynczą instrukcję kodu pośredniego w postaci tekstowej np. "LOAD 4", "SWP b #komentarz"
+/// @param output plik wyjściowy
+/// @param instr instrukcja do zapisania
+void write_instruction(FILE* output, const Instr& instr) {
+    fputs(opName(instr.op), output);
+    if (hasRegArg(instr.op)) fprintf(output, " %c", instr.reg);
+    else if (hasNumArg(instr.op)) fprintf(output, " %llu", instr.arg);
+    if (instr.comment) fprintf(output, " #%s", instr.comment);
+    fputc('\n', output);
+}
+
+/// @brief dzieli listę rozdzieloną przecinkami np. "swp-pair,jump-next"
+vector<string> split_list(const string& list) {
+    vector<string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) end = list.size();
+        if (end > start) items.push_back(list.substr(start, end - start));
+        start = end + 1;
     }
+    return items;
+}
+
+void print_usage() {
+    cerr << "Sposób użycia: kompilator [opcje] plik_wejściowy plik_wyjściowy\n"
+         << "               kompilator [opcje] --batch plik1.imp plik2.imp ...\n"
+         << "Opcje:\n"
+         << "  --batch                kompiluje wiele plików jednocześnie, każdy do pliku o tej samej nazwie z rozszerzeniem .mr\n"
+         << "  --jobs=N               liczba wątków w trybie --batch (domyślnie liczba rdzeni)\n"
+         << "  --no-peephole          wyłącza optymalizację przez szparkę\n"
+         << "  --peephole=r1,r2,...   włącza tylko podane reguły optymalizacji przez szparkę:\n";
+    for (const PeepholeRule& rule : peepholeRules()) cerr << "      " << rule.name << " - " << rule.description << "\n";
+    cerr << "  --peephole-report      wypisuje na stderr, ile zaoszczędziła optymalizacja przez szparkę\n"
+         << "  --no-dce               nie usuwa martwego kodu (nieosiągalnych procedur, martwych zapisów i obliczeń)\n"
+         << "  --dce-report           wypisuje na stderr, ile zaoszczędziło usuwanie martwego kodu\n"
+         << "  --no-layout            przydziela pamięć zmiennym po kolei, bez nakładania ramek procedur\n"
+         << "  --no-partial-eval      nie oblicza w czasie kompilacji komend niezależnych od READ\n"
+         << "  --no-clone             nie tworzy klonów procedur, w których parametry mają stałe adresy argumentów\n"
+         << "  --kernel=basic|adaptive pętle mnożenia i dzielenia: basic - jeden bit na obrót, adaptive (domyślnie) - po\n"
+         << "                         mniejszym czynniku, dwa bity na obrót, wczesne wyjście dla 0, 1 i małej dzielnej\n"
+         << "  --no-inline            nie wstawia ciał procedur w miejsca wywołań\n"
+         << "  --force-inline         wstawia wszystkie wywołania procedur, niezależnie od rozmiaru\n"
+         << "  --force-inline=p,q,... wstawia zawsze wywołania podanych procedur\n"
+         << "  --stats                wypisuje na stderr czas faz kompilacji i liczbę instrukcji według rozkazu\n"
+         << "                         i części generatora kodu (generateConstant, generateMult, generateDiv, save_to_reg)\n"
+         << "  --line-map=plik        zapisuje linię kodu źródłowego każdej instrukcji (dla symulatora --lines)\n"
+         << "  --profile-use plik     korzysta z profilu wykonania symulatora (--profile-out) zamiast heurystyk:\n"
+         << "                         przydział rejestrów, wstawianie procedur, rozwijanie i obracanie pętli\n";
+}
 
-    input = fopen(argv[1], "r");
+/// @brief kompiluje jeden plik. Komunikaty (błędy, raporty) trafiają do log, żeby w trybie --batch
+/// wyjście równoległych kompilacji się nie przeplatało
+/// @param prefix dopisywany przed komunikatem błędu (nazwa pliku w trybie --batch)
+CompileResult compile_file(const string& input_name, const string& output_name, const Settings& settings,
+                           ostream& log, const string& prefix = "") {
+    FILE* input = fopen(input_name.c_str(), "r");
     if (!input) {
-        cerr << "Błąd: Nie można otworzyć pliku wejściowego " << argv[1] << "\n";
-        return 1;
+        log << "Błąd: Nie można otworzyć pliku wejściowego " << input_name << "\n";
+        return CompileResult::IO_ERROR;
     }
 
-    output = fopen(argv[2], "w");
-    if (!output) {
-        cerr << "Błąd: Nie można otworzyć pliku wyjściowego " << argv[2] << "\n";
+    // Compilation jest duży (tablice generatora i alokatora), a wątki mają mały stos
+    auto ctx = make_unique<Compilation>(settings.options);
+    vector<Instr> program;
+    try {
+        parse_code(*ctx, program, input);
+    } catch (const CompileError& e) {
+        log << prefix << e.what() << "\n";
         fclose(input);
-        return 1;
+        return CompileResult::PROGRAM_ERROR;
+    } catch (const exception& e) { // np. brak pamięci maszyny wirtualnej
+        log << prefix << "Błąd: " << e.what() << "\n";
+        fclose(input);
+        return CompileResult::PROGRAM_ERROR;
+    }
+    fclose(input);
+
+    if (settings.use_dce) {
+        DeadCodeEliminator dce;
+        ctx->stats.phase("usuwanie martwego kodu", [&]() { dce.run(program, ctx->symbolTable.indirectMemory()); });
+        if (settings.dce_report) dce.report(log);
+    }
+    if (settings.use_peephole) {
+        PeepholeOptimizer peephole = settings.peephole; // liczniki reguł osobno dla każdego pliku
+        ctx->stats.phase("optymalizacja przez szparkę", [&]() { peephole.run(program); });
+        if (settings.peephole_report) peephole.report(log);
     }
 
-    parse_code(program, input);
+    CompileResult result = CompileResult::OK;
+    ctx->stats.phase("zapis wyniku", [&]() {
+        FILE* output = fopen(output_name.c_str(), "w");
+        if (!output) {
+            log << "Błąd: Nie można otworzyć pliku wyjściowego " << output_name << "\n";
+            result = CompileResult::IO_ERROR;
+            return;
+        }
+        for (const auto& instr : program) {
+            write_instruction(output, instr);
+        }
+        fclose(output);
 
-    for (const auto& line : program) {
-        fprintf(output, "%s\n", line.c_str());
+        if (!settings.line_map.empty()) {
+            FILE* lines = fopen(settings.line_map.c_str(), "w");
+            if (!lines) {
+                log << "Błąd: Nie można otworzyć pliku mapy linii " << settings.line_map << "\n";
+                result = CompileResult::IO_ERROR;
+                return;
+            }
+            for (const auto& instr : program) fprintf(lines, "%d%s\n", instr.line, instr.inner_loop ? "*" : "");
+            fclose(lines);
+        }
+    });
+    if (result == CompileResult::OK && settings.stats) ctx->stats.report(log << prefix, program);
+    return result;
+}
+
+/// @brief nazwa pliku wynikowego w trybie --batch: "dir/prog.imp" -> "dir/prog.mr"
+string batch_output_name(const string& input) {
+    size_t slash = input.find_last_of('/');
+    size_t dot = input.find_last_of('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) return input + ".mr";
+    return input.substr(0, dot) + ".mr";
+}
+
+/// @brief kompiluje pliki na puli wątków. Każdy wątek bierze kolejny nieskompilowany plik;
+/// komunikaty są wypisywane na końcu w kolejności plików
+/// @return 0 gdy wszystkie pliki się skompilowały, 1 w przeciwnym razie
+int compile_batch(const vector<string>& files, const Settings& settings, unsigned jobs) {
+    vector<ostringstream> logs(files.size());
+    vector<CompileResult> results(files.size(), CompileResult::OK);
+    atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++)
+            results[i] = compile_file(files[i], batch_output_name(files[i]), settings, logs[i], files[i] + ": ");
+    };
+
+    jobs = max(1u, min<unsigned>(jobs, files.size()));
+    vector<thread> pool;
+    for (unsigned j = 1; j < jobs; j++) pool.emplace_back(worker);
+    worker();
+    for (thread& t : pool) t.join();
+
+    size_t failed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        cerr << logs[i].str();
+        if (results[i] != CompileResult::OK) failed++;
     }
+    if (failed) cerr << "Nie skompilowano " << failed << " z " << files.size() << " plików\n";
+    return failed ? 1 : 0;
+}
 
-    fclose(input);
-    fclose(output);
+/// @brief łączy kompilator w całość. Czyta kod, wywołuje parser i zapisuje kod maszyny wirtualnej
+/// @param argv opcje, plik wejściowy kodu, plik wyjściowy do zapisania kodu vm (albo --batch i lista plików)
+int main(int argc, char const* argv[]) {
+    vector<string> files;
+    Settings settings;
+    bool batch = false;
+    unsigned jobs = thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        try {
+            if (arg == "--no-peephole") settings.use_peephole = false;
+            else if (arg.rfind("--peephole=", 0) == 0) settings.peephole.setRules(split_list(arg.substr(11)));
+            else if (arg == "--peephole-report") settings.peephole_report = true;
+            else if (arg == "--no-dce") settings.use_dce = false;
+            else if (arg == "--dce-report") settings.dce_report = true;
+            else if (arg == "--stats") settings.stats = true;
+            else if (arg.rfind("--line-map=", 0) == 0) settings.line_map = arg.substr(11);
+            else if (arg == "--profile-use" && i + 1 < argc) settings.options.profile.load(argv[++i]);
+            else if (arg.rfind("--profile-use=", 0) == 0) settings.options.profile.load(arg.substr(14));
+            else if (arg == "--no-layout") settings.options.memoryLayout = false;
+            else if (arg == "--no-partial-eval") settings.options.partialEvaluation = false;
+            else if (arg == "--no-clone") settings.options.procedureCloning = false;
+            else if (arg == "--kernel=basic") settings.options.kernel = ArithmeticKernel::BASIC;
+            else if (arg == "--kernel=adaptive") settings.options.kernel = ArithmeticKernel::ADAPTIVE;
+            else if (arg == "--no-inline") settings.options.inlineMode = InlineMode::NEVER;
+            else if (arg == "--force-inline") settings.options.inlineMode = InlineMode::ALWAYS;
+            else if (arg.rfind("--force-inline=", 0) == 0) {
+                for (const string& name : split_list(arg.substr(15))) settings.options.forceInline.insert(name);
+            }
+            else if (arg == "--batch") batch = true;
+            else if (arg.rfind("--jobs=", 0) == 0) {
+                jobs = stoul(arg.substr(7));
+                if (jobs == 0) throw invalid_argument("--jobs musi być dodatnie");
+            }
+            else if (arg.rfind("--", 0) == 0) {
+                cerr << "Błąd: Nieznana opcja " << arg << "\n";
+                print_usage();
+                return 1;
+            }
+            else files.push_back(arg);
+        } catch (const logic_error& e) { // invalid_argument, out_of_range z stoul
+            cerr << "Błąd: " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    if (batch) {
+        if (files.empty()) {
+            print_usage();
+            return 1;
+        }
+        if (!settings.line_map.empty()) {
+            cerr << "Błąd: --line-map działa tylko przy kompilacji jednego pliku\n";
+            return 1;
+        }
+        return compile_batch(files, settings, jobs);
+    }
 
-    return 0;
+    if (files.size() != 2) {
+        print_usage();
+        return 1;
+    }
+    switch (compile_file(files[0], files[1], settings, cerr)) {
+    case CompileResult::OK: return 0;
+    case CompileResult::PROGRAM_ERROR: return -1; // jak dawniej exit(-1) z parsera
+    default: return 1;
+    }
 }
@@ -0,0 +1,217 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "tokenStream.hh"
+
+/// Najwięcej pustych komórek, jakie warto zostawić, żeby tablica leżała pod adresem równym indeksowi startowemu
+/// (wtedy arr[x] nie potrzebuje stałej przesunięcia: oszczędza to ok. 10 przy każdym dostępie przez zmienną)
+const unsigned long long MAX_ARRAY_GAP = 1024;
+
+/// Największa ramka planowana z góry (większe programy wracają do przydziału po kolei)
+const unsigned long long MAX_FRAME_CELLS = 1ull << 56;
+
+/// @brief Rozmieszczenie pamięci jednego zakresu (procedury albo maina)
+struct FramePlan {
+    unsigned long long base = 0;        // pierwsza komórka ramki
+    unsigned long long end = 0;         // pierwsza komórka za ramką
+    std::map<std::string, unsigned long long> fixed; // adresy parametrów i zmiennych z deklaracji ("" - adres powrotu)
+    unsigned long long dynamicBase = 0; // obszar iteratorów FOR i zmiennych wstawionych procedur, przydzielany po kolei
+    unsigned long long dynamicEnd = 0;
+};
+
+/// @brief Planuje rozmieszczenie zmiennych w pamięci przed parsowaniem. Procedury, które nie mogą być aktywne
+/// jednocześnie (żadna nie wywołuje drugiej, również pośrednio), dostają nakładające się ramki: ramka procedury
+/// leży zawsze nad ramkami wszystkich procedur, które ją wywołują. W ramce najpierw trafiają tablice indeksowane
+/// zmiennymi, pod adres równy indeksowi startowemu, potem często przekazywane zmienne pod małe adresy (tańsza stała)
+class MemoryLayout {
+    enum class Kind { RETURN, PARAM, VARIABLE, ARRAY };
+
+    struct Item {
+        std::string name;
+        Kind kind;
+        unsigned long long size;
+        unsigned long long start = 0; // indeks startowy tablicy
+    };
+
+    struct Scope {
+        std::vector<Item> items;                // w kolejności deklaracji
+        std::map<std::string, double> weights;  // nazwa -> ile razy trzeba wygenerować jej adres (z wagą pętli)
+        std::set<std::string> callees;
+        unsigned long long dynamicSize = 0;
+    };
+
+    std::vector<std::string> order;   // zakresy w kolejności w pliku (main ostatni)
+    std::map<std::string, Scope> scopes;
+
+    static double weight(int depth) {
+        return std::pow(10.0, std::min(depth, 6));
+    }
+
+    /// @brief Zbiera deklaracje, wywołania i miejsca liczenia adresów w każdym zakresie
+    void analyze(const std::vector<Token>& tokens) {
+        enum { OUTSIDE, HEAD, DECLARATIONS, BODY } state = OUTSIDE;
+        Scope* scope = nullptr;
+        int depth = 0;
+        int n = (int)tokens.size();
+        for (int i = 0; i < n; i++) {
+            const Token& t = tokens[i];
+            switch (state) {
+            case OUTSIDE:
+                if (t.kind == PROCEDURE && i + 1 < n && tokens[i + 1].kind == PIDENTIFIER) {
+                    std::string name = tokens[++i].value.id->pid;
+                    if (scopes.count(name)) return; // podwójna deklaracja - błąd zgłosi parser
+                    order.push_back(name);
+                    scope = &scopes[name];
+                    scope->items.push_back({"", Kind::RETURN, 1});
+                    state = HEAD;
+                } else if (t.kind == PROGRAM) {
+                    order.push_back("");
+                    scope = &scopes[""];
+                    state = HEAD;
+                }
+                break;
+            case HEAD:
+                if (t.kind == PIDENTIFIER) {
+                    bool isT = i > 0 && tokens[i - 1].kind == T;
+                    scope->items.push_back({t.value.id->pid, Kind::PARAM, isT ? 2ull : 1ull});
+                } else if (t.kind == IS) state = DECLARATIONS;
+                break;
+            case DECLARATIONS:
+                if (t.kind == PIDENTIFIER) {
+                    if (i + 5 < n && tokens[i + 1].kind == LBRACKET && tokens[i + 2].kind == NUM
+                        && tokens[i + 4].kind == NUM) {
+                        unsigned long long start = tokens[i + 2].value.num, end = tokens[i + 4].value.num;
+                        scope->items.push_back({t.value.id->pid, Kind::ARRAY, start <= end ? end - start + 1 : 1, start});
+                        i += 5;
+                    } else scope->items.push_back({t.value.id->pid, Kind::VARIABLE, 1});
+                } else if (t.kind == IN) {
+                    state = BODY;
+                    depth = 0;
+                }
+                break;
+            case BODY:
+                switch (t.kind) {
+                case FOR: scope->dynamicSize += 2; depth++; break;
+                case WHILE: case REPEAT: depth++; break;
+                case ENDFOR: case ENDWHILE: case UNTIL: depth = std::max(0, depth - 1); break;
+                case INLINE_BEGIN:
+                    for (const InlineLocal& local : t.value.inline_site->locals)
+                        scope->dynamicSize += local.is_array && local.start <= local.end ? local.end - local.start + 1 : 1;
+                    break;
+                case PIDENTIFIER:
+                    if (i + 1 < n && tokens[i + 1].kind == LPAREN) { // wywołanie: adresy argumentów są stałymi
+                        scope->callees.insert(t.value.id->pid);
+                        for (i += 2; i < n && tokens[i].kind != RPAREN; i++)
+                            if (tokens[i].kind == PIDENTIFIER) scope->weights[tokens[i].value.id->pid] += weight(depth);
+                    } else if (i + 2 < n && tokens[i + 1].kind == LBRACKET && tokens[i + 2].kind == PIDENTIFIER) {
+                        scope->weights[t.value.id->pid] += weight(depth); // arr[x]: adres liczony w czasie wykonania
+                    }
+                    break;
+                case END: state = OUTSIDE; break;
+                default: break;
+                }
+                break;
+            }
+        }
+    }
+
+    /// @brief Najmniejszy adres >= from, od którego size komórek nie nachodzi na zajęte przedziały
+    static unsigned long long firstFit(const std::vector<std::pair<unsigned long long, unsigned long long>>& used,
+                                       unsigned long long from, unsigned long long size) {
+        unsigned long long address = from;
+        for (const auto& [begin, end] : used) { // posortowane po początku
+            if (end <= address) continue;
+            if (begin >= address + size) break;
+            address = end;
+        }
+        return address;
+    }
+
+    static bool isFree(const std::vector<std::pair<unsigned long long, unsigned long long>>& used,
+                       unsigned long long from, unsigned long long size) {
+        return firstFit(used, from, size) == from;
+    }
+
+    /// @brief Rozmieszcza zmienne zakresu w ramce zaczynającej się od base
+    FramePlan place(const Scope& scope, unsigned long long base) const {
+        FramePlan plan;
+        plan.base = base;
+        std::vector<std::pair<unsigned long long, unsigned long long>> used;
+        auto take = [&](unsigned long long address, unsigned long long size) {
+            if (size == 0) return;
+            used.insert(std::upper_bound(used.begin(), used.end(), std::make_pair(address, address + size)),
+                        {address, address + size});
+        };
+        auto weightOf = [&](const Item& item) {
+            auto it = scope.weights.find(item.name);
+            return it == scope.weights.end() ? 0.0 : it->second;
+        };
+
+        std::vector<const Item*> arrays, scalars, rest;
+        for (const Item& item : scope.items) {
+            if (item.kind == Kind::ARRAY) arrays.push_back(&item);
+            else if (item.kind == Kind::VARIABLE) scalars.push_back(&item);
+            else rest.push_back(&item);
+        }
+        auto hotter = [&](const Item* x, const Item* y) { return weightOf(*x) > weightOf(*y); };
+        std::stable_sort(arrays.begin(), arrays.end(), hotter);
+        std::stable_sort(scalars.begin(), scalars.end(), hotter);
+
+        std::vector<const Item*> pending;
+        for (const Item* array : arrays) { // adres == indeks startowy: arr[x] to po prostu adres x
+            if (weightOf(*array) > 0 && array->start >= base && array->start - base <= MAX_ARRAY_GAP
+                && isFree(used, array->start, array->size)) {
+                plan.fixed[array->name] = array->start;
+                take(array->start, array->size);
+            } else pending.push_back(array);
+        }
+        std::vector<const Item*> packed = scalars;
+        packed.insert(packed.end(), rest.begin(), rest.end());
+        packed.insert(packed.end(), pending.begin(), pending.end());
+        for (const Item* item : packed) {
+            unsigned long long address = firstFit(used, base, item->size);
+            plan.fixed[item->name] = address;
+            take(address, item->size);
+        }
+        plan.dynamicBase = firstFit(used, base, scope.dynamicSize);
+        plan.dynamicEnd = plan.dynamicBase + scope.dynamicSize;
+        take(plan.dynamicBase, scope.dynamicSize);
+
+        plan.end = base;
+        for (const auto& block : used) plan.end = std::max(plan.end, block.second);
+        return plan;
+    }
+
+public:
+    /// @brief Wyznacza ramki wszystkich zakresów programu (po wstawieniu procedur)
+    /// @param tokens cały program
+    /// @return nazwa procedury ("" dla maina) -> rozmieszczenie jej zmiennych
+    std::map<std::string, FramePlan> plan(const std::vector<Token>& tokens) {
+        order.clear();
+        scopes.clear();
+        analyze(tokens);
+        for (const auto& [name, scope] : scopes) { // olbrzymie tablice: zostaje przydział po kolei, który zgłosi brak pamięci
+            unsigned long long total = scope.dynamicSize;
+            for (const Item& item : scope.items) total = std::min(total + item.size, MAX_FRAME_CELLS + 1);
+            if (total > MAX_FRAME_CELLS) return {};
+        }
+
+        // procedura może wołać tylko wcześniej zadeklarowane, więc wołający są już rozmieszczeni
+        std::map<std::string, std::vector<std::string>> callers;
+        for (const auto& [name, scope] : scopes)
+            for (const std::string& callee : scope.callees) callers[callee].push_back(name);
+        std::map<std::string, FramePlan> plans;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            unsigned long long base = 0;
+            for (const std::string& caller : callers[*it])
+                if (auto c = plans.find(caller); c != plans.end()) base = std::max(base, c->second.end);
+            plans[*it] = place(scopes[*it], base);
+        }
+        return plans;
+    }
+};
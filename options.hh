@@ -0,0 +1,29 @@
+#pragma once
+#include <set>
+#include <string>
+
+#include "profile.hh"
+
+/// @brief Tryb wstawiania procedur w miejsca wywołań
+enum class InlineMode {
+    HEURISTIC, // według rozmiaru ciała, liczby wywołań i zagnieżdżenia w pętlach
+    NEVER,     // --no-inline
+    ALWAYS     // --force-inline
+};
+
+/// @brief Kod pętli mnożenia i dzielenia zmiennych (--kernel=)
+enum class ArithmeticKernel {
+    BASIC,   // jeden bit na obrót, pętla po bitach rb niezależnie od wartości czynników
+    ADAPTIVE // pętla po mniejszym czynniku, dwa bity na obrót, wczesne wyjście dla 0, 1 i dzielnej mniejszej od dzielnika
+};
+
+/// @brief Opcje kompilatora z linii poleceń, które wpływają na parser i generowanie kodu
+struct CompilerOptions {
+    InlineMode inlineMode = InlineMode::HEURISTIC;
+    std::set<std::string> forceInline; // procedury wstawiane zawsze (--force-inline=p,q)
+    bool memoryLayout = true;          // nakładanie ramek procedur i rozmieszczanie tablic (--no-layout wyłącza)
+    bool partialEvaluation = true;     // obliczanie w czasie kompilacji komend niezależnych od READ (--no-partial-eval wyłącza)
+    bool procedureCloning = true;      // klony procedur dla wywołań z tablicami i zmiennymi wołającego (--no-clone wyłącza)
+    ArithmeticKernel kernel = ArithmeticKernel::ADAPTIVE; // pętle mnożenia i dzielenia (--kernel=basic|adaptive)
+    ExecutionProfile profile;          // liczby wykonań linii z poprzedniego uruchomienia (--profile-use)
+};
@@ -4,19 +4,25 @@
 #include <map>
 #include <stdexcept>
 
+#include "instruction.hh"
+#include "arena.hh"
+
 using namespace std;
 
 struct Symbol;
 struct ForLoopInfo;
+struct Compilation;
 
+// Identyfikator z leksera: nazwa z puli names, więc równe nazwy mają ten sam wskaźnik
 struct Identifier {
-    char *pid;
+    const char *pid;
     unsigned long long num;
+    NameId name;            // numer nazwy w names (klucz tablicy symboli)
 };
 
 // Struktura używana wszędzie tam gdzie są zmienne
 struct VariableInfo {
-    std::string name;       // nazwa zmiennej
+    const char *name;       // nazwa zmiennej (z puli names)
     Symbol *sym;            // referencja dod symbolu zmiennej
     Symbol *ref;            // zapisujemy symbol zmiennej referencyjnej do tablicy np. x dla arr[x]
     bool is_param;          // czy jest parametrem procedury (I, O, T)
@@ -24,6 +30,7 @@ struct VariableInfo {
     bool is_array_ref;      // Czy to referencja do tablicy przez zmienną np. arr[x]
     unsigned long long offset_or_addr; // Adres zmiennej indeksującej (dla arr[x])
     unsigned long long arr_start;
+    char pointer_reg = 0;   // rejestr z adresem arr[i] prowadzonym razem z iteratorem i (0 jeśli brak)
 };
 
 // Struktura używana do nieterminala value. Zawsze z niego czytamy, nigdy nie zapisujemy
@@ -43,12 +50,39 @@ struct ProcCall{
     Args *args;
 };
 
+// Zmienna lokalna procedury wstawionej w miejsce wywołania (już pod nową nazwą)
+struct InlineLocal {
+    std::string name;
+    bool is_array;
+    unsigned long long start, end; // zakres indeksów tablicy
+};
+
+// Miejsce wstawienia ciała procedury (token INLINE_BEGIN)
+struct InlineSite {
+    std::string callee;                 // nazwa wstawionej procedury
+    std::vector<std::string> args;      // argumenty wywołania
+    std::vector<InlineLocal> locals;    // zmienne lokalne do zadeklarowania w obecnym zakresie
+};
+
+// Wynik warunku: etykieta, do której kod warunku skacze, gdy warunek jest fałszywy (gdy prawdziwy - przechodzi dalej),
+// albo wartość warunku znana w czasie kompilacji
+struct Condition {
+    int false_lable;    // definiuje ją instrukcja, która użyła warunku
+    signed char known;  // -1 nieznany, 0 zawsze fałsz, 1 zawsze prawda
+};
+
+// Wartość wyrażenia, jeśli da się ją policzyć w czasie kompilacji
+struct KnownValue {
+    bool is_known;
+    unsigned long long value;
+};
+
 }
 
 %code provides {
-void declare_array(Identifier *id, unsigned long long start, unsigned long long end);
-void declare_variable(Identifier *id);
-void declare_parameter(Identifier *id, char type);
+void declare_array(Compilation& ctx, Identifier *id, unsigned long long start, unsigned long long end);
+void declare_variable(Compilation& ctx, Identifier *id);
+void declare_parameter(Compilation& ctx, Identifier *id, char type);
 }
 
 
@@ -57,290 +91,936 @@ void declare_parameter(Identifier *id, char type);
 #include <string>
 #include <vector>
 
-#include "codeGenerator.hh"
-#include "symbolTable.hh"
+#include "compilation.hh"
 #include "parser.hh"
-
-int yylex( void );
-void yyset_in( FILE * in_str );
-extern int yylineno;
-void yyerror(const char*);
-
-CodeGenerator codeGen;
-SymbolTable symbolTable;
+#include "inliner.hh"
+#include "memoryLayout.hh"
+#include "partialEvaluator.hh"
+#include "procedureCloner.hh"
+
+int yylex(YYSTYPE* lval, Compilation& ctx);
+void yyerror(Compilation& ctx, const char*);
+
+// lekser wielowejściowy (lexer.l, %option reentrant)
+typedef void* yyscan_t;
+int scan_token(YYSTYPE* lval, yyscan_t scanner);
+int yylex_init_extra(Compilation* extra, yyscan_t* scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE* in, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
 
 /* Funkcja obsługi błędów */
-void semantic_error(unsigned long long lineno, char const *s) {
-    if(lineno == 0) lineno = (unsigned long long)yylineno;
-    std::cerr << "Syntax error on line " << (int)lineno << ": " << s << std::endl;
-    exit(-1);
+void semantic_error(Compilation& ctx, unsigned long long lineno, char const *s) {
+    if(lineno == 0) lineno = (unsigned long long)ctx.line;
+    throw CompileError("Syntax error on line " + std::to_string((int)lineno) + ": " + s);
 }
 
-/// @brief pobiera listę parametrów procedury name i ustawia referencje do args. Dla tablicy ustawia dodatkową zmienną w której przechowuje indeks startowy tablicy
+/// @brief sprawdza, czy argumenty args pasują do parametrów procedury name, i oznacza jako zainicjalizowane
+/// argumenty, które procedura inicjalizuje
 /// @param name nazwa procedury
 /// @param args lista argumentów do przekazania
-void set_arguments(const std::string& name, std::vector<const char*> args, unsigned long long line){
-    std::vector<Symbol> params = symbolTable.getParameters(name);
+void check_arguments(Compilation& ctx, const std::string& name, const std::vector<const char*>& args){
+    const std::vector<Symbol>& params = ctx.symbolTable.getParameters(name);
     int argsSize = args.size();
     
     if((int)params.size() != argsSize) {
         std::string msg = "Wrong number of arguments at call for procedure " + name;
-        yyerror(msg.c_str());
+        yyerror(ctx, msg.c_str());
     }
 
     for (int i = 0; i < argsSize; i++){
         const char *argName = args[i];
-        Symbol* arg = symbolTable.getSymbol(argName); // Symbol zmiennej przekazywanej (argumentu)
+        Symbol* arg = ctx.symbolTable.getSymbol(argName); // Symbol zmiennej przekazywanej (argumentu)
         
         if(arg == nullptr) {
             std::string msg = "Trying to call procedure with undeclared variable: " + std::string(argName);
-            yyerror(msg.c_str());
+            yyerror(ctx, msg.c_str());
         }
 
-        Symbol param = params.at(i);
+        const Symbol& param = params.at(i);
         bool argIsArrayType = arg->is_array || (arg->is_param && arg->is_T);
         
-        if (param.is_T && !argIsArrayType) yyerror("Expected array as argument but got scalar variable");
-        if (!param.is_T && argIsArrayType) yyerror("Expected scalar variable as argument but got array");
-        if (arg->is_O && param.is_I) yyerror("Cannot pass O argument to I parameter");
-        if (arg->is_I && !param.is_I) yyerror("Cannot pass I argument to not I parameter");
+        if (param.is_array && !argIsArrayType) yyerror(ctx, "Expected array as argument but got scalar variable");
+        if (!param.is_array && argIsArrayType) yyerror(ctx, "Expected scalar variable as argument but got array");
+        // w ciele wstawionej procedury parametr O wołającego zastępuje jej parametr, który można było przekazać dalej
+        // do parametru I - wywołania w ciele sprawdziliśmy przy definicji procedury
+        if (arg->is_O && param.is_I && !ctx.inline_depth) yyerror(ctx, "Cannot pass O argument to I parameter");
+        if (arg->is_I && !param.is_I) yyerror(ctx, "Cannot pass I argument to not I parameter");
+
+        if (!param.is_array && ctx.symbolTable.isParameterInitialized(name, param.name, arg)) arg->is_initialized = true;
+    }
+}
+
+/// @brief pobiera listę parametrów procedury name i ustawia referencje do args. Dla tablicy ustawia dodatkową zmienną w której przechowuje indeks startowy tablicy
+/// @param name nazwa procedury
+/// @param args lista argumentów do przekazania
+void set_arguments(Compilation& ctx, const std::string& name, const std::vector<const char*>& args, unsigned long long line){
+    check_arguments(ctx, name, args);
+    const std::vector<Symbol>& params = ctx.symbolTable.getParameters(name);
+
+    for (size_t i = 0; i < args.size(); i++){
+        Symbol* arg = ctx.symbolTable.getSymbol(args[i]); // Symbol zmiennej przekazywanej (argumentu)
+        const Symbol& param = params.at(i);
+        if (param.is_bound) continue; // parametr klonu ma już adres argumentu
 
         if (param.is_T) {
             if (arg->is_param && arg->is_T) {
-                codeGen.emit("LOAD", arg->memory_address);
+                ctx.codeGen.emit(Op::LOAD, arg->memory_address);
             } else {
-                codeGen.generateConstant("a", arg->memory_address);
+                ctx.codeGen.generateConstant('a', arg->memory_address);
             }
-            codeGen.emit("STORE", param.memory_address);
+            ctx.codeGen.emit(Op::STORE, param.memory_address);
             
             // Przekazanie INDEKSU STARTOWEGO
             if (arg->is_param && arg->is_T) {
                 // Przekazujemy parametr dalej: pobierz start_index z parametru źródłowego
                 // Start index leży w komórce obok adresu!
-                codeGen.emit("LOAD", arg->memory_address + 1); 
+                ctx.codeGen.emit(Op::LOAD, arg->memory_address + 1); 
             } else {
                 // Przekazujemy zwykłą tablicę: weź jej stały start_index
-                codeGen.generateConstant("a", arg->array_start);
+                ctx.codeGen.generateConstant('a', arg->array_start);
             }
-            codeGen.emit("STORE", param.memory_address + 1); // Zapisz w drugiej komórce parametru
+            ctx.codeGen.emit(Op::STORE, param.memory_address + 1); // Zapisz w drugiej komórce parametru
             
         }
         else{
-            if(symbolTable.isParameterInitialized(name, param.name, arg)) arg->is_initialized = true;
             if (arg->is_param) {
             // Przekazujemy dalej parametr Zmienna 'arg' już trzyma ADRES właściwej zmiennej. 
             // Musimy ten adres przepisać do nowego parametru.
-            codeGen.emit("LOAD", arg->memory_address); // Wczytaj wartość wskaźnika do Rejestru A
+            ctx.codeGen.emit(Op::LOAD, arg->memory_address); // Wczytaj wartość wskaźnika do Rejestru A
             } else {
                 // Przekazujemy zmienną lokalną (np. main x; call p(x);) Musimy przekazać ADRES tej zmiennej w pamięci VM.
-                codeGen.generateConstant("a", arg->memory_address);
+                ctx.codeGen.generateConstant('a', arg->memory_address);
+                ctx.symbolTable.markIndirect(arg->memory_address);
             }
             // Teraz w Rejestrze A (akumulatorze) mamy adres, na który ma wskazywać nowy parametr.
             // Zapisujemy go w miejscu pamięci przeznaczonym dla parametru procedury.
-            codeGen.emit("STORE", param.memory_address);
+            ctx.codeGen.emit(Op::STORE, param.memory_address);
         }
     }
 }
 
+/// @brief Początek wstawionego ciała procedury: sprawdza argumenty jak przy wywołaniu
+/// i deklaruje w obecnym zakresie zmienne lokalne wstawionej procedury
+void begin_inline(Compilation& ctx, InlineSite *site){
+    if(!ctx.symbolTable.procedureExists(site->callee)) yyerror(ctx, ("Calling undeclared procedure \"" + site->callee + "\"").c_str());
+    std::vector<const char*> args;
+    for(const std::string& arg : site->args) args.push_back(arg.c_str());
+    check_arguments(ctx, site->callee, args);
+
+    const std::map<std::string, char>& regs = ctx.registerAllocator.scalarRegisters(ctx.symbolTable.currentProcedure());
+    for(const InlineLocal& local : site->locals){
+        try {
+            if(local.is_array) ctx.symbolTable.declareArray(local.name, local.start, local.end);
+            else ctx.symbolTable.declareVariable(local.name);
+        } catch (const std::invalid_argument &e) {
+            yyerror(ctx, e.what());
+        }
+        if(auto it = regs.find(local.name); it != regs.end() && it->second) ctx.symbolTable.getSymbol(local.name)->reg = it->second;
+    }
+    ctx.inline_depth++;
+}
+
 /// @brief deklaruje tablicę
 /// @param id nazwa tablicy
 /// @param start indeks startowy tablicy (np. 10) tablica nie musi zaczynać się od 0.
 /// @param end indeks końcowy tablicy
-void declare_array(Identifier *id, unsigned long long start, unsigned long long end)
+void declare_array(Compilation& ctx, Identifier *id, unsigned long long start, unsigned long long end)
 {
     try {
-        symbolTable.declareArray(id->pid, start, end);
+        ctx.symbolTable.declareArray(id->pid, start, end);
     } catch (const std::invalid_argument &e) {
-        semantic_error(id->num, e.what());
+        semantic_error(ctx, id->num, e.what());
     }
-    free(id->pid);
 }
 
 /// @brief deklaruje zmienną
 /// @param id nazwa zmiennej
-void declare_variable(Identifier *id)
+void declare_variable(Compilation& ctx, Identifier *id)
 {
     try {
-        symbolTable.declareVariable(id->pid);
+        ctx.symbolTable.declareVariable(id->pid);
     } catch (const std::invalid_argument &e) {
-        semantic_error(id->num, e.what());
+        semantic_error(ctx, id->num, e.what());
     }
-    free(id->pid);
 }
 
 /// @brief deklaruje parametr funkcji
 /// @param id nazwa parametru
 /// @param type typ parametru (I, O, T, '')
-void declare_parameter(Identifier *id, char type)
+void declare_parameter(Compilation& ctx, Identifier *id, char type)
 {
     try {
-        symbolTable.declareParameter(id->pid, type);
+        ctx.symbolTable.declareParameter(id->pid, type);
     } catch (const std::invalid_argument &e) {
-        semantic_error(id->num, e.what());
+        semantic_error(ctx, id->num, e.what());
+    }
+}
+
+/// @brief ładuje do ra wartość zmiennej skalarnej, która nie jest parametrem (z rejestru albo z pamięci)
+/// @param sym symbol zmiennej
+/// @param address adres zmiennej w pamięci
+void load_scalar(Compilation& ctx, Symbol *sym, unsigned long long address){
+    if(sym->reg){
+        ctx.codeGen.emit(Op::RST, 'a');
+        ctx.codeGen.emit(Op::ADD, sym->reg);
     }
-    free(id->pid);
+    else ctx.codeGen.emit(Op::LOAD, address);
+}
+
+/// @brief zapisuje ra do zmiennej skalarnej, która nie jest parametrem (do rejestru albo do pamięci). Niszczy ra
+/// @param sym symbol zmiennej
+/// @param address adres zmiennej w pamięci
+void store_scalar(Compilation& ctx, Symbol *sym, unsigned long long address){
+    if(sym->reg) ctx.codeGen.emit(Op::SWP, sym->reg);
+    else ctx.codeGen.emit(Op::STORE, address);
+}
+
+/// @brief Klucz wartości (albo adresu) zmiennej do numeracji wartości: x, t[i] albo t@adres dla stałego indeksu.
+/// Do deps dopisuje zmienne, od których wartość zależy ("*" dla parametrów - mogą wskazywać na tę samą pamięć).
+/// Adres zależy tylko od indeksu, bo adresy tablic i parametrów zmieniają się jedynie przy wywołaniu procedury
+std::string variable_key(const VariableInfo *info, std::vector<std::string>& deps, bool address = false){
+    if(!address){
+        deps.push_back(info->name);
+        if(info->sym->is_param) deps.push_back("*");
+    }
+    std::string prefix = address ? "&" : "";
+    if(info->is_array_ref){
+        deps.push_back(info->ref->name);
+        if(info->ref->is_param) deps.push_back("*");
+        return prefix + info->name + "[" + info->ref->name + "]";
+    }
+    if(info->sym->is_array || info->sym->is_T) return prefix + info->name + "@" + std::to_string(info->memory_address);
+    return prefix + info->name;
 }
 
 /// @brief Zapisuje do reg wartość albo adres z info (5,a,tab[5],tab[a]). Rejestr h JEST ZAREZEROWOWANY DO OBLICZEŃ. Rejestr a jest używany do obliczeń. Jeśli mamy gdzieś więcej niż jedną value jednocześnie to tylko ostatnia może zostać zapisana do a. value_to_reg = true to value
 /// @param info wszystkie informacje o zmiennej
 /// @param reg który rejestr spośród 'a', 'b',... , 'g'
 /// @param value_to_reg dla true zapisuje do rejestru wartość zmiennej zapisanej w value. Dla false zapisuje do rejestru adres zmiennej.
-void save_to_reg(VariableInfo *info, std::string reg, bool value_to_reg){ 
-    if (info->is_array_ref == false) { // x lub arr[5] (stały indeks)
+void save_to_reg(Compilation& ctx, VariableInfo *info, char reg, bool value_to_reg){ 
+    CodeGenerator::OriginScope scope(ctx.codeGen, Origin::ADDRESS);
+    // element tablicy i parametr: wartość albo adres mogły zostać już policzone w tym bloku kodu
+    bool numbered = info->is_array_ref || info->sym->is_param || info->sym->is_array;
+    ValueNumber computed, address;
+    if (numbered) {
+        computed.key = variable_key(info, computed.deps, !value_to_reg);
+        address.key = variable_key(info, address.deps, true);
+        if (ctx.codeGen.findValue(computed.key) == reg) return;
+        if (ctx.codeGen.reuseValue(computed.key, value_to_reg)) {
+            if(reg != 'a') ctx.codeGen.emit(Op::SWP, reg);
+            return;
+        }
+    }
+
+    if (info->pointer_reg) { // adres arr[i] jest już w rejestrze
+        if (value_to_reg) ctx.codeGen.emit(Op::RLOAD, info->pointer_reg);
+        else {
+            ctx.codeGen.emit(Op::RST, 'a');
+            ctx.codeGen.emit(Op::ADD, info->pointer_reg);
+        }
+        if(reg != 'a') ctx.codeGen.emit(Op::SWP, reg);
+    }
+    else if (info->is_array_ref == false) { // x lub arr[5] (stały indeks)
         if (info->sym->is_param && info->sym->is_T) { // Tablica parametrowa(memory_address + 1 zawiera start_index)
             // info->memory_address zawiera: sym->memory_address + index
             unsigned long long constant_index = info->memory_address - info->sym->memory_address;
             // Teraz realizujemy wzór: Adres = Base + (Index - Start)
 
-            codeGen.emit("LOAD", info->sym->memory_address + 1); //ra = startIndex
-            codeGen.emit("SWP h"); //rh = startIndex
+            ctx.codeGen.emit(Op::LOAD, info->sym->memory_address + 1); //ra = startIndex
+            ctx.codeGen.emit(Op::SWP, 'h'); //rh = startIndex
 
-            codeGen.generateConstant("a", constant_index);
-            codeGen.emit("SUB h"); //ra = index - startIndex
-            codeGen.emit("SWP h");
-            codeGen.emit("LOAD", info->sym->memory_address); //ra = baseaddress
-            codeGen.emit("ADD h"); //ra = baseadress + (index - startIndex)
+            ctx.codeGen.generateConstant('a', constant_index);
+            ctx.codeGen.emit(Op::SUB, 'h'); //ra = index - startIndex
+            ctx.codeGen.emit(Op::SWP, 'h');
+            ctx.codeGen.emit(Op::LOAD, info->sym->memory_address); //ra = baseaddress
+            ctx.codeGen.emit(Op::ADD, 'h'); //ra = baseadress + (index - startIndex)
 
             if(value_to_reg){
-                codeGen.emit("SWP h");
-                codeGen.emit("RLOAD h #param array const index");
+                ctx.codeGen.emit(Op::SWP, 'h');
+                ctx.codeGen.emit(Op::RLOAD, 'h', "param array const index");
             }
         }
         else { //Zwykła zmienna lub lokalna tablica arr[5]
             if(info->sym->is_param) // Jeśli to zwykły parametr (nie tablica), musimy wyłuskać wartość (dereferencja)
             {
-                codeGen.emit("LOAD", info->memory_address);
+                ctx.codeGen.emit(Op::LOAD, info->memory_address);
                 if(value_to_reg){
-                    codeGen.emit("SWP h");
-                    codeGen.emit("RLOAD h #param");
+                    ctx.codeGen.emit(Op::SWP, 'h');
+                    ctx.codeGen.emit(Op::RLOAD, 'h', "param");
                 }
             }
             else{
-                if(value_to_reg) codeGen.emit("LOAD", info->memory_address);
-                else codeGen.generateConstant("a", info->memory_address);
+                if(info->sym->reg && !value_to_reg) yyerror(ctx, "Internal error: address of a variable kept in register");
+                if(value_to_reg) load_scalar(ctx, info->sym, info->memory_address);
+                else {
+                    ctx.codeGen.generateConstant('a', info->memory_address);
+                    ctx.symbolTable.markIndirect(info->memory_address); // adres zmiennej w rejestrze - zapis przez RSTORE
+                }
             }
         }
-        if(reg != "a") codeGen.emit("SWP " + reg);
+        if(reg != 'a') ctx.codeGen.emit(Op::SWP, reg);
     } else { // arr[x]
         // Adres = AdresBazowy + Wartość(x) - StartIndex
-        codeGen.emit("LOAD", info->offset_or_addr); // Załaduj x do ra
+        if (info->ref->is_param) ctx.codeGen.emit(Op::LOAD, info->offset_or_addr); // Załaduj x do ra
+        else load_scalar(ctx, info->ref, info->offset_or_addr);
 
         if (info->ref->is_param) { // Jeśli indeks 'x' jest parametrem to ładujemy adres
-            if(info->ref->is_O && !info->ref->is_initialized) yyerror("Trying to access O variable");
-            codeGen.emit("SWP h");
-            codeGen.emit("RLOAD h #load x"); 
+            if(info->ref->is_O && !info->ref->is_initialized) yyerror(ctx, "Trying to access O variable");
+            ctx.codeGen.emit(Op::SWP, 'h');
+            ctx.codeGen.emit(Op::RLOAD, 'h', "load x"); 
         }
         // Teraz w ra mamy liczbę całkowitą będącą indeksem tablicy
         if (info->sym->is_param && info->sym->is_T) {
-            if(!info->sym->is_T) yyerror("Accessing parameter as array but array not marked as T");
+            if(!info->sym->is_T) yyerror(ctx, "Accessing parameter as array but array not marked as T");
             // [memory_address] = Adres Bazowy, [memory_address + 1] = Start Index
             // Odejmij StartIndex od wartości indeksu x (arr[x])
-            codeGen.emit("SWP h"); //rh = x
-            codeGen.emit("LOAD", info->memory_address + 1); //ra = start_index
-            codeGen.emit("SWP h"); //ra = x rh = start_index
-            codeGen.emit("SUB h"); //ra = x-start_index
+            ctx.codeGen.emit(Op::SWP, 'h'); //rh = x
+            ctx.codeGen.emit(Op::LOAD, info->memory_address + 1); //ra = start_index
+            ctx.codeGen.emit(Op::SWP, 'h'); //ra = x rh = start_index
+            ctx.codeGen.emit(Op::SUB, 'h'); //ra = x-start_index
             
-            codeGen.emit("SWP h"); // Przenieś przesunięcie do 'h', żeby zwolnić 'a'
-            codeGen.emit("LOAD", info->memory_address); // Załaduj dynamiczny adres bazowy tablicy
-            codeGen.emit("ADD h"); // ra = memory_addres + x - start_index
+            ctx.codeGen.emit(Op::SWP, 'h'); // Przenieś przesunięcie do 'h', żeby zwolnić 'a'
+            ctx.codeGen.emit(Op::LOAD, info->memory_address); // Załaduj dynamiczny adres bazowy tablicy
+            ctx.codeGen.emit(Op::ADD, 'h'); // ra = memory_addres + x - start_index
 
             if(value_to_reg){
-                codeGen.emit("SWP h");
-                codeGen.emit("RLOAD h #param");
+                ctx.codeGen.emit(Op::SWP, 'h');
+                ctx.codeGen.emit(Op::RLOAD, 'h', "param");
             }
-            if(reg != "a") codeGen.emit("SWP " + reg);
+            if(reg != 'a') ctx.codeGen.emit(Op::SWP, reg);
         }
         else{
             long long net_offset = (long long)info->memory_address - (long long)info->sym->array_start;
     
             // rb zawiera net_offset
             if (net_offset > 0) {
-                codeGen.generateConstant("h", net_offset); 
-                codeGen.emit("ADD h"); // ra = ra + rh = x + arr.memory_address - arr.start_index
+                ctx.codeGen.generateConstant('h', net_offset); 
+                ctx.codeGen.emit(Op::ADD, 'h'); // ra = ra + rh = x + arr.memory_address - arr.start_index
             } else if (net_offset < 0) {
-                codeGen.generateConstant("h", -net_offset);
-                codeGen.emit("SUB h"); // ra = max(ra - rh, 0) 
+                ctx.codeGen.generateConstant('h', -net_offset);
+                ctx.codeGen.emit(Op::SUB, 'h'); // ra = max(ra - rh, 0) 
             }
             
             if(value_to_reg){
-                codeGen.emit("SWP h"); // teraz rb zawiera adres
-                codeGen.emit("RLOAD h"); // Wczytaj liczbę do ra. ra = p_rh
+                ctx.codeGen.emit(Op::SWP, 'h'); // teraz rb zawiera adres
+                ctx.codeGen.emit(Op::RLOAD, 'h'); // Wczytaj liczbę do ra. ra = p_rh
             }
-            if(reg != "a") codeGen.emit("SWP " + reg);
+            if(reg != 'a') ctx.codeGen.emit(Op::SWP, reg);
         }
     }
+    if (numbered) {
+        // odczyt przez RLOAD h zostawia adres w rh
+        if (value_to_reg && !info->pointer_reg && (info->is_array_ref || info->sym->is_param)) ctx.codeGen.bindValue('h', address);
+        ctx.codeGen.bindValue(reg, computed);
+    }
+}
+
+/// @brief Sprawdza, czy wartość value jest znana w czasie kompilacji (liczba albo zmienna lokalna o znanej wartości)
+/// @param val_info value z parsera
+/// @param value tu zapisywana jest znana wartość
+bool value_known(Compilation& ctx, ValueInfo *val_info, unsigned long long &value){
+    VariableInfo *info = val_info->var_info;
+    if(info == nullptr){
+        value = val_info->value;
+        return true;
+    }
+    if(info->is_array_ref || info->sym->is_param || info->sym->is_array || info->sym->is_iterator) return false;
+    return ctx.knownValues.get(info->name, value);
 }
 
 /// @brief zapisuje do rejestru wartość zmiennej / liczbę
-void save_value_to_reg(ValueInfo *val_info, std::string reg){
-    if(reg == "h") yyerror("r_h is reserved for calculations in save_value_to_reg!");
+void save_value_to_reg(Compilation& ctx, ValueInfo *val_info, char reg){
+    if(reg == 'h') yyerror(ctx, "r_h is reserved for calculations in save_value_to_reg!");
     VariableInfo *info = val_info->var_info;
+    unsigned long long known;
     if(info == nullptr){
-        codeGen.generateConstant(reg, val_info->value);
+        ctx.codeGen.generateConstant(reg, val_info->value);
+    }
+    else if(value_known(ctx, val_info, known) &&
+            ctx.codeGen.constantCost(reg, known) <= (info->sym->reg ? 6u : 50u) + (reg != 'a' ? 5u : 0u)){
+        ctx.codeGen.generateConstant(reg, known); // taniej niż odczyt zmiennej o znanej wartości
     }
     else{
-        save_to_reg(info, reg, true);
+        save_to_reg(ctx, info, reg, true);
     }
-    delete info;
-    delete val_info;
 }
 
 /// @brief zapisuje do rejestru adres zmiennej / adres
-void save_address_to_reg(VariableInfo *info, std::string reg){
-    if(reg == "h") yyerror("r_h is reserved for calculations in save_address_to_reg!");
-    save_to_reg(info, reg, false);
+void save_address_to_reg(Compilation& ctx, VariableInfo *info, char reg){
+    if(reg == 'h') yyerror(ctx, "r_h is reserved for calculations in save_address_to_reg!");
+    save_to_reg(ctx, info, reg, false);
+}
+
+/// @brief zwraca rejestr, w którym trzymana jest wartość value (zmienna skalarna w rejestrze), albo 0
+char value_register(ValueInfo *val_info){
+    VariableInfo *info = val_info->var_info;
+    if(info == nullptr || info->is_array_ref || info->sym->is_param) return 0;
+    return info->sym->reg;
+}
+
+/// @brief pomija value, której wartość nie musi być ładowana (np. jest już w rejestrze). Węzły zwalnia arena kompilacji
+void discard_value(ValueInfo *){
+}
+
+/// @brief Klucz value do numeracji wartości: znana liczba albo klucz zmiennej
+std::string value_key(Compilation& ctx, ValueInfo *val_info, std::vector<std::string>& deps){
+    unsigned long long known;
+    if(value_known(ctx, val_info, known)) return std::to_string(known);
+    return variable_key(val_info->var_info, deps);
 }
 
-/// @brief tworzy pętle FOR wraz z warunkiem wyjścia z pętli oraz emituje instrukcje skoków
-ForLoopInfo* create_for_loop(char* pid, ValueInfo* fromVal, ValueInfo* toVal, bool is_downto) {
+/// @brief Po zapisie ra do zmiennej info unieważnia zapamiętane wyrażenia, które od niej zależą,
+/// i zapamiętuje, że zmienna (w pamięci) albo ra zawiera zapisaną wartość
+void assign_value(Compilation& ctx, const VariableInfo *info){
+    if(!info->is_array_ref && !info->sym->is_param && !info->sym->is_array){
+        ctx.codeGen.assignValue(info->name, info->sym->reg ? -1 : (long long)info->memory_address);
+        return;
+    }
+    ValueNumber value;
+    value.key = variable_key(info, value.deps);
+    ctx.codeGen.invalidateValues(info->name);
+    if(info->sym->is_param) ctx.codeGen.invalidateValues("*");
+    ctx.codeGen.bindValue('a', value);
+}
+
+/// @brief Zapamiętuje wartości w ra i w drugim rejestrze po dzieleniu x / y (DIV: iloraz w ra, reszta w rb,
+/// MOD: reszta w ra, iloraz w rh), żeby drugie z działań na tych samych argumentach nie dzieliło ponownie
+/// @param both false, gdy policzono tylko wynik w ra (np. przesunięciami)
+void bind_division(Compilation& ctx, const std::string& kx, const std::string& ky, const std::vector<std::string>& deps, bool is_mod, bool both){
+    ctx.codeGen.bindValue('a', {kx + (is_mod ? "%" : "/") + ky, deps});
+    if(both) ctx.codeGen.bindValue(is_mod ? 'h' : 'b', {kx + (is_mod ? "/" : "%") + ky, deps});
+}
+
+/// @brief Liczy w czasie kompilacji x op y, jeśli obie wartości są znane. Wtedy generuje wynik w ra i zwalnia x i y
+/// @param op jeden z '+', '-', '*', '/', '%'
+/// @return znana wartość wyrażenia albo is_known = false (np. przy przekroczeniu 64 bitów)
+KnownValue fold_expression(Compilation& ctx, ValueInfo *x, ValueInfo *y, char op){
+    unsigned long long a, b, result = 0;
+    if(!value_known(ctx, x, a) || !value_known(ctx, y, b)) return {false, 0};
+    switch(op){
+        case '+': if(__builtin_add_overflow(a, b, &result)) return {false, 0}; break;
+        case '-': result = a > b ? a - b : 0; break;
+        case '*': if(__builtin_mul_overflow(a, b, &result)) return {false, 0}; break;
+        case '/': result = b == 0 ? 0 : a / b; break;
+        case '%': result = b == 0 ? 0 : a % b; break;
+    }
+    discard_value(x);
+    discard_value(y);
+    ctx.codeGen.generateConstant('a', result);
+    return {true, result};
+}
+
+/// @brief ra = x * c dla stałej c. Wybiera tańszy z kodu bez pętli (przesunięcia i dodawania) i pętli generateMult
+void mult_by_constant(Compilation& ctx, ValueInfo *x, unsigned long long c){
+    if(c == 0){
+        discard_value(x);
+        ctx.codeGen.emit(Op::RST, 'a');
+        return;
+    }
+    char r = value_register(x);
+    if(ctx.codeGen.multByConstantCost(c, r == 0) <= ctx.codeGen.multLoopCost(c)){
+        if(r){
+            discard_value(x);
+            ctx.codeGen.emit(Op::RST, 'a');
+            ctx.codeGen.emit(Op::ADD, r);
+        }
+        else save_value_to_reg(ctx, x, 'a');
+        ctx.codeGen.generateMultByConstant(c, r);
+    }
+    else{ // pętla wykonuje się raz dla każdego bitu stałej w rb
+        save_value_to_reg(ctx, x, 'c');
+        ctx.codeGen.generateConstant('b', c);
+        ctx.codeGen.generateMult(false);
+    }
+}
+
+/// @brief ra = x div d albo ra = x mod d dla stałej d. Potęgi dwójki liczone przesunięciami, jeśli są tańsze od pętli generateDiv
+/// @param is_mod true dla reszty z dzielenia
+/// @return true, gdy dzielenie pętlą zostawiło też drugi wynik (jak bind_division)
+bool div_by_constant(Compilation& ctx, ValueInfo *x, unsigned long long d, bool is_mod){
+    if(d == 0 || (is_mod && d == 1)){
+        discard_value(x);
+        ctx.codeGen.emit(Op::RST, 'a');
+        return false;
+    }
+    char r = value_register(x);
+    int k = CodeGenerator::bitLength(d) - 1;
+    if((d & (d - 1)) == 0){ // d = 2^k
+        unsigned long long shift_cost = is_mod ? 2 * k + (r ? 16 : 21) : k;
+        if(!is_mod || shift_cost <= ctx.codeGen.divLoopCost(d)){
+            if(r){
+                discard_value(x);
+                ctx.codeGen.emit(Op::RST, 'a');
+                ctx.codeGen.emit(Op::ADD, r);
+            }
+            else save_value_to_reg(ctx, x, 'a');
+            if(is_mod && !r){ // rb = x
+                ctx.codeGen.emit(Op::SWP, 'b');
+                ctx.codeGen.emit(Op::RST, 'a');
+                ctx.codeGen.emit(Op::ADD, 'b');
+            }
+            for(int i = 0; i < k; i++) ctx.codeGen.emit(Op::SHR, 'a');
+            if(is_mod){ // x mod 2^k = x - (x div 2^k) * 2^k
+                for(int i = 0; i < k; i++) ctx.codeGen.emit(Op::SHL, 'a');
+                ctx.codeGen.emit(Op::SWP, 'b');
+                if(r){
+                    ctx.codeGen.emit(Op::RST, 'a');
+                    ctx.codeGen.emit(Op::ADD, r);
+                }
+                ctx.codeGen.emit(Op::SUB, 'b');
+            }
+            return false;
+        }
+    }
+    save_value_to_reg(ctx, x, 'b');
+    ctx.codeGen.generateConstant('c', d);
+    ctx.codeGen.generateDiv(false);
+    ctx.codeGen.emit(Op::SWP, is_mod ? 'b' : 'h');
+    return true;
+}
+
+/// @brief ra = x * y. Iloczyn policzony wcześniej w tym bloku kodu jest brany z rejestru albo ze zmiennej
+void emit_multiplication(Compilation& ctx, ValueInfo *x, ValueInfo *y){
+    std::vector<std::string> deps;
+    std::string kx = value_key(ctx, x, deps), ky = value_key(ctx, y, deps);
+    if(ky < kx) std::swap(kx, ky);
+    ValueNumber product{kx + "*" + ky, deps};
+    unsigned long long c;
+    bool by_constant = value_known(ctx, x, c) || value_known(ctx, y, c);
+    if(ctx.codeGen.reuseValue(product.key, !by_constant)){ // mnożenie przez stałą bywa tańsze od LOAD
+        discard_value(x);
+        discard_value(y);
+        return;
+    }
+    if(value_known(ctx, y, c)){
+        discard_value(y);
+        mult_by_constant(ctx, x, c);
+    }
+    else if(value_known(ctx, x, c)){
+        discard_value(x);
+        mult_by_constant(ctx, y, c);
+    }
+    else{ //r_a = r_b*r_c metodą rosyjskich chłopów
+        save_value_to_reg(ctx, x, 'b');
+        save_value_to_reg(ctx, y, 'c');
+        ctx.codeGen.generateMult();
+    }
+    ctx.codeGen.bindValue('a', product);
+}
+
+/// @brief ra = x div y albo ra = x mod y. Iloraz i reszta z jednego dzielenia są zapamiętywane,
+/// więc x / y i x % y na tych samych argumentach dzielą tylko raz
+void emit_division(Compilation& ctx, ValueInfo *x, ValueInfo *y, bool is_mod){
+    std::vector<std::string> deps;
+    std::string kx = value_key(ctx, x, deps), ky = value_key(ctx, y, deps);
+    unsigned long long d;
+    bool by_shift = value_known(ctx, y, d) && (d & (d - 1)) == 0; // przesunięcie bywa tańsze od LOAD
+    if(ctx.codeGen.reuseValue(kx + (is_mod ? "%" : "/") + ky, !by_shift)){
+        discard_value(x);
+        discard_value(y);
+        return;
+    }
+    bool both = true;
+    if(value_known(ctx, y, d)){
+        discard_value(y);
+        both = div_by_constant(ctx, x, d, is_mod);
+    }
+    else{ // generateDiv zostawia iloraz w rh, a resztę w rb
+        save_value_to_reg(ctx, x, 'b');
+        save_value_to_reg(ctx, y, 'c');
+        ctx.codeGen.generateDiv();
+        ctx.codeGen.emit(Op::SWP, is_mod ? 'b' : 'h');
+    }
+    bind_division(ctx, kx, ky, deps, is_mod, both);
+}
+
+/// @brief Liczy w czasie kompilacji porównanie x i y, jeśli obie wartości są znane. Wtedy zwalnia x i y
+/// @param op jeden z "=", "!=", ">", "<", ">=", "<="
+/// @return 1 prawda, 0 fałsz, -1 gdy wartość nie jest znana
+signed char fold_condition(Compilation& ctx, ValueInfo *x, ValueInfo *y, const std::string& op){
+    unsigned long long a, b;
+    if(!value_known(ctx, x, a) || !value_known(ctx, y, b)) return -1;
+    bool result = op == "=" ? a == b : op == "!=" ? a != b : op == ">" ? a > b :
+                  op == "<" ? a < b : op == ">=" ? a >= b : a <= b;
+    discard_value(x);
+    discard_value(y);
+    return result;
+}
+
+/// @brief Zapomina wartości zmiennych modyfikowanych w pętli otwieranej tokenem kind (WHILE, REPEAT, FOR),
+/// bo przy kolejnych obrotach pętli mogą być inne niż przed nią. Parser redukuje akcje otwierające pętle
+/// bez wczytywania tokenu z wyprzedzeniem, więc najbliższy wcześniejszy token kind otwiera właśnie tę pętlę
+void forget_loop_variables(Compilation& ctx, int kind){
+    int start = ctx.tokenStream.findBackward(kind);
+    if(start < 0) ctx.knownValues.clear();
+    else ctx.knownValues.forget(KnownValues::modifiedInLoop(ctx.tokenStream.all(), start));
+}
+
+/// @brief emituje ra = max(x - y, 0) dla porównań. Odjemnik trzymany w rejestrze nie jest kopiowany do rb,
+/// a małą stałą odejmujemy instrukcjami DEC
+void emit_difference(Compilation& ctx, ValueInfo *x, ValueInfo *y){
+    unsigned long long c;
+    if (value_known(ctx, y, c) && c <= ctx.codeGen.constantCost('b', c) + 5) {
+        discard_value(y);
+        save_value_to_reg(ctx, x, 'a');
+        for (unsigned long long i = 0; i < c; i++) ctx.codeGen.emit(Op::DEC, 'a');
+    }
+    else if (char r = value_register(y)) {
+        discard_value(y);
+        save_value_to_reg(ctx, x, 'a');
+        ctx.codeGen.emit(Op::SUB, r);
+    }
+    else {
+        save_value_to_reg(ctx, y, 'b');
+        save_value_to_reg(ctx, x, 'a');
+        ctx.codeGen.emit(Op::SUB, 'b');
+    }
+}
+
+/// @brief Warunek porządkowy: emituje ra = x - y i skok jump (JZERO albo JPOS) do false_lable.
+/// Gdy odjemna jest znanym zerem, różnica też jest zerem i wynik warunku jest znany bez emitowania kodu
+/// @return known dla struktury Condition
+signed char emit_relation(Compilation& ctx, ValueInfo *x, ValueInfo *y, Op jump, int false_lable){
+    unsigned long long c;
+    if (value_known(ctx, x, c) && c == 0) {
+        discard_value(x);
+        discard_value(y);
+        return jump == Op::JZERO ? 0 : 1;
+    }
+    emit_difference(ctx, x, y);
+    ctx.codeGen.emitLable(false_lable, jump);
+    return -1;
+}
+
+/// @brief Warunek x = y (albo x != y, gdy negate): emituje porównanie ze skokiem do false_lable, gdy warunek jest fałszywy.
+/// Różnice x - y i y - x są sprawdzane po kolei, więc gdy pierwsza rozstrzyga, drugiej nie liczymy.
+/// Porównanie ze stałą c sprawdza x - (c - 1) > 0 i x - c = 0 jedną różnicą i instrukcją DEC
+void emit_equality(Compilation& ctx, ValueInfo *x, ValueInfo *y, int false_lable, bool negate){
+    unsigned long long c;
+    if (value_known(ctx, x, c)) std::swap(x, y);
+    if (value_known(ctx, y, c)) {
+        discard_value(y);
+        if (c == 0) {
+            save_value_to_reg(ctx, x, 'a');
+            ctx.codeGen.emitLable(false_lable, negate ? Op::JZERO : Op::JPOS);
+            return;
+        }
+        emit_difference(ctx, x, ctx.arena.make<ValueInfo>(c - 1, nullptr));
+        int L_true = negate ? ctx.codeGen.newLable() : -1;
+        ctx.codeGen.emitLable(negate ? L_true : false_lable, Op::JZERO); // x < c
+        ctx.codeGen.emit(Op::DEC, 'a');
+        ctx.codeGen.emitLable(false_lable, negate ? Op::JZERO : Op::JPOS); // x = c albo x > c
+        if (negate) ctx.codeGen.defineLable(L_true);
+        return;
+    }
+
+    // zmienne w rejestrach porównujemy na miejscu, pozostałe wartości trafiają do rb i rc
+    char ry = value_register(y), rx = value_register(x);
+    if (ry) discard_value(y);
+    else { save_value_to_reg(ctx, y, 'b'); ry = 'b'; }
+    if (rx) discard_value(x);
+    else { save_value_to_reg(ctx, x, 'c'); rx = 'c'; }
+
+    int L_true = negate ? ctx.codeGen.newLable() : -1;
+    ctx.codeGen.emit(Op::RST, 'a');
+    ctx.codeGen.emit(Op::ADD, rx);
+    ctx.codeGen.emit(Op::SUB, ry);
+    ctx.codeGen.emitLable(negate ? L_true : false_lable, Op::JPOS); // x > y
+    ctx.codeGen.emit(Op::RST, 'a');
+    ctx.codeGen.emit(Op::ADD, ry);
+    ctx.codeGen.emit(Op::SUB, rx);
+    ctx.codeGen.emitLable(false_lable, negate ? Op::JZERO : Op::JPOS); // y > x albo x = y
+    if (negate) ctx.codeGen.defineLable(L_true);
+}
+
+/// @brief emituje ra = X - Y dla zmiennych pętli FOR (iterator, limit) trzymanych w rejestrach albo w pamięci
+void emit_loop_difference(Compilation& ctx, char regX, unsigned long long addrX, char regY, unsigned long long addrY){
+    if(regY){
+        if(regX){ ctx.codeGen.emit(Op::RST, 'a'); ctx.codeGen.emit(Op::ADD, regX); }
+        else ctx.codeGen.emit(Op::LOAD, addrX);
+        ctx.codeGen.emit(Op::SUB, regY);
+    }
+    else{
+        ctx.codeGen.emit(Op::LOAD, addrY);
+        ctx.codeGen.emit(Op::SWP, 'b');
+        if(regX){ ctx.codeGen.emit(Op::RST, 'a'); ctx.codeGen.emit(Op::ADD, regX); }
+        else ctx.codeGen.emit(Op::LOAD, addrX);
+        ctx.codeGen.emit(Op::SUB, 'b');
+    }
+}
+
+// Zmienna trzymana w rejestrze, którą trzeba odtworzyć z pamięci po wywołaniu procedury
+struct SpillSlot {
+    char reg;
+    unsigned long long address;
+};
+
+/// @brief Przed wywołaniem procedury name zapisuje do pamięci zmienne trzymane w rejestrach, które procedura może odczytać
+/// (przekazane jako argument) albo których rejestr nadpisuje
+/// @return lista zmiennych do odtworzenia po powrocie z procedury
+std::vector<SpillSlot> spill_registers(Compilation& ctx, const std::string& name, const std::vector<const char*>& args){
+    std::vector<SpillSlot> reload;
+    unsigned clobbered = ctx.symbolTable.getClobberedRegs(name);
+    const std::vector<Symbol>& params = ctx.symbolTable.getParameters(name);
+
+    for(Symbol *sym : ctx.symbolTable.registerVariables()){
+        bool passed = false, modified = false;
+        for(size_t k = 0; k < args.size(); k++){
+            if(sym->name != args[k]) continue;
+            passed = true;
+            if(k >= params.size() || !params[k].is_I) modified = true;
+        }
+        bool is_clobbered = clobbered & (1u << (sym->reg - 'a'));
+        if(passed || is_clobbered){
+            ctx.codeGen.emit(Op::RST, 'a');
+            ctx.codeGen.emit(Op::ADD, sym->reg);
+            ctx.codeGen.emit(Op::STORE, sym->memory_address);
+        }
+        if(is_clobbered || modified) reload.push_back({sym->reg, sym->memory_address});
+    }
+    for(ForLoopInfo *loop : ctx.symbolTable.activeLoops()){
+        if(loop->limitReg && (clobbered & (1u << (loop->limitReg - 'a')))){
+            ctx.codeGen.emit(Op::RST, 'a');
+            ctx.codeGen.emit(Op::ADD, loop->limitReg);
+            ctx.codeGen.emit(Op::STORE, loop->limitAddr);
+            reload.push_back({loop->limitReg, loop->limitAddr});
+        }
+    }
+    return reload;
+}
+
+/// @brief Po powrocie z procedury odtwarza rejestry zapisane przez spill_registers
+void reload_registers(Compilation& ctx, const std::vector<SpillSlot>& reload){
+    for(const SpillSlot& slot : reload){
+        ctx.codeGen.emit(Op::LOAD, slot.address);
+        ctx.codeGen.emit(Op::SWP, slot.reg);
+    }
+}
+
+/// @brief Początek ciała procedury lub programu: przydział rejestrów zmiennym zakresu
+void begin_body(Compilation& ctx){
+    std::string proc = ctx.symbolTable.currentProcedure();
+    unsigned mask = ctx.registerAllocator.allocate(proc, ctx.symbolTable);
+    for(const auto& [name, reg] : ctx.registerAllocator.scalarRegisters(proc)){
+        if(Symbol *sym = ctx.symbolTable.getSymbol(name); sym && reg) sym->reg = reg;
+    }
+    ctx.symbolTable.setClobberedRegs(mask);
+    ctx.for_counter = 0;
+    ctx.knownValues.clear();
+}
+
+/// @brief Wylicza adres arr[iterator] do rejestru reg (wskaźnik indukcyjny pętli loop). Niszczy ra i rh
+void set_array_pointer(Compilation& ctx, ForLoopInfo *loop, const std::string& array, char reg){
+    VariableInfo info;
+    info.sym = ctx.symbolTable.getSymbol(array);
+    info.ref = ctx.symbolTable.getSymbol(loop->iteratorName);
+    info.name = ctx.names.intern(array);
+    info.memory_address = info.sym->memory_address;
+    info.is_param = info.sym->is_param;
+    info.is_array_ref = true;
+    info.offset_or_addr = info.ref->memory_address;
+    save_address_to_reg(ctx, &info, reg);
+}
+
+/// @brief Po wywołaniu procedury, która nadpisuje rejestry, wylicza na nowo wskaźniki indukcyjne otwartych pętli
+void restore_array_pointers(Compilation& ctx, unsigned clobbered){
+    for(ForLoopInfo *loop : ctx.symbolTable.activeLoops())
+        for(const auto& [array, reg] : loop->pointerRegs)
+            if(clobbered & (1u << (reg - 'a'))) set_array_pointer(ctx, loop, array, reg);
+}
+
+// Rozwijanie pętli FOR o znanych granicach (liczba dodanych instrukcji, bo długość kodu też się liczy)
+const unsigned long long WHILE_ROTATE_BUDGET = 12;   // najdłuższy kod warunku WHILE kopiowany na koniec ciała
+const unsigned long long HOT_LOOP_EXECUTIONS = 1000; // z profilem: pętla o tylu obrotach dostaje 4 razy większy budżet rozwinięcia
+const unsigned long long FULL_UNROLL_BUDGET = 48;    // pełne rozwinięcie: (obroty - 1) * (ciało + krok)
+const unsigned long long PARTIAL_UNROLL_BUDGET = 24; // częściowe: (krotność - 1) * (ciało + krok)
+const unsigned long long MAX_UNROLL_FACTOR = 4;
+
+/// @brief ładuje do ra iterator pętli
+void load_iterator(Compilation& ctx, ForLoopInfo *info){
+    if(info->iteratorReg){
+        ctx.codeGen.emit(Op::RST, 'a');
+        ctx.codeGen.emit(Op::ADD, info->iteratorReg);
+    }
+    else ctx.codeGen.emit(Op::LOAD, info->iteratorAddr);
+}
+
+/// @brief emituje ra = max(iterator - limit, 0)
+void emit_iterator_minus_limit(Compilation& ctx, ForLoopInfo *info){
+    if(info->limitStored){
+        emit_loop_difference(ctx, info->iteratorReg, info->iteratorAddr, info->limitReg, info->limitAddr);
+        return;
+    }
+    ctx.codeGen.generateConstant('b', info->limit);
+    load_iterator(ctx, info);
+    ctx.codeGen.emit(Op::SUB, 'b');
+}
+
+/// @brief emituje ra = max(limit - iterator, 0)
+void emit_limit_minus_iterator(Compilation& ctx, ForLoopInfo *info){
+    if(info->limitStored){
+        emit_loop_difference(ctx, info->limitReg, info->limitAddr, info->iteratorReg, info->iteratorAddr);
+        return;
+    }
+    if(info->iteratorReg){
+        ctx.codeGen.generateConstant('a', info->limit);
+        ctx.codeGen.emit(Op::SUB, info->iteratorReg);
+    }
+    else{
+        ctx.codeGen.emit(Op::LOAD, info->iteratorAddr);
+        ctx.codeGen.emit(Op::SWP, 'b');
+        ctx.codeGen.generateConstant('a', info->limit);
+        ctx.codeGen.emit(Op::SUB, 'b');
+    }
+}
+
+/// @brief Liczba wykonań linii źródła z profilu (--profile-use)
+/// @return false, gdy nie ma profilu albo linii w profilu - wtedy decyzję podejmuje heurystyka statyczna
+bool line_executions(Compilation& ctx, int line, unsigned long long& executions){
+    return ctx.options.profile.count(line, executions);
+}
+
+/// @brief zwiększa (TO) albo zmniejsza (DOWNTO) iterator i wskaźniki indukcyjne pętli
+void emit_loop_step(Compilation& ctx, ForLoopInfo *info){
+    Op step = info->is_downto ? Op::DEC : Op::INC;
+    if (info->iteratorReg) {
+        ctx.codeGen.emit(step, info->iteratorReg, "FOOOOOOOOR LOOOOOOOP EEEEEEEEEEENDDDD AT NEXT JUMP");
+    } else {
+        ctx.codeGen.emit(Op::LOAD, info->iteratorAddr, "FOOOOOOOOR LOOOOOOOP EEEEEEEEEEENDDDD AT NEXT JUMP");
+        ctx.codeGen.emit(step, 'a');
+        ctx.codeGen.emit(Op::STORE, info->iteratorAddr);
+    }
+    for (const auto& [array, reg] : info->pointerRegs) ctx.codeGen.emit(step, reg);
+    ctx.codeGen.invalidateValues(info->iteratorName);
+}
+
+/// @brief tworzy pętlę FOR: zapisuje iterator i limit, sprawdza raz, czy pętla wykona się choć raz,
+/// i zaczyna ciało. Warunek kolejnego obrotu jest sprawdzany na końcu ciała (end_for_loop)
+ForLoopInfo* create_for_loop(Compilation& ctx, const char* pid, ValueInfo* fromVal, ValueInfo* toVal, bool is_downto) {
     
-    ForLoopInfo *info = symbolTable.declareIterator(pid, is_downto); 
+    ForLoopInfo *info = ctx.symbolTable.declareIterator(pid, is_downto); 
+    if(const LoopUsage *usage = ctx.registerAllocator.loop(ctx.symbolTable.currentProcedure(), ctx.for_counter++)){
+        info->iteratorReg = usage->iteratorReg;
+        info->limitReg = usage->limitReg;
+        ctx.symbolTable.getSymbol(pid)->reg = usage->iteratorReg;
+    }
+
+    unsigned long long from, to;
+    bool toKnown = value_known(ctx, toVal, to);
+    info->boundsKnown = value_known(ctx, fromVal, from) && toKnown;
+    if(info->boundsKnown){
+        unsigned long long high = is_downto ? from : to, low = is_downto ? to : from;
+        if(high < low) info->trips = 0;
+        else if(high - low == ULLONG_MAX) info->boundsKnown = false;
+        else info->trips = high - low + 1;
+    }
+    int L_end = ctx.codeGen.newLable();
+    if(info->boundsKnown && info->trips == 0) ctx.codeGen.skipUntil(L_end); // ciało nigdy się nie wykona
     
     // Zapisz wartość początkową (FROM) do iteratora
-    save_value_to_reg(fromVal, "a");
-    codeGen.emit("STORE", info->iteratorAddr, "FOOOOOOOOOR LOOOOOOOOOP STAAAAAAAAART");
+    save_value_to_reg(ctx, fromVal, 'a');
+    if(info->iteratorReg) ctx.codeGen.emit(Op::SWP, info->iteratorReg, "FOOOOOOOOOR LOOOOOOOOOP STAAAAAAAAART");
+    else ctx.codeGen.emit(Op::STORE, info->iteratorAddr, "FOOOOOOOOOR LOOOOOOOOOP STAAAAAAAAART");
+    ctx.codeGen.invalidateValues(pid);
     
-    // Zapisz wartość końcową (TO/DOWNTO) do ukrytej zmiennej (limit)
-    save_value_to_reg(toVal, "a");
-    codeGen.emit("STORE", info->limitAddr);
+    // Zapisz wartość końcową (TO/DOWNTO) do ukrytej zmiennej (limit). Znaną małą stałą taniej wygenerować przy porównaniu
+    if(toKnown && !info->limitReg && ctx.codeGen.constantCost(to) <= 50){
+        discard_value(toVal);
+        info->limitStored = false;
+        info->limit = to;
+    }
+    else{
+        save_value_to_reg(ctx, toVal, 'a');
+        if(info->limitReg) ctx.codeGen.emit(Op::SWP, info->limitReg);
+        else ctx.codeGen.emit(Op::STORE, info->limitAddr);
+    }
 
-    int L_start = codeGen.newLable();
-    codeGen.defineLable(L_start); // miejsce początku pętli
-    codeGen.pushLable(L_start);
-    
-    if (!is_downto) { // from 0 to 5.
-        // Pętla TO (i++). Warunek stopu: Jeśli (iterator - limit) > 0 to KONIEC.
-        codeGen.emit("LOAD", info->limitAddr);
-        codeGen.emit("SWP b");
-        codeGen.emit("LOAD", info->iteratorAddr);
-        codeGen.emit("SUB b"); // acc = iterator - limit
-    } else { // from 5 down to 2
-    // from 5 downto 0 
-        // Pętla DOWNTO (i--). Warunek stopu Jeśli (limit - iterator) > 0 to KONIEC.
-        codeGen.emit("LOAD", info->iteratorAddr);
-        codeGen.emit("SWP b");
-        codeGen.emit("LOAD", info->limitAddr);
-        codeGen.emit("SUB b");  // acc = limit - iterator
-    }
-
-    int L_end = codeGen.newLable();
-    codeGen.emitLable(L_end, "JPOS");
-    codeGen.pushLable(L_end);
-    
-    // info->startLabel = startLabel;
-    // info->endLabel = jumpInstrIndex;
+    if(const LoopUsage *usage = ctx.registerAllocator.loop(ctx.symbolTable.currentProcedure(), ctx.for_counter - 1)){
+        for(const ArrayPointer& p : usage->pointers){
+            if(!p.reg) continue;
+            info->pointerRegs[p.array] = p.reg;
+            set_array_pointer(ctx, info, p.array, p.reg);
+        }
+    }
+
+    forget_loop_variables(ctx, FOR);
+    ctx.known_stack.push_back(ctx.knownValues.state());
+
+    if(!info->boundsKnown){ // pętla może nie wykonać się ani razu
+        if(!is_downto) emit_iterator_minus_limit(ctx, info); // TO: koniec, gdy iterator - limit > 0
+        else emit_limit_minus_iterator(ctx, info);           // DOWNTO: koniec, gdy limit - iterator > 0
+        ctx.codeGen.emitLable(L_end, Op::JPOS);
+    }
+
+    int L_body = ctx.codeGen.newLable();
+    ctx.codeGen.defineLable(L_body); // początek ciała, tu wraca skok z końca pętli
+    info->bodyStart = ctx.codeGen.getCurrentLine();
+    ctx.codeGen.pushLable(L_body);
+    ctx.codeGen.pushLable(L_end);
     
     return info;
 }
 
-const std::string JPOS_lable = "JPOS";
-const std::string JZERO_lable = "JZERO";
+/// @brief Kończy pętlę FOR. Przy znanej liczbie obrotów ciało jest kopiowane: w całości, jeśli zmieści się w budżecie
+/// rozmiaru kodu, albo kilka razy na jeden obrót pętli (liczba obrotów musi być podzielna przez krotność rozwinięcia).
+/// Pozostałe obroty sprawdzają warunek na końcu ciała, bez skoku na początek pętli
+void end_for_loop(Compilation& ctx, ForLoopInfo *info, int L_body, int L_end){
+    unsigned long long bodyEnd = ctx.codeGen.getCurrentLine();
+    if(info->boundsKnown && info->trips > 0 && ctx.codeGen.isLive()){
+        unsigned long long copy = bodyEnd - info->bodyStart + (info->iteratorReg ? 1 : 3) + info->pointerRegs.size();
+        unsigned long long full_budget = FULL_UNROLL_BUDGET, partial_budget = PARTIAL_UNROLL_BUDGET, executions;
+        // z profilem: nie rozwijamy pętli, która się nie wykonała. Warunek obrotu jest w linii ENDFOR (obecnej)
+        if(line_executions(ctx, ctx.line, executions)){
+            unsigned long long scale = executions == 0 ? 0 : executions >= HOT_LOOP_EXECUTIONS ? 4 : 1;
+            full_budget *= scale;
+            partial_budget *= scale;
+        }
+        if(info->trips - 1 <= full_budget / copy){
+            for(unsigned long long k = 1; k < info->trips; k++){
+                emit_loop_step(ctx, info);
+                ctx.codeGen.duplicate(info->bodyStart, bodyEnd);
+            }
+            ctx.codeGen.defineLable(L_end);
+            return;
+        }
+        unsigned long long factor = MAX_UNROLL_FACTOR;
+        while(factor > 1 && (info->trips % factor != 0 || (factor - 1) * copy > partial_budget)) factor--;
+        for(unsigned long long k = 1; k < factor; k++){
+            emit_loop_step(ctx, info);
+            ctx.codeGen.duplicate(info->bodyStart, bodyEnd);
+        }
+    }
+
+    if(!info->is_downto){ // iterator++; dalej, gdy iterator - limit = 0
+        emit_loop_step(ctx, info);
+        emit_iterator_minus_limit(ctx, info);
+        ctx.codeGen.emitLable(L_body, Op::JZERO);
+    }
+    else if(info->iteratorReg){ // dalej, gdy iterator - limit > 0 (przed zmniejszeniem, bo DEC zatrzymuje się na 0)
+        emit_iterator_minus_limit(ctx, info);
+        emit_loop_step(ctx, info);
+        ctx.codeGen.emitLable(L_body, Op::JPOS);
+    }
+    else{ // iterator w pamięci: zmniejszenie przechodzi przez ra
+        emit_iterator_minus_limit(ctx, info);
+        ctx.codeGen.emitLable(L_end, Op::JZERO);
+        emit_loop_step(ctx, info);
+        ctx.codeGen.emitLable(L_body, Op::JUMP);
+    }
+    ctx.codeGen.defineLable(L_end);
+}
 
 %}
 
 // wyświetla błędy semantyczne np. brak średnika
 %define parse.error verbose
 
+// parser wielowejściowy: stan kompilacji w ctx zamiast zmiennych globalnych
+%define api.pure full
+%parse-param { Compilation& ctx }
+%lex-param { Compilation& ctx }
+
 /* Definicja typów danych przekazywanych między regułami */
 %union {
     unsigned long long num; /* Dla liczb (64-bit)  */
@@ -350,8 +1030,10 @@ const std::string JZERO_lable = "JZERO";
     ValueInfo *val;
     Args *args;
     ProcCall *procCall;
-    const std::string *lable;
+    Condition cond;
+    KnownValue known;
     ForLoopInfo* loop_info;
+    InlineSite* inline_site;
 }
 
 
@@ -359,7 +1041,8 @@ const std::string JZERO_lable = "JZERO";
 %token <id> PIDENTIFIER
 
 %type <var_info> identifier
-%type <lable> condition
+%type <cond> condition
+%type <known> expression
 %type <val> value
 %type <procCall> proc_call
 %type <type> type
@@ -385,32 +1068,36 @@ const std::string JZERO_lable = "JZERO";
 
 %token PLUS MINUS MULT DIV MOD
 
+%token <inline_site> INLINE_BEGIN
+%token INLINE_END
+
 %%
 
 // koniec programu ma instrukcje końca HALT
 program_all:
-    procedures main {codeGen.emit("HALT");}
+    procedures main {ctx.codeGen.emit(Op::HALT);}
     ;
 
 // Deklaracja nowej procedury, wejście do nowego zakresu widoczności (scope'u), zapisanie adresu powrotu z procedury
 procedure_head: PROCEDURE PIDENTIFIER {
-    if(symbolTable.procedureExists($2->pid)) yyerror("Procedure already declared");
-    unsigned long long returnAddress = symbolTable.createProcedure($2->pid, codeGen.getCurrentLine());
-    symbolTable.enterScope();
-    codeGen.emit("STORE", returnAddress);
+    if(ctx.symbolTable.procedureExists($2->pid)) yyerror(ctx, "Procedure already declared");
+    unsigned long long returnAddress = ctx.symbolTable.createProcedure($2->pid, ctx.codeGen.getCurrentLine());
+    ctx.symbolTable.enterScope();
+    ctx.codeGen.forgetRegisters(); // procedura jest wołana z różnych miejsc
+    ctx.codeGen.emit(Op::STORE, returnAddress);
 }
 
 // Po zakończeniu procedury, ładuje adres powrotu i wraca RTRN
 procedures:
-    procedures procedure_head proc_head IS declarations IN commands END {
-        codeGen.emit("LOAD", symbolTable.getReturnAddress());
-        codeGen.emit("RTRN #" + symbolTable.currentProcedure());
-        symbolTable.leaveScope();
+    procedures procedure_head proc_head IS declarations body_start commands END {
+        ctx.codeGen.emit(Op::LOAD, ctx.symbolTable.getReturnAddress());
+        ctx.codeGen.emit(Op::RTRN, ctx.symbolTable.currentProcedureName());
+        ctx.symbolTable.leaveScope();
         }
-    | procedures procedure_head proc_head IS IN commands END {
-        codeGen.emit("LOAD", symbolTable.getReturnAddress());
-        codeGen.emit("RTRN #" + symbolTable.currentProcedure());
-        symbolTable.leaveScope();
+    | procedures procedure_head proc_head IS body_start commands END {
+        ctx.codeGen.emit(Op::LOAD, ctx.symbolTable.getReturnAddress());
+        ctx.codeGen.emit(Op::RTRN, ctx.symbolTable.currentProcedureName());
+        ctx.symbolTable.leaveScope();
         }
     | %empty
     ;
@@ -421,8 +1108,8 @@ proc_head:
 
 // Deklaracja kolejnych parametrów procedury
 args_decl:
-    args_decl COMMA type PIDENTIFIER { declare_parameter($4, $3);}
-    | type PIDENTIFIER { declare_parameter($2, $1); }
+    args_decl COMMA type PIDENTIFIER { declare_parameter(ctx, $4, $3);}
+    | type PIDENTIFIER { declare_parameter(ctx, $2, $1); }
     ;
 
 type:
@@ -434,23 +1121,26 @@ type:
 
 // wejście w scope dla main
 main_start: PROGRAM IS { 
-        symbolTable.enterScope(); //enter main scope
-        int L_end = codeGen.popLable();
-        codeGen.defineLable(L_end);
+        ctx.symbolTable.enterScope(); //enter main scope
+        int L_end = ctx.codeGen.popLable();
+        ctx.codeGen.defineLable(L_end);
     }
 
+// początek ciała procedury lub programu, po deklaracjach zmiennych
+body_start: IN { begin_body(ctx); };
+
 main:
-    main_start declarations IN commands END
-    | main_start IN commands END
-    | ERROR { yyerror(""); }
+    main_start declarations body_start commands END
+    | main_start body_start commands END
+    | ERROR { yyerror(ctx, ""); }
     ;
 
 // deklaracja kolejno zmiennej i tablicy
 declarations:
-    declarations COMMA PIDENTIFIER{ declare_variable($3);}
-    | declarations COMMA PIDENTIFIER LBRACKET NUM COLON NUM RBRACKET { declare_array($3, $5, $7);}
-    | PIDENTIFIER { declare_variable($1);}
-    | PIDENTIFIER LBRACKET NUM COLON NUM RBRACKET { declare_array($1, $3, $5);}
+    declarations COMMA PIDENTIFIER{ declare_variable(ctx, $3);}
+    | declarations COMMA PIDENTIFIER LBRACKET NUM COLON NUM RBRACKET { declare_array(ctx, $3, $5, $7);}
+    | PIDENTIFIER { declare_variable(ctx, $1);}
+    | PIDENTIFIER LBRACKET NUM COLON NUM RBRACKET { declare_array(ctx, $1, $3, $5);}
     ;
 
 commands:
@@ -458,12 +1148,14 @@ commands:
     | command
     ;
  
- // Pomocniczy nieterminal, wstawia *$1 label i pushLable(label)
+ // Pomocniczy nieterminal, wstawia $1 label i pushLable(label)
 if_start:
     condition {
-      int L_else = codeGen.newLable();
-      codeGen.emitLable(L_else, *$1);
-      codeGen.pushLable(L_else);
+      int L_else = $1.false_lable;
+      if ($1.known == 0) ctx.codeGen.skipUntil(L_else); // gałąź THEN nigdy się nie wykona
+      ctx.codeGen.pushLable(L_else);
+      ctx.if_known.push_back($1.known);
+      ctx.known_stack.push_back(ctx.knownValues.state());
     };
 
 then_block: THEN commands;
@@ -471,28 +1163,41 @@ then_block: THEN commands;
 // tworzy pętle for
 for_start:
     FOR PIDENTIFIER FROM value TO value DO {
-        $$ = create_for_loop($2->pid, $4, $6, false);
+        $$ = create_for_loop(ctx, $2->pid, $4, $6, false);
     }
     | FOR PIDENTIFIER FROM value DOWNTO value DO {
-        $$ = create_for_loop($2->pid, $4, $6, true);
+        $$ = create_for_loop(ctx, $2->pid, $4, $6, true);
     }
     ;
 
 // To jest miejsce po wykonaniu then_block
 then_tail: 
     { 
-        int L_else = codeGen.popLable();
-        int L_end  = codeGen.newLable();
-        codeGen.emitLable(L_end, "JUMP"); // jump za ELSE
-        codeGen.defineLable(L_else);// definuj poczatek ELSE
-        codeGen.pushLable(L_end);
+        int L_else = ctx.codeGen.popLable();
+        int L_end  = ctx.codeGen.newLable();
+        if (ctx.if_known.back() == 1) ctx.codeGen.skipUntil(L_end); // gałąź ELSE nigdy się nie wykona
+        else ctx.codeGen.emitLable(L_end, Op::JUMP); // jump za ELSE
+        ctx.codeGen.defineLable(L_else);// definuj poczatek ELSE
+        ctx.codeGen.pushLable(L_end);
+        // ELSE zaczyna się ze stanem sprzed IF, stan po THEN czeka na złączenie
+        KnownValues::State then_state = ctx.knownValues.state();
+        ctx.knownValues.restore(ctx.known_stack.back());
+        ctx.known_stack.back() = then_state;
     } ELSE commands ENDIF {
-        int L_end = codeGen.popLable();
-        codeGen.defineLable(L_end);
+        int L_end = ctx.codeGen.popLable();
+        ctx.codeGen.defineLable(L_end);
+        if (ctx.if_known.back() == 1) ctx.knownValues.restore(ctx.known_stack.back());
+        else if (ctx.if_known.back() == -1) ctx.knownValues.merge(ctx.known_stack.back());
+        ctx.if_known.pop_back();
+        ctx.known_stack.pop_back();
     }
   | ENDIF {//bez ELSE
-        int L_end = codeGen.popLable();
-        codeGen.defineLable(L_end);
+        int L_end = ctx.codeGen.popLable();
+        ctx.codeGen.defineLable(L_end);
+        if (ctx.if_known.back() == 0) ctx.knownValues.restore(ctx.known_stack.back());
+        else if (ctx.if_known.back() == -1) ctx.knownValues.merge(ctx.known_stack.back());
+        ctx.if_known.pop_back();
+        ctx.known_stack.pop_back();
     };
 
 // Rdzeń parsera, są tu wszystkie komendy języka
@@ -500,99 +1205,124 @@ command:
     identifier ASSIGN expression SEMICOLON { 
         // v := expr, r_b zawiera adres v
         VariableInfo *info = $1;
-        if(info->sym->is_I) yyerror("Cannot modify constant I variable");
-        if(info->sym->is_iterator) yyerror("Cannot modify FOR iterator");
-
-        codeGen.emit("SWP f");
-        save_address_to_reg(info, "b");
-        codeGen.emit("SWP f"); 
-        codeGen.emit("RSTORE b"); // r_a zawiera wartość expression (policzone w expr)
-        symbolTable.markInitialized(info->name);
-        delete info;
+        if(info->sym->is_I) yyerror(ctx, "Cannot modify constant I variable");
+        if(info->sym->is_iterator) yyerror(ctx, "Cannot modify FOR iterator");
+        if (info->is_array_ref == false && info->sym->is_param == false && info->sym->is_array == false) {
+            if ($3.is_known) ctx.knownValues.set(info->name, $3.value);
+            else ctx.knownValues.forget(info->name);
+        }
+
+        if (info->is_array_ref == false && info->sym->is_param == false) { // x lub arr[5]
+            store_scalar(ctx, info->sym, info->memory_address);
+        } else if (info->pointer_reg) {
+            ctx.codeGen.emit(Op::RSTORE, info->pointer_reg);
+        } else {
+            ctx.codeGen.emit(Op::SWP, 'd');
+            save_address_to_reg(ctx, info, 'b');
+            ctx.codeGen.emit(Op::SWP, 'd'); 
+            ctx.codeGen.emit(Op::RSTORE, 'b'); // r_a zawiera wartość expression (policzone w expr)
+        }
+        assign_value(ctx, info);
+        ctx.symbolTable.markInitialized(info->name);
     } 
     | IF if_start then_block then_tail //działa
     | WHILE{
-            int L_start = codeGen.newLable();
-            codeGen.defineLable(L_start); // miejsce początku pętli
-            codeGen.pushLable(L_start); // zapamiętaj start (będzie potrzebny do JUMP)
+            forget_loop_variables(ctx, WHILE);
+            ctx.known_stack.push_back(ctx.knownValues.state());
+            int L_start = ctx.codeGen.newLable();
+            ctx.codeGen.defineLable(L_start); // początek warunku
+            ctx.codeGen.pushLable(L_start);
         } condition{
-            int L_end = codeGen.newLable();
-            codeGen.emitLable(L_end, *$3);
-            codeGen.pushLable(L_end);
+            int L_end = $3.false_lable;
+            if ($3.known == 0) ctx.codeGen.skipUntil(L_end); // ciało pętli nigdy się nie wykona
+            int L_body = ctx.codeGen.newLable();
+            ctx.codeGen.defineLable(L_body);
+            ctx.codeGen.pushLable(L_body);
+            ctx.codeGen.pushLable(L_end);
         } DO commands ENDWHILE {
-            int L_end = codeGen.popLable();
-            int L_start = codeGen.popLable();
-            codeGen.emitLable(L_start, "JUMP"); // skocz z powrotem na początek
-            codeGen.defineLable(L_end);
+            int L_end = ctx.codeGen.popLable();
+            int L_body = ctx.codeGen.popLable();
+            int L_start = ctx.codeGen.popLable();
+            // krótki warunek powtarzamy na końcu ciała z odwróconym skokiem (do ciała, gdy prawdziwy),
+            // więc obrót pętli nie wykonuje skoku z powrotem do warunku
+            unsigned long long cond_start = ctx.codeGen.lableAddress(L_start), cond_end = ctx.codeGen.lableAddress(L_body);
+            unsigned long long budget = WHILE_ROTATE_BUDGET, executions;
+            // z profilem: obracamy każdą pętlę, której ciało się powtarzało, i żadnej, która się nie wykonała
+            if (cond_start < cond_end && line_executions(ctx, ctx.codeGen.sourceLine(cond_start), executions))
+                budget = executions > 1 ? cond_end - cond_start : 0;
+            if (cond_start == cond_end) ctx.codeGen.emitLable(L_body, Op::JUMP); // warunek zawsze prawdziwy
+            else if (cond_end - cond_start > budget
+                     || !ctx.codeGen.emitInvertedCondition(cond_start, cond_end, L_end, L_body))
+                ctx.codeGen.emitLable(L_start, Op::JUMP);
+            ctx.codeGen.defineLable(L_end);
+            ctx.knownValues.restore(ctx.known_stack.back()); // z pętli wychodzimy przy sprawdzaniu warunku
+            ctx.known_stack.pop_back();
         }
     | REPEAT{
-            int L_start = codeGen.newLable();
-            codeGen.defineLable(L_start); // miejsce początku pętli
-            codeGen.pushLable(L_start);
+            forget_loop_variables(ctx, REPEAT);
+            int L_start = ctx.codeGen.newLable();
+            ctx.codeGen.defineLable(L_start); // miejsce początku pętli
+            ctx.codeGen.pushLable(L_start);
         } commands UNTIL condition SEMICOLON {
-            int L_start = codeGen.popLable();
-            codeGen.emitLable(L_start, *$5 );
+            int L_start = ctx.codeGen.popLable();
+            if ($5.known == 0) ctx.codeGen.emitLable(L_start, Op::JUMP); // warunek nigdy nie jest prawdziwy
+            ctx.codeGen.defineLableAs($5.false_lable, L_start); // fałszywy warunek wraca na początek pętli
         }
     | for_start commands ENDFOR  {
         ForLoopInfo* info = $1;
-        int L_end = codeGen.popLable();
+        int L_end = ctx.codeGen.popLable();
+        int L_body = ctx.codeGen.popLable();
+        end_for_loop(ctx, info, L_body, L_end);
+        ctx.knownValues.restore(ctx.known_stack.back());
+        ctx.known_stack.pop_back();
 
-        if (info->is_downto) { // from 5 to 0.
-            // Pętla TO (i++). Warunek stopu: Jeśli (iterator - limit) > 0 to KONIEC.
-            codeGen.emit("LOAD", info->limitAddr);
-            codeGen.emit("SWP b");
-            codeGen.emit("LOAD", info->iteratorAddr);
-            codeGen.emit("SUB b"); // acc = iterator - limit
-            codeGen.emitLable(L_end, "JZERO");
-        }
-        
-        codeGen.emit("LOAD", info->iteratorAddr, "FOOOOOOOOR LOOOOOOOP EEEEEEEEEEENDDDD AT NEXT JUMP");
-        
-        if (info->is_downto) codeGen.emit("DEC a"); 
-        else codeGen.emit("INC a");
-        
-        codeGen.emit("STORE", info->iteratorAddr);
-        
-        int L_start = codeGen.popLable();
-        codeGen.emitLable(L_start, "JUMP"); // skocz z powrotem na początek
-        codeGen.defineLable(L_end);
-
-        symbolTable.removeIterator();
-        delete info;
+        ctx.symbolTable.removeIterator();
     }
     | proc_call SEMICOLON {
-        if(!symbolTable.procedureExists($1->id->pid)) yyerror(("Calling undeclared procedure \"" + std::string($1->id->pid) + "\"").c_str());
-        if(symbolTable.currentProcedure() == $1->id->pid) yyerror(("Recursive call for procedure \"" + std::string($1->id->pid) + "\"").c_str());
-        unsigned long long procLable = symbolTable.getProcedureLable($1->id->pid);
-        set_arguments($1->id->pid, $1->args->arguments, $1->id->num);
-        free($1);
-        codeGen.emit("CALL", procLable);
+        if(!ctx.symbolTable.procedureExists($1->id->pid)) yyerror(ctx, ("Calling undeclared procedure \"" + std::string($1->id->pid) + "\"").c_str());
+        if(ctx.symbolTable.currentProcedure() == $1->id->pid) yyerror(ctx, ("Recursive call for procedure \"" + std::string($1->id->pid) + "\"").c_str());
+        unsigned long long procLable = ctx.symbolTable.getProcedureLable($1->id->pid);
+        const std::vector<Symbol>& params = ctx.symbolTable.getParameters($1->id->pid);
+        for (size_t k = 0; k < $1->args->arguments.size(); k++) // procedura może zmienić argumenty, które nie są I
+            if (k >= params.size() || !params[k].is_I) ctx.knownValues.forget($1->args->arguments[k]);
+        std::vector<SpillSlot> reload = spill_registers(ctx, $1->id->pid, $1->args->arguments);
+        set_arguments(ctx, $1->id->pid, $1->args->arguments, $1->id->num);
+        unsigned clobbered = ctx.symbolTable.getClobberedRegs($1->id->pid);
+        ctx.codeGen.emit(Op::CALL, procLable);
+        reload_registers(ctx, reload);
+        restore_array_pointers(ctx, clobbered);
     }
     | READ identifier SEMICOLON {
         VariableInfo *info = $2;
         
         if (info->is_array_ref == false && info->sym->is_param == false) { // x lub arr[5]
-            codeGen.emit("READ");
-            codeGen.emit("STORE", info->memory_address);
+            ctx.codeGen.emit(Op::READ);
+            store_scalar(ctx, info->sym, info->memory_address);
+            ctx.knownValues.forget(info->name);
+        } else if (info->pointer_reg) {
+            ctx.codeGen.emit(Op::READ);
+            ctx.codeGen.emit(Op::RSTORE, info->pointer_reg);
         } else { // arr[x]
-            save_address_to_reg(info, "b");
-            codeGen.emit("READ"); // Wczytaj liczbę do ra
-            codeGen.emit("RSTORE b"); // Zapisz ra do adresu wskazanego przez rb
+            save_address_to_reg(ctx, info, 'b');
+            ctx.codeGen.emit(Op::READ); // Wczytaj liczbę do ra
+            ctx.codeGen.emit(Op::RSTORE, 'b'); // Zapisz ra do adresu wskazanego przez rb
         }
-        symbolTable.markInitialized(info->name);
-        delete info;
+        assign_value(ctx, info);
+        ctx.symbolTable.markInitialized(info->name);
     }
+    // ciało procedury wstawione w miejsce wywołania przez Inliner
+    | INLINE_BEGIN { begin_inline(ctx, $1); } commands INLINE_END { ctx.inline_depth--; }
     // Zapisz do r_a wartość value i wywołaj WRITE
     | WRITE value SEMICOLON {
-        save_value_to_reg($2, "a");
-        codeGen.emit("WRITE");
+        save_value_to_reg(ctx, $2, 'a');
+        ctx.codeGen.emit(Op::WRITE);
     }
     ;
 
 // wywołanie procedury z listą argumentów np. fun(a, b, c)
 proc_call:
     PIDENTIFIER LPAREN args RPAREN { // args są po kolei [a1, a2, a3,...]
-        $$ = new ProcCall();
+        $$ = ctx.arena.make<ProcCall>();
         $$->id = $1;
         $$->args = $3;
     }
@@ -603,132 +1333,104 @@ args:
         $$->arguments.push_back($3->pid);
     }
     | PIDENTIFIER {
-        $$ = new Args();
+        $$ = ctx.arena.make<Args>();
         $$->arguments.push_back($1->pid);
     };
 
 expression: // zapisuje wartość wyrażenia do r_a
     value PLUS value {
-        save_value_to_reg($1, "b");
-        save_value_to_reg($3, "a");
-        codeGen.emit("ADD b");
-    }
-    | value MINUS value {
-        save_value_to_reg($1, "b");
-        save_value_to_reg($3, "a");
-        codeGen.emit("SWP b");
-        codeGen.emit("SUB b");
-    }
-    | value MULT value {
-        if ($3 -> value == 0 && $3->var_info == nullptr) codeGen.emit("RST a");
-        else if ($1 -> value == 0 && $1->var_info == nullptr) codeGen.emit("RST a");
-        else if ($3 -> value == 2){
-            save_value_to_reg($1, "a");
-            codeGen.emit("SHL a");
+        $$ = fold_expression(ctx, $1, $3, '+');
+        if ($$.is_known) {}
+        else if (char r = value_register($3)) {
+            discard_value($3);
+            save_value_to_reg(ctx, $1, 'a');
+            ctx.codeGen.emit(Op::ADD, r);
         }
-        else if ($1 -> value == 2){
-            save_value_to_reg($3, "a");
-            codeGen.emit("SHL a");
+        else if (char r = value_register($1)) {
+            discard_value($1);
+            save_value_to_reg(ctx, $3, 'a');
+            ctx.codeGen.emit(Op::ADD, r);
         }
-        else if ($3 -> value == 1) save_value_to_reg($1, "a");
-        else if ($1 -> value == 1) save_value_to_reg($3, "a");
-        else{ //r_a = r_b*r_c metodą rosyjskich chłopów
-            save_value_to_reg($1, "b");
-            save_value_to_reg($3, "c");
-            unsigned long long jumpLable = codeGen.getCurrentLine();
-            codeGen.generateMult(jumpLable);
+        else {
+            save_value_to_reg(ctx, $1, 'b');
+            save_value_to_reg(ctx, $3, 'a');
+            ctx.codeGen.emit(Op::ADD, 'b');
         }
     }
-    | value DIV value {
-        if ($3 -> value == 0 && $3->var_info == nullptr){
-            codeGen.emit("RST a");
-        }
-        else if ($3 -> value == 1){
-            save_value_to_reg($1, "a");
-        }
-        else if ($3 -> value == 2){
-            save_value_to_reg($1, "a");
-            codeGen.emit("SHR a");
+    | value MINUS value {
+        $$ = fold_expression(ctx, $1, $3, '-');
+        if ($$.is_known) {}
+        else if (char r = value_register($3)) {
+            discard_value($3);
+            save_value_to_reg(ctx, $1, 'a');
+            ctx.codeGen.emit(Op::SUB, r);
         }
         else {
-            // co z dzieleniem przez 0 jeśli value to nie NUM
-            // SWP c    JZERO end_of_div    SWP c    a=b/c
-            // generate_division_code w jednym rejestrze wynik w drugim reszta z dzielenia(modulo)
-            save_value_to_reg($1, "b");
-            save_value_to_reg($3, "c");
-            codeGen.generateDiv();
-            codeGen.emit("SWP h");
+            save_value_to_reg(ctx, $1, 'b');
+            save_value_to_reg(ctx, $3, 'a');
+            ctx.codeGen.emit(Op::SWP, 'b');
+            ctx.codeGen.emit(Op::SUB, 'b');
         }
     }
+    | value MULT value {
+        $$ = fold_expression(ctx, $1, $3, '*');
+        if (!$$.is_known) emit_multiplication(ctx, $1, $3);
+    }
+    | value DIV value {
+        $$ = fold_expression(ctx, $1, $3, '/');
+        if (!$$.is_known) emit_division(ctx, $1, $3, false);
+    }
     | value MOD value {
-        if ($3 -> value == 0 && $3->var_info == nullptr){
-            codeGen.emit("RST a");
-        }
-        else if ($3 -> value == 1){
-            codeGen.emit("RST a");
-        }
-        else{
-            save_value_to_reg($1, "b");
-            save_value_to_reg($3, "c");
-            codeGen.generateDiv();
-            codeGen.emit("SWP b");
-        }
+        $$ = fold_expression(ctx, $1, $3, '%');
+        if (!$$.is_known) emit_division(ctx, $1, $3, true);
+    }
+    | value {
+        $$.is_known = value_known(ctx, $1, $$.value);
+        save_value_to_reg(ctx, $1, 'a');
     }
-    | value { save_value_to_reg($1, "a");}
     ;
 
-//skaczemy jeśli fałsz (sprawdzamy warunek przeciwny)
+//skaczemy do false_lable jeśli fałsz (sprawdzamy warunek przeciwny)
 condition:
-    value EQ value { // (a-b)+(b-a)>0
-        save_value_to_reg($1, "b");
-        save_value_to_reg($3, "c");
-        codeGen.generateIsEqual();
-        $$ = &JPOS_lable;
-    }
-    | value NEQ value { // (a-b)+(b-a)=0
-        save_value_to_reg($1, "b");
-        save_value_to_reg($3, "c");
-        codeGen.generateIsEqual();
-        $$ = &JZERO_lable;
+    value EQ value {
+        $$ = {ctx.codeGen.newLable(), fold_condition(ctx, $1, $3, "=")};
+        if ($$.known == -1) emit_equality(ctx, $1, $3, $$.false_lable, false);
+    }
+    | value NEQ value {
+        $$ = {ctx.codeGen.newLable(), fold_condition(ctx, $1, $3, "!=")};
+        if ($$.known == -1) emit_equality(ctx, $1, $3, $$.false_lable, true);
     }
     | value GT value { // a <= b -> a-b <= 0
-        save_value_to_reg($3, "b");
-        save_value_to_reg($1, "a");
-        codeGen.emit("SUB b");
-        $$ = &JZERO_lable;
-    }
-    | value LT value { // b >= a -> 0 >= a-b
-        save_value_to_reg($1, "b");
-        save_value_to_reg($3, "a");
-        codeGen.emit("SUB b");
-        $$ = &JZERO_lable;
-    }
-    | value GE value { // b < a -> a-b > 0
-        save_value_to_reg($1, "b");
-        save_value_to_reg($3, "a");
-        codeGen.emit("SUB b");
-        $$ = &JPOS_lable;
+        $$ = {ctx.codeGen.newLable(), fold_condition(ctx, $1, $3, ">")};
+        if ($$.known == -1) $$.known = emit_relation(ctx, $1, $3, Op::JZERO, $$.false_lable);
+    }
+    | value LT value { // b >= a -> 0 >= b-a
+        $$ = {ctx.codeGen.newLable(), fold_condition(ctx, $1, $3, "<")};
+        if ($$.known == -1) $$.known = emit_relation(ctx, $3, $1, Op::JZERO, $$.false_lable);
+    }
+    | value GE value { // b > a -> b-a > 0
+        $$ = {ctx.codeGen.newLable(), fold_condition(ctx, $1, $3, ">=")};
+        if ($$.known == -1) $$.known = emit_relation(ctx, $3, $1, Op::JPOS, $$.false_lable);
     }
     | value LE value { // a > b -> a-b > 0
-        save_value_to_reg($3, "b");
-        save_value_to_reg($1, "a");
-        codeGen.emit("SUB b");
-        $$ = &JPOS_lable;
+        $$ = {ctx.codeGen.newLable(), fold_condition(ctx, $1, $3, "<=")};
+        if ($$.known == -1) $$.known = emit_relation(ctx, $1, $3, Op::JPOS, $$.false_lable);
     }
     ;
 
 value: // zapisuje do ValueInfo wartość NUM albo wskaźnik do VariableInfo
     NUM {
-        $$ = new ValueInfo();
+        $$ = ctx.arena.make<ValueInfo>();
         $$->value = $1;
         $$->var_info = nullptr;
     }
     | identifier{
         VariableInfo *info = $1;
-        Symbol* sym = symbolTable.getSymbol(info->name);
-        if(!sym->is_initialized && !sym->is_param) yyerror("Cannot access uninitialized variable");
-        if(sym->is_O && !sym->is_initialized) yyerror("Cannot access uninitialized O variable");
-        $$ = new ValueInfo();
+        Symbol* sym = ctx.symbolTable.getSymbol(info->name);
+        // w ciele wstawionej procedury parametry są zastąpione argumentami - sprawdziliśmy je przy definicji procedury
+        if(!sym->is_initialized && !sym->is_param && !ctx.inline_depth) yyerror(ctx, "Cannot access uninitialized variable");
+        if(sym->is_O && !sym->is_initialized && !ctx.inline_depth) yyerror(ctx, "Cannot access uninitialized O variable");
+        $$ = ctx.arena.make<ValueInfo>();
         $$->var_info = info;
     }
     ;
@@ -737,10 +1439,10 @@ value: // zapisuje do ValueInfo wartość NUM albo wskaźnik do VariableInfo
 identifier:
     PIDENTIFIER //x
     {
-        Symbol* var = symbolTable.getSymbol($1->pid);
-        if(var == nullptr) yyerror(("Variable \"" + std::string($1->pid) + "\" not declared").c_str());
-        if(var->is_array == 1) yyerror(("Cannot access array \"" + std::string($1->pid) + "\" as variable").c_str());
-        $$ = new VariableInfo();
+        Symbol* var = ctx.symbolTable.getSymbol($1->name);
+        if(var == nullptr) yyerror(ctx, ("Variable \"" + std::string($1->pid) + "\" not declared").c_str());
+        if(var->is_array == 1) yyerror(ctx, ("Cannot access array \"" + std::string($1->pid) + "\" as variable").c_str());
+        $$ = ctx.arena.make<VariableInfo>();
         $$->sym = var;
         $$->name = $1->pid;
         $$->memory_address = var->memory_address;
@@ -749,58 +1451,106 @@ identifier:
     }
     | PIDENTIFIER LBRACKET PIDENTIFIER RBRACKET //arr[x]
     {
-        Symbol* arr = symbolTable.getSymbol($1->pid);
-        if(arr == nullptr) yyerror(("Array \""+ std::string($1->pid) + "\" not declared").c_str());
-        if(arr->is_array == 0) yyerror("Cannot access variable at index");
+        Symbol* arr = ctx.symbolTable.getSymbol($1->name);
+        if(arr == nullptr) yyerror(ctx, ("Array \""+ std::string($1->pid) + "\" not declared").c_str());
+        if(arr->is_array == 0) yyerror(ctx, "Cannot access variable at index");
 
-        Symbol* var = symbolTable.getSymbol($3->pid);
-        if(var == nullptr) yyerror(("Variable \""+ std::string($3->pid) + "\" not declared").c_str());
-        if(var->is_array == 1) yyerror("Cannot access array with another array");
-        if(var->is_initialized == 0 && !var->is_param) yyerror("Cannot access array with an uninitialized variable");
-        if(var->is_O == 1) yyerror("Cannot access O variable");
+        Symbol* var = ctx.symbolTable.getSymbol($3->name);
+        if(var == nullptr) yyerror(ctx, ("Variable \""+ std::string($3->pid) + "\" not declared").c_str());
+        if(var->is_array == 1) yyerror(ctx, "Cannot access array with another array");
+        if(var->is_initialized == 0 && !var->is_param && !ctx.inline_depth) yyerror(ctx, "Cannot access array with an uninitialized variable");
+        if(var->is_O == 1 && !ctx.inline_depth) yyerror(ctx, "Cannot access O variable");
 
-        $$ = new VariableInfo();
+        $$ = ctx.arena.make<VariableInfo>();
         $$->sym = arr;
         $$->ref = var;
         $$->name = $1->pid;
         $$->memory_address = arr->memory_address; // Adres bazowy tablicy
         $$->is_array_ref = true;
         $$->offset_or_addr = var->memory_address; // Adres zmiennej x
+        if (var->is_iterator) {
+            for (ForLoopInfo *loop : ctx.symbolTable.activeLoops())
+                if (loop->iteratorName == var->name && loop->pointerRegs.count(arr->name)) $$->pointer_reg = loop->pointerRegs[arr->name];
+        }
+
+        // Znana wartość x: odwołanie jak do arr[5]
+        unsigned long long index;
+        if (!var->is_param && !var->is_iterator && ctx.knownValues.get(var->name, index)) {
+            if (arr->is_T) {
+                $$->memory_address = arr->memory_address + index;
+                $$->is_array_ref = false;
+            } else if (index >= arr->array_start && index <= arr->array_end) {
+                $$->memory_address = arr->memory_address + (index - arr->array_start);
+                $$->is_array_ref = false;
+            }
+        }
     }
     | PIDENTIFIER LBRACKET NUM RBRACKET //arr[5]
     {
-        Symbol* sym = symbolTable.getSymbol($1->pid);
-        if(sym == nullptr) yyerror("Array not declared");
-        if(sym->is_array == 0) yyerror("Cannot access variable at index");
+        Symbol* sym = ctx.symbolTable.getSymbol($1->name);
+        if(sym == nullptr) yyerror(ctx, "Array not declared");
+        if(sym->is_array == 0) yyerror(ctx, "Cannot access variable at index");
         unsigned long long start = sym->array_start;
         unsigned long long end = sym->array_end;
         
-        if(!sym->is_T && ($3 < start || $3 > end)) yyerror("Array index out of bounds");
+        unsigned long long index = $3;
+        if(!sym->is_T && ($3 < start || $3 > end)) {
+            // parametr T wstawionej procedury nie sprawdzał zakresu: adres = początek + max(indeks - start, 0)
+            if(!ctx.inline_depth) yyerror(ctx, "Array index out of bounds");
+            if(index < start) index = start;
+        }
         if(sym->is_T) start = 0;
         
-        $$ = new VariableInfo();
+        $$ = ctx.arena.make<VariableInfo>();
         $$->sym = sym;
         $$->name = $1->pid;
-        $$->memory_address = sym->memory_address + ($3 - start);
+        $$->memory_address = sym->memory_address + (index - start);
         $$->is_array_ref = false;
     }
     ;
 
 %%
 
+/// @brief Podaje parserowi tokeny wczytane wcześniej przez lekser do tokenStream
+int yylex(YYSTYPE* lval, Compilation& ctx){
+    return ctx.tokenStream.nextToken(lval, &ctx.line);
+}
+
 /* Funkcja obsługi błędów */
-void yyerror(char const *s) {
-    std::cerr << "Error on line " << yylineno << ": " << s << std::endl;
-    exit(-1);
+void yyerror(Compilation& ctx, char const *s) {
+    throw CompileError("Error on line " + std::to_string(ctx.line) + ": " + s);
 }
 
-void parse_code( std::vector< std::string > & code, FILE * data ) 
+/// @brief Kompiluje program z pliku data do code. Błąd w programie zgłasza wyjątkiem CompileError
+/// @param ctx stan kompilacji z opcjami (ctx.options); po kompilacji ctx.symbolTable.indirectMemory() podaje
+/// komórki dostępne pośrednio
+void parse_code( Compilation& ctx, std::vector< Instr > & code, FILE * data ) 
 {
-    codeGen.setCode(code);
-    yyset_in( data );
+    ctx.codeGen.setCode(code, &ctx.line);
+    yyscan_t scanner;
+    if (yylex_init_extra(&ctx, &scanner) != 0) throw std::runtime_error("Cannot create scanner");
+    yyset_in(data, scanner);
+    ctx.stats.phase("lekser", [&]() {
+        ctx.tokenStream.read([scanner](YYSTYPE* lval, int* lineno) {
+            int kind = scan_token(lval, scanner);
+            *lineno = yyget_lineno(scanner);
+            return kind;
+        });
+    });
+    yylex_destroy(scanner);
+    ctx.stats.phase("wstawianie procedur", [&]() { Inliner(ctx.options, ctx.arena, ctx.names).run(ctx.tokenStream.all()); });
+    if (ctx.options.partialEvaluation)
+        ctx.stats.phase("obliczanie częściowe", [&]() { PartialEvaluator(ctx.arena, ctx.names).run(ctx.tokenStream.all()); });
+    CloneBindings clones;
+    if (ctx.options.procedureCloning && ctx.options.memoryLayout) // klony potrzebują adresów argumentów z planu
+        ctx.stats.phase("klonowanie procedur", [&]() { clones = ProcedureCloner(ctx.arena, ctx.names).run(ctx.tokenStream.all()); });
+    ctx.stats.phase("przydział rejestrów", [&]() { ctx.registerAllocator.analyze(ctx.tokenStream.all(), &ctx.options.profile); });
+    if (ctx.options.memoryLayout)
+        ctx.stats.phase("rozmieszczenie pamięci", [&]() { ctx.symbolTable.setLayout(MemoryLayout().plan(ctx.tokenStream.all())); });
+    ctx.symbolTable.setBindings(clones);
     //extern int yydebug;
     //yydebug = 1; 
-    yyparse();
-    codeGen.backpatchAllCheck();
-    symbolTable.leaveScope();
-}
\ No newline at end of file
+    ctx.stats.phase("parser i generowanie kodu", [&]() { yyparse(ctx); });
+    ctx.stats.phase("backpatching", [&]() { ctx.codeGen.backpatchAllCheck(); });
+    ctx.symbolTable.leaveScope();
+}
@@ -0,0 +1,623 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tokenStream.hh"
+#include "arena.hh"
+#include "codeGenerator.hh"
+
+// Budżet interpretera: tyle wykonanych komend i obrotów pętli na cały program
+const unsigned long long PARTIAL_EVAL_STEPS = 1000000;
+// Najwięcej komórek, którym jeden zastąpiony fragment przypisuje stałe (ogranicza przyrost kodu)
+const size_t PARTIAL_EVAL_MAX_CELLS = 1024;
+
+/// @brief Ewaluacja częściowa maina na poziomie tokenów, po wstawieniu procedur, przed analizą rejestrów.
+/// Komendy maina są po kolei wykonywane przez interpreter: te, których wartości nie zależą od READ (np. wypełnienie
+/// tablicy kwadratami w pętli), zastępujemy wypisaniem stałych (WRITE) i przypisaniem stałych zmiennym i komórkom
+/// tablic, które zmieniły - o ile według szacunku kosztu jest to tańsze od wykonania pętli w maszynie. Propagacja
+/// stałych w parserze podstawia potem te wartości w dalszym kodzie. Komenda, której nie da się wykonać (READ,
+/// wywołanie procedury, nieznana wartość, przepełnienie, wyczerpany budżet), zostaje, a zmienne, które może zmienić,
+/// przestają być znane. Zastępujemy tylko komendy, w których parser nie zgłosiłby błędu, więc błędy są zgłaszane jak wcześniej
+class PartialEvaluator {
+    struct Unsupported {}; // komendy nie da się wykonać w czasie kompilacji albo tokeny nie są poprawnym mainem
+
+    /// Liczba albo zmienna: x, arr[5], arr[x]
+    struct Operand {
+        const char* name = nullptr;  // nullptr - liczba num
+        unsigned long long num = 0;  // liczba albo stały indeks
+        const char* index = nullptr; // zmienna indeksująca arr[x]
+        bool indexed = false;
+    };
+
+    struct Command {
+        int kind = 0;                    // ASSIGN, IF, WHILE, REPEAT, FOR, READ, WRITE, LPAREN (wywołanie), INLINE_BEGIN
+        int begin = 0, end = 0;          // tokeny komendy [begin, end)
+        int line = 0;
+        bool clean = true;               // parser nie zgłosi w komendzie błędu
+        Operand target, left, right;     // cel przypisania/READ; wyrażenie, warunek, zakres FOR albo wartość WRITE
+        int op = 0;                      // PLUS..MOD, EQ..LE albo 0, gdy jest tylko left
+        bool downto = false;
+        const char* iterator = nullptr;
+        std::vector<Command> body, orelse;
+        std::set<const char*> assigned;  // zmienne i tablice maina, którym komenda przypisuje wartość (w tekście)
+        std::set<const char*> modified;  // wszystko, co komenda może zmienić (również argumenty wywołań)
+    };
+
+    struct Declaration {
+        bool is_array;
+        unsigned long long start, end;
+        bool is_main; // zadeklarowana w mainie (a nie lokalna zmienna wstawionej procedury)
+    };
+
+    using Cell = std::pair<const char*, unsigned long long>; // zmienna (indeks 0) albo komórka tablicy
+
+    /// Zmiana wartości komórki w bieżącej komendzie, do wycofania
+    struct Change {
+        Cell cell;
+        bool had;
+        unsigned long long old;
+    };
+
+    /// Ciąg kolejnych wykonanych komend maina, które razem zastąpimy stałymi
+    struct Fragment {
+        int begin = -1, end = -1;                  // tokeny [begin, end)
+        unsigned long long cost = 0;               // szacowany koszt wykonania komend w maszynie
+        std::vector<Cell> cells;                   // zmienione komórki maina, w kolejności pierwszego zapisu
+        std::map<Cell, int> lines;                 // linia komendy, która ostatnio zapisała komórkę
+        std::vector<std::pair<unsigned long long, int>> writes; // wypisane wartości i linie
+    };
+
+    /// Fragment maina zastąpiony stałymi
+    struct Replacement {
+        int begin, end;            // zastąpione tokeny [begin, end)
+        std::vector<Token> tokens; // WRITE i przypisania stałych
+    };
+
+    Arena& arena;
+    StringPool& names;
+    std::vector<Token>* tokens = nullptr;
+    int pos = 0;
+
+    // parsowanie
+    std::unordered_map<const char*, Declaration> declarations; // main i zmienne lokalne wstawionych procedur
+    std::map<const char*, std::vector<bool>> procedures;        // procedura -> czy kolejne parametry są tablicami (T)
+    std::vector<const char*> iterators;                         // iteratory otwartych pętli FOR
+    std::set<const char*> initialized;                          // zmienne przypisane w tekście przed obecnym miejscem
+    int inlineDepth = 0;                                        // w ciałach wstawionych procedur parser nie sprawdza inicjalizacji
+
+    // wykonanie
+    std::map<Cell, unsigned long long> values; // znane wartości komórek
+    std::vector<Change> journal;               // zmiany od początku bieżącej komendy maina
+    Fragment fragment;
+    std::vector<Replacement> replacements;
+    unsigned long long steps = 0;
+    unsigned long long cost = 0; // szacowany koszt bieżącej komendy
+
+    int kindAt(int i) const {
+        return i < (int)tokens->size() ? (*tokens)[i].kind : 0;
+    }
+
+    void expect(int kind) {
+        if (kindAt(pos) != kind) throw Unsupported{};
+        pos++;
+    }
+
+    const char* name() {
+        if (kindAt(pos) != PIDENTIFIER) throw Unsupported{};
+        return (*tokens)[pos++].value.id->pid;
+    }
+
+    const Declaration* declaration(const char* name) const {
+        auto it = declarations.find(name);
+        return it == declarations.end() ? nullptr : &it->second;
+    }
+
+    bool isIterator(const char* name) const {
+        return std::find(iterators.begin(), iterators.end(), name) != iterators.end();
+    }
+
+    bool isMain(const char* name) const {
+        const Declaration* d = declaration(name);
+        return d && d->is_main;
+    }
+
+    /// @brief Nagłówki procedur: które parametry są tablicami (do sprawdzenia argumentów wstawionych wywołań)
+    void scanProcedures() {
+        int n = (int)tokens->size();
+        for (int i = 0; i + 2 < n; i++) {
+            if (kindAt(i) != PROCEDURE || kindAt(i + 1) != PIDENTIFIER || kindAt(i + 2) != LPAREN) continue;
+            std::vector<bool>& params = procedures[(*tokens)[i + 1].value.id->pid];
+            for (i += 3; i < n && kindAt(i) != RPAREN; i++)
+                if (kindAt(i) == PIDENTIFIER) params.push_back(kindAt(i - 1) == T);
+        }
+    }
+
+    /// @brief x, arr[5] albo arr[x], ze sprawdzeniami parsera
+    /// @param read wartość jest odczytywana (musi być zainicjalizowana)
+    Operand parseIdentifier(Command& c, bool read) {
+        Operand o;
+        o.name = name();
+        const Declaration* d = declaration(o.name);
+        if (kindAt(pos) == LBRACKET) {
+            pos++;
+            o.indexed = true;
+            if (!d || !d->is_array) c.clean = false;
+            if (kindAt(pos) == NUM) {
+                o.num = (*tokens)[pos++].value.num;
+                if (d && d->is_array && !inlineDepth && (o.num < d->start || o.num > d->end)) c.clean = false;
+            } else {
+                o.index = name();
+                const Declaration* index = declaration(o.index);
+                bool iterator = isIterator(o.index);
+                if ((!index && !iterator) || (index && index->is_array)) c.clean = false;
+                else if (!inlineDepth && !iterator && !initialized.count(o.index)) c.clean = false;
+            }
+            expect(RBRACKET);
+        } else {
+            bool iterator = isIterator(o.name);
+            if ((!d && !iterator) || (d && d->is_array)) c.clean = false;
+            else if (read && !inlineDepth && !iterator && !initialized.count(o.name)) c.clean = false;
+        }
+        return o;
+    }
+
+    Operand parseValue(Command& c) {
+        if (kindAt(pos) != NUM) return parseIdentifier(c, true);
+        Operand o;
+        o.num = (*tokens)[pos++].value.num;
+        return o;
+    }
+
+    void parseCondition(Command& c) {
+        c.left = parseValue(c);
+        c.op = kindAt(pos);
+        if (c.op != EQ && c.op != NEQ && c.op != GT && c.op != LT && c.op != GE && c.op != LE) throw Unsupported{};
+        pos++;
+        c.right = parseValue(c);
+    }
+
+    /// @brief Zmiana wartości celu przypisania albo READ
+    void assignTo(Command& c, const char* target) {
+        if (isMain(target)) c.assigned.insert(target);
+        c.modified.insert(target);
+        initialized.insert(target);
+    }
+
+    /// @brief Parsuje komendy do tokenu kończącego blok i dołącza ich własności do parent
+    std::vector<Command> parseCommands(Command& parent) {
+        std::vector<Command> commands;
+        for (;;) {
+            switch (kindAt(pos)) {
+            case END: case ELSE: case ENDIF: case ENDWHILE: case UNTIL: case ENDFOR: case INLINE_END: case 0:
+                return commands;
+            default:
+                commands.push_back(parseCommand());
+                const Command& c = commands.back();
+                parent.clean = parent.clean && c.clean;
+                parent.assigned.insert(c.assigned.begin(), c.assigned.end());
+                parent.modified.insert(c.modified.begin(), c.modified.end());
+            }
+        }
+    }
+
+    Command parseCommand() {
+        Command c;
+        c.begin = pos;
+        c.line = (*tokens)[pos].line;
+        c.kind = kindAt(pos);
+        switch (c.kind) {
+        case IF:
+            pos++;
+            parseCondition(c);
+            expect(THEN);
+            c.body = parseCommands(c);
+            if (kindAt(pos) == ELSE) {
+                pos++;
+                c.orelse = parseCommands(c);
+            }
+            expect(ENDIF);
+            break;
+        case WHILE:
+            pos++;
+            parseCondition(c);
+            expect(DO);
+            c.body = parseCommands(c);
+            expect(ENDWHILE);
+            break;
+        case REPEAT:
+            pos++;
+            c.body = parseCommands(c);
+            expect(UNTIL);
+            parseCondition(c);
+            expect(SEMICOLON);
+            break;
+        case FOR:
+            pos++;
+            c.iterator = name();
+            expect(FROM);
+            c.left = parseValue(c);
+            if (kindAt(pos) != TO && kindAt(pos) != DOWNTO) throw Unsupported{};
+            c.downto = kindAt(pos++) == DOWNTO;
+            c.right = parseValue(c);
+            expect(DO);
+            if (declaration(c.iterator) || isIterator(c.iterator)) c.clean = false;
+            iterators.push_back(c.iterator);
+            c.body = parseCommands(c);
+            iterators.pop_back();
+            expect(ENDFOR);
+            break;
+        case READ:
+            pos++;
+            c.target = parseIdentifier(c, false);
+            expect(SEMICOLON);
+            assignTo(c, c.target.name);
+            break;
+        case WRITE:
+            pos++;
+            c.left = parseValue(c);
+            expect(SEMICOLON);
+            break;
+        case INLINE_BEGIN: {
+            const InlineSite* site = (*tokens)[pos++].value.inline_site;
+            auto proc = procedures.find(names.intern(site->callee));
+            if (proc == procedures.end() || proc->second.size() != site->args.size()) c.clean = false;
+            for (size_t k = 0; k < site->args.size(); k++) {
+                const char* arg = names.intern(site->args[k]);
+                const Declaration* d = declaration(arg);
+                if (!d && !isIterator(arg)) c.clean = false;
+                else if (c.clean && proc->second[k] != (d && d->is_array)) c.clean = false;
+                c.modified.insert(arg);
+            }
+            for (const InlineLocal& local : site->locals) {
+                const char* local_name = names.intern(local.name);
+                if (declaration(local_name)) c.clean = false;
+                declarations[local_name] = {local.is_array, local.start, local.end, false};
+            }
+            inlineDepth++;
+            c.body = parseCommands(c);
+            inlineDepth--;
+            expect(INLINE_END);
+            break;
+        }
+        case PIDENTIFIER:
+            if (kindAt(pos + 1) == LPAREN) { // wywołanie procedury: może zmienić argumenty
+                c.kind = LPAREN;
+                pos += 2;
+                c.modified.insert(name());
+                while (kindAt(pos) == COMMA) {
+                    pos++;
+                    c.modified.insert(name());
+                }
+                expect(RPAREN);
+                expect(SEMICOLON);
+                break;
+            }
+            c.kind = ASSIGN;
+            c.target = parseIdentifier(c, false);
+            if (isIterator(c.target.name)) c.clean = false;
+            expect(ASSIGN);
+            c.left = parseValue(c);
+            if (kindAt(pos) == PLUS || kindAt(pos) == MINUS || kindAt(pos) == MULT || kindAt(pos) == DIV
+                || kindAt(pos) == MOD) {
+                c.op = kindAt(pos++);
+                c.right = parseValue(c);
+            }
+            expect(SEMICOLON);
+            assignTo(c, c.target.name);
+            break;
+        default:
+            throw Unsupported{};
+        }
+        c.end = pos;
+        return c;
+    }
+
+    /// @brief PROGRAM IS deklaracje IN komendy END
+    std::vector<Command> parseMain() {
+        pos = 0;
+        while (kindAt(pos) && kindAt(pos) != PROGRAM) pos++;
+        expect(PROGRAM);
+        expect(IS);
+        while (kindAt(pos) == PIDENTIFIER) {
+            const char* declared = name();
+            Declaration d{false, 0, 0, true};
+            if (kindAt(pos) == LBRACKET) {
+                if (kindAt(pos + 1) != NUM || kindAt(pos + 2) != COLON || kindAt(pos + 3) != NUM || kindAt(pos + 4) != RBRACKET)
+                    throw Unsupported{};
+                d = {true, (*tokens)[pos + 1].value.num, (*tokens)[pos + 3].value.num, true};
+                if (d.start > d.end) throw Unsupported{};
+                pos += 5;
+            }
+            if (!declarations.emplace(declared, d).second) throw Unsupported{};
+            if (kindAt(pos) != COMMA) break;
+            pos++;
+        }
+        expect(IN);
+        Command root;
+        std::vector<Command> program = parseCommands(root);
+        expect(END);
+        if (pos != (int)tokens->size()) throw Unsupported{};
+        return program;
+    }
+
+    void step() {
+        if (++steps > PARTIAL_EVAL_STEPS) throw Unsupported{};
+    }
+
+    void set(const Cell& cell, unsigned long long value) {
+        auto it = values.find(cell);
+        journal.push_back({cell, it != values.end(), it != values.end() ? it->second : 0});
+        values[cell] = value;
+    }
+
+    void erase(const Cell& cell) {
+        auto it = values.find(cell);
+        if (it == values.end()) return;
+        journal.push_back({cell, true, it->second});
+        values.erase(it);
+    }
+
+    void rollback() {
+        for (auto it = journal.rbegin(); it != journal.rend(); ++it) {
+            if (it->had) values[it->cell] = it->old;
+            else values.erase(it->cell);
+        }
+        journal.clear();
+    }
+
+    /// @brief Zapomina wszystkie komórki podanych zmiennych i tablic
+    void forget(const std::set<const char*>& modified) {
+        for (const char* name : modified)
+            values.erase(values.lower_bound({name, 0}), values.upper_bound({name, ULLONG_MAX}));
+    }
+
+    Cell cell(const Operand& o) {
+        if (!o.indexed) return {o.name, 0};
+        unsigned long long index = o.num;
+        if (o.index) {
+            auto it = values.find({o.index, 0});
+            if (it == values.end()) throw Unsupported{};
+            index = it->second;
+            cost += 5;
+        }
+        const Declaration* d = declaration(o.name);
+        if (!d || !d->is_array || index < d->start || index > d->end) throw Unsupported{};
+        return {o.name, index};
+    }
+
+    unsigned long long load(const Operand& o) {
+        if (!o.name) return o.num;
+        auto it = values.find(cell(o));
+        if (it == values.end()) throw Unsupported{}; // wartość z READ albo niezainicjalizowana
+        if (o.indexed) cost += 50;
+        return it->second;
+    }
+
+    unsigned long long calculate(const Command& c) {
+        unsigned long long a = load(c.left);
+        if (!c.op) return a;
+        unsigned long long b = load(c.right), result = 0;
+        switch (c.op) {
+        case PLUS:
+            if (__builtin_add_overflow(a, b, &result)) throw Unsupported{};
+            cost += 5;
+            break;
+        case MINUS:
+            result = a > b ? a - b : 0;
+            cost += 5;
+            break;
+        case MULT:
+            if (__builtin_mul_overflow(a, b, &result)) throw Unsupported{};
+            cost += 10 * (64 - __builtin_clzll(std::max(std::min(a, b), 1ull)));
+            break;
+        case DIV: case MOD:
+            result = b == 0 ? 0 : c.op == DIV ? a / b : a % b;
+            cost += 10 * (64 - __builtin_clzll(std::max(a, 1ull)));
+            break;
+        }
+        return result;
+    }
+
+    bool test(const Command& c) {
+        unsigned long long a = load(c.left), b = load(c.right);
+        cost += 5;
+        switch (c.op) {
+        case EQ: return a == b;
+        case NEQ: return a != b;
+        case GT: return a > b;
+        case LT: return a < b;
+        case GE: return a >= b;
+        default: return a <= b;
+        }
+    }
+
+    void execute(const std::vector<Command>& commands) {
+        for (const Command& c : commands) execute(c);
+    }
+
+    void execute(const Command& c) {
+        step();
+        switch (c.kind) {
+        case ASSIGN: {
+            unsigned long long value = calculate(c);
+            set(cell(c.target), value);
+            cost += c.target.indexed ? 50 : 5;
+            break;
+        }
+        case WRITE:
+            fragment.writes.push_back({load(c.left), c.line});
+            cost += 100;
+            break;
+        case IF:
+            execute(test(c) ? c.body : c.orelse);
+            break;
+        case WHILE:
+            while (test(c)) {
+                execute(c.body);
+                step();
+            }
+            break;
+        case REPEAT:
+            do {
+                execute(c.body);
+                step();
+            } while (!test(c));
+            break;
+        case FOR: {
+            unsigned long long from = load(c.left), to = load(c.right);
+            Cell iterator{c.iterator, 0};
+            cost += 10;
+            if (c.downto ? from >= to : from <= to) {
+                for (unsigned long long i = from;; c.downto ? i-- : i++) {
+                    set(iterator, i);
+                    execute(c.body);
+                    step();
+                    cost += 2;
+                    if (i == to) break;
+                }
+            }
+            erase(iterator);
+            break;
+        }
+        case INLINE_BEGIN:
+            execute(c.body);
+            break;
+        default: // READ i wywołania procedur
+            throw Unsupported{};
+        }
+    }
+
+    Token token(int kind, int line) const {
+        return Token{kind, {}, line};
+    }
+
+    Token number(unsigned long long value, int line) const {
+        Token t{NUM, {}, line};
+        t.value.num = value;
+        return t;
+    }
+
+    Token identifier(const char* name, int line) {
+        Token t{PIDENTIFIER, {}, line};
+        t.value.id = arena.make<Identifier>(name, (unsigned long long)line, names.id(name));
+        return t;
+    }
+
+    /// @brief Kończy bieżący fragment: zastępuje go stałymi, jeśli to tańsze od wykonania jego komend
+    void closeFragment() {
+        if (fragment.begin >= 0) {
+            unsigned long long emitted = 0;
+            for (const auto& [value, line] : fragment.writes) emitted += 100 + CodeGenerator::constantCost(value);
+            for (const Cell& c : fragment.cells)
+                emitted += (declaration(c.first)->is_array ? 50 : 5) + CodeGenerator::constantCost(values.at(c));
+            if (emitted < fragment.cost) {
+                std::vector<Token> out;
+                for (const auto& [value, line] : fragment.writes) {
+                    out.push_back(token(WRITE, line));
+                    out.push_back(number(value, line));
+                    out.push_back(token(SEMICOLON, line));
+                }
+                for (const Cell& c : fragment.cells) {
+                    int line = fragment.lines.at(c);
+                    out.push_back(identifier(c.first, line));
+                    if (declaration(c.first)->is_array) {
+                        out.push_back(token(LBRACKET, line));
+                        out.push_back(number(c.second, line));
+                        out.push_back(token(RBRACKET, line));
+                    }
+                    out.push_back(token(ASSIGN, line));
+                    out.push_back(number(values.at(c), line));
+                    out.push_back(token(SEMICOLON, line));
+                }
+                replacements.push_back({fragment.begin, fragment.end, std::move(out)});
+            }
+        }
+        fragment = Fragment();
+    }
+
+public:
+    PartialEvaluator(Arena& arena, StringPool& names) : arena(arena), names(names) {}
+
+    /// @brief Wykonuje main w czasie kompilacji na ile się da i zastępuje obliczone fragmenty stałymi
+    /// @param program tokeny całego programu (po wstawieniu procedur)
+    void run(std::vector<Token>& program) {
+        tokens = &program;
+        std::vector<Command> commands;
+        try {
+            scanProcedures();
+            commands = parseMain();
+        } catch (const Unsupported&) {
+            return; // błąd składni - zgłosi go parser
+        }
+
+        for (const Command& c : commands) {
+            journal.clear();
+            cost = 0;
+            size_t writes = fragment.writes.size();
+            unsigned long long stepsBefore = steps;
+            bool known = c.clean;
+            if (known) {
+                try {
+                    execute(c);
+                } catch (const Unsupported&) {
+                    known = false;
+                }
+            }
+            if (!known) { // zostaje w programie, a to, co mogła zmienić, jest nieznane
+                rollback();
+                fragment.writes.resize(writes);
+                closeFragment();
+                forget(c.modified);
+                continue;
+            }
+
+            std::set<const char*> written;
+            size_t newCells = 0;
+            for (const Change& change : journal) {
+                if (!isMain(change.cell.first)) continue;
+                written.insert(change.cell.first);
+                if (!fragment.lines.count(change.cell)) newCells++;
+            }
+            // każda zmienna przypisana w tekście musi dostać przypisanie, żeby parser widział ją jako zainicjalizowaną
+            if (!std::includes(written.begin(), written.end(), c.assigned.begin(), c.assigned.end())
+                || fragment.cells.size() + newCells > PARTIAL_EVAL_MAX_CELLS) {
+                // komenda zostaje, ale jej wynik jest znany: wykonujemy ją jeszcze raz po zamknięciu fragmentu
+                rollback();
+                fragment.writes.resize(writes);
+                closeFragment();
+                steps = stepsBefore;
+                execute(c);
+                fragment.writes.clear();
+                continue;
+            }
+
+            if (fragment.begin < 0) fragment.begin = c.begin;
+            fragment.end = c.end;
+            fragment.cost += cost;
+            for (const Change& change : journal) {
+                if (!isMain(change.cell.first)) continue;
+                if (!fragment.lines.count(change.cell)) fragment.cells.push_back(change.cell);
+                fragment.lines[change.cell] = c.line;
+            }
+        }
+        closeFragment();
+
+        if (replacements.empty()) return;
+        std::vector<Token> out;
+        out.reserve(program.size());
+        size_t next = 0;
+        for (int i = 0; i < (int)program.size(); i++) {
+            if (next < replacements.size() && replacements[next].begin == i) {
+                out.insert(out.end(), replacements[next].tokens.begin(), replacements[next].tokens.end());
+                i = replacements[next++].end - 1;
+            } else out.push_back(program[i]);
+        }
+        program = std::move(out);
+    }
+};
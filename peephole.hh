@@ -0,0 +1,218 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+
+#include "instruction.hh"
+
+/// @brief Reguła optymalizacji przez szparkę (nazwa używana w opcji --peephole=)
+struct PeepholeRule {
+    const char* name;
+    const char* description;
+};
+
+/// @brief Lista wszystkich reguł w kolejności stosowania
+inline const std::vector<PeepholeRule>& peepholeRules() {
+    static const std::vector<PeepholeRule> rules = {
+        {"jump-thread",   "skok do JUMP skacze od razu do jego celu"},
+        {"jump-to-exit",  "JUMP do HALT lub RTRN zastąpiony tą instrukcją"},
+        {"jump-next",     "usuwa skok do następnej instrukcji"},
+        {"branch-invert", "JZERO/JPOS nad JUMP zamienione na odwrotny skok warunkowy"},
+        {"unreachable",   "usuwa instrukcje za JUMP, RTRN i HALT, do których nie prowadzi żaden skok"},
+        {"swp-pair",      "usuwa SWP r; SWP r oraz SWP a"},
+        {"store-load",    "usuwa LOAD x po STORE x"},
+        {"load-store",    "usuwa STORE x po LOAD x"},
+        {"repeat",        "usuwa powtórzone STORE x, LOAD x i RST r"},
+        {"inc-dec",       "usuwa INC r; DEC r"},
+    };
+    return rules;
+}
+
+/// @brief Optymalizacja przez szparkę na gotowym kodzie (po backpatchAllCheck, skoki mają już numery linii).
+/// Wzorce stosowane są aż do punktu stałego. Instrukcje, do których prowadzi skok, nie są łączone z poprzednimi,
+/// a po usunięciu instrukcji cele skoków są przeliczane.
+class PeepholeOptimizer {
+    std::set<std::string> enabled;                 // włączone reguły
+    std::map<std::string, unsigned long long> applied; // ile razy zastosowano regułę
+    unsigned long long removedInstructions = 0;
+    unsigned long long savedCost = 0;               // suma kosztów usuniętych i zmienionych instrukcji (statycznie)
+
+    /// @brief Zaznacza instrukcje, do których można doskoczyć: cele skoków, powroty z CALL i początek programu
+    static std::vector<bool> jumpTargets(const std::vector<Instr>& code) {
+        std::vector<bool> target(code.size() + 1, false);
+        target[0] = true;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (isJump(code[i].op) && code[i].arg < target.size()) target[code[i].arg] = true;
+            if (code[i].op == Op::CALL) target[i + 1] = true; // RTRN wraca za CALL
+        }
+        return target;
+    }
+
+    bool on(const char* rule) const {
+        return enabled.count(rule) > 0;
+    }
+
+    void count(const char* rule) {
+        applied[rule]++;
+    }
+
+    /// @brief Jedno przejście wszystkich reguł
+    /// @return czy kod się zmienił
+    bool pass(std::vector<Instr>& code) {
+        std::vector<bool> target = jumpTargets(code);
+        std::vector<bool> removed(code.size(), false);
+        bool changed = false;
+        auto remove = [&](size_t i, const char* rule) {
+            removed[i] = true;
+            savedCost += instrCost(code[i].op);
+            count(rule);
+            changed = true;
+        };
+
+        // poprawki skoków bez usuwania instrukcji
+        for (size_t i = 0; i < code.size(); i++) {
+            Instr& in = code[i];
+            if (in.op != Op::JUMP && in.op != Op::JZERO && in.op != Op::JPOS) continue;
+            if (in.arg >= code.size()) continue;
+            const Instr& dest = code[in.arg];
+            if (on("jump-thread") && dest.op == Op::JUMP && dest.arg != in.arg) {
+                in.arg = dest.arg;
+                count("jump-thread");
+                changed = true;
+            } else if (on("jump-to-exit") && in.op == Op::JUMP && (dest.op == Op::HALT || dest.op == Op::RTRN)) {
+                savedCost += instrCost(in.op) - instrCost(dest.op);
+                Instr exit = dest;
+                exit.line = in.line;
+                exit.comment = in.comment;
+                in = exit;
+                count("jump-to-exit");
+                changed = true;
+            }
+        }
+
+        bool reachable = true;
+        size_t prev = code.size(); // ostatnia niezmieniona instrukcja przed i
+        for (size_t i = 0; i < code.size(); i++) {
+            Instr& in = code[i];
+            if (target[i]) {
+                reachable = true;
+                prev = code.size(); // nie łączymy instrukcji przez miejsce, do którego prowadzi skok
+            }
+            if (!reachable && on("unreachable")) {
+                remove(i, "unreachable");
+                continue;
+            }
+            if ((in.op == Op::JUMP || in.op == Op::JZERO || in.op == Op::JPOS) && in.arg == i + 1 && on("jump-next")) {
+                remove(i, "jump-next");
+                continue;
+            }
+            if ((in.op == Op::JZERO || in.op == Op::JPOS) && in.arg == i + 2 && i + 1 < code.size()
+                && code[i + 1].op == Op::JUMP && !target[i + 1] && on("branch-invert")) {
+                // JZERO L; JUMP M; L: -> JPOS M; L:
+                in.op = in.op == Op::JZERO ? Op::JPOS : Op::JZERO;
+                in.arg = code[i + 1].arg;
+                remove(i + 1, "branch-invert");
+                prev = i;
+                i++;
+                continue;
+            }
+            if (in.op == Op::SWP && in.reg == 'a' && on("swp-pair")) {
+                remove(i, "swp-pair");
+                continue;
+            }
+            if (prev < code.size()) {
+                Instr& p = code[prev];
+                bool sameReg = p.reg == in.reg;
+                bool sameAddr = p.arg == in.arg;
+                if (on("swp-pair") && p.op == Op::SWP && in.op == Op::SWP && sameReg) {
+                    remove(prev, "swp-pair");
+                    remove(i, "swp-pair");
+                    prev = code.size();
+                    continue;
+                }
+                if (on("inc-dec") && p.op == Op::INC && in.op == Op::DEC && sameReg) {
+                    remove(prev, "inc-dec");
+                    remove(i, "inc-dec");
+                    prev = code.size();
+                    continue;
+                }
+                if (on("store-load") && p.op == Op::STORE && in.op == Op::LOAD && sameAddr) {
+                    remove(i, "store-load");
+                    continue;
+                }
+                if (on("load-store") && p.op == Op::LOAD && in.op == Op::STORE && sameAddr) {
+                    remove(i, "load-store");
+                    continue;
+                }
+                if (on("repeat") && p.op == in.op && ((sameAddr && (in.op == Op::STORE || in.op == Op::LOAD))
+                                                   || (sameReg && in.op == Op::RST))) {
+                    remove(i, "repeat");
+                    continue;
+                }
+            }
+            if (in.op == Op::JUMP || in.op == Op::RTRN || in.op == Op::HALT) reachable = false;
+            prev = i;
+        }
+
+        if (changed) compact(code, removed);
+        return changed;
+    }
+
+    /// @brief Usuwa zaznaczone instrukcje i przelicza cele skoków na nowe numery linii
+    void compact(std::vector<Instr>& code, const std::vector<bool>& removed) {
+        // newIndex[i] = nowy numer pierwszej zachowanej instrukcji od i
+        std::vector<unsigned long long> newIndex(code.size() + 1);
+        unsigned long long kept = 0;
+        for (size_t i = 0; i < code.size(); i++) {
+            newIndex[i] = kept;
+            if (!removed[i]) kept++;
+        }
+        newIndex[code.size()] = kept;
+
+        std::vector<Instr> result;
+        result.reserve(kept);
+        for (size_t i = 0; i < code.size(); i++) {
+            if (removed[i]) continue;
+            Instr in = code[i];
+            if (isJump(in.op) && in.arg <= code.size()) in.arg = newIndex[in.arg];
+            result.push_back(in);
+        }
+        removedInstructions += code.size() - result.size();
+        code.swap(result);
+    }
+
+public:
+    /// @brief Optymalizator z włączonymi wszystkimi regułami
+    PeepholeOptimizer() {
+        for (const PeepholeRule& rule : peepholeRules()) enabled.insert(rule.name);
+    }
+
+    /// @brief Włącza tylko reguły o podanych nazwach
+    /// @throws std::invalid_argument dla nieznanej reguły
+    void setRules(const std::vector<std::string>& names) {
+        enabled.clear();
+        for (const std::string& name : names) {
+            bool known = false;
+            for (const PeepholeRule& rule : peepholeRules()) known = known || name == rule.name;
+            if (!known) throw std::invalid_argument("Unknown peephole rule: " + name);
+            enabled.insert(name);
+        }
+    }
+
+    /// @brief Stosuje reguły do kodu aż do punktu stałego
+    void run(std::vector<Instr>& code) {
+        for (int iteration = 0; iteration < 1000 && pass(code); iteration++) {}
+    }
+
+    /// @brief Wypisuje, ile instrukcji i kosztu (statycznie, bez uwzględnienia pętli) zaoszczędzono
+    void report(std::ostream& out) const {
+        out << "peephole: removed " << removedInstructions << " instructions, saved " << savedCost << " cost units\n";
+        for (const PeepholeRule& rule : peepholeRules()) {
+            auto it = applied.find(rule.name);
+            if (it != applied.end()) out << "  " << rule.name << ": " << it->second << "\n";
+        }
+    }
+};
@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tokenStream.hh"
+
+// Progi klonowania procedur
+const int CLONE_MAX_PER_PROCEDURE = 4; // najwięcej klonów jednej procedury (pozostałe wywołania idą do wersji ogólnej)
+const int CLONE_GROWTH_TOKENS = 4000;  // dopuszczalny przyrost kodu: suma tokenów ciał wszystkich klonów
+
+/// @brief Argument związany na stałe z parametrem klonu: zmienna albo tablica z deklaracji zakresu scope
+struct ParamBinding {
+    std::string scope;                  // procedura (albo klon), w której ramce leży argument ("" - main)
+    std::string var;                    // nazwa argumentu w tym zakresie
+    bool is_array = false;
+    unsigned long long start = 0, end = 0; // zakres indeksów tablicy
+    unsigned long long address = 0;     // adres z planu rozmieszczenia pamięci (uzupełnia SymbolTable::setBindings)
+};
+
+/// klon -> parametr -> argument, z którym parametr jest związany
+using CloneBindings = std::map<std::string, std::map<std::string, ParamBinding>>;
+
+/// @brief Specjalizacja procedur na poziomie tokenów, po wstawieniu procedur i obliczaniu częściowym, przed analizą
+/// rejestrów i rozmieszczeniem pamięci. Wywołanie, które przekazuje tablice albo zmienne zadeklarowane w wołającym
+/// (a nie jego parametry), dostaje klon procedury, w którym te parametry mają stałe adresy argumentów: tablica jest
+/// zwykłą tablicą (bez LOAD adresu bazowego i indeksu startowego przy każdym dostępie), a zmienna zwykłą komórką
+/// (bez RLOAD przez wskaźnik), a wywołanie nie zapisuje ich adresów. Wywołania z tymi samymi argumentami dzielą klon;
+/// pozostałe (np. z parametrem wołającego) idą dalej do wersji ogólnej. Klony są w ciałach klonów znów specjalizowane,
+/// więc adres tablicy maina przechodzi w dół całego łańcucha wywołań. Klon ma te same parametry co oryginał (parser
+/// sprawdza wywołania jak wcześniej) i nazwę z cyfrą (nie koliduje z nazwami z programu). Stoi zaraz za oryginałem,
+/// więc przed każdym zakresem, który go woła. Oryginał zostaje - parser zgłasza w nim błędy jak wcześniej,
+/// a nieużywany usuwa usuwanie martwego kodu. Adres argumentu jest poprawny, bo ramki procedur nakładają się tylko,
+/// gdy nie mogą być aktywne jednocześnie, a wołający jest aktywny przez całe wykonanie klonu
+class ProcedureCloner {
+    struct Param {
+        std::string name;
+        char type;  // 'T', 'I', 'O' albo 'N'
+    };
+
+    /// @brief Procedura albo main w tokenach programu
+    struct Definition {
+        std::string name;
+        int begin = 0, name_pos = -1, in = 0, end = 0; // PROCEDURE (PROGRAM), nazwa, IN, END
+        std::vector<Param> params;
+        std::map<std::string, ParamBinding> locals;   // zmienne i tablice z deklaracji (bez zakresu)
+        std::map<std::string, std::pair<unsigned long long, unsigned long long>> constIndices; // t -> min, max stałych indeksów t[NUM]
+        int clones = 0;
+    };
+
+    /// @brief Oryginał albo klon procedury
+    struct Instance {
+        int def;                                  // numer definicji
+        std::string name;
+        std::map<std::string, ParamBinding> bound; // parametry związane z argumentami
+        std::map<int, std::string> calls;         // pozycja nazwy w wywołaniu -> nazwa wywoływanego klonu
+    };
+
+    Arena& arena;
+    StringPool& names;
+    const std::vector<Token>* source = nullptr;  // tokeny programu przed klonowaniem
+    std::vector<Definition> defs;
+    std::deque<Instance> instances;               // oryginały, potem klony w kolejności tworzenia
+    std::map<std::string, int> cloneOf;           // wywoływana procedura z argumentami -> numer klonu
+    std::vector<bool> reached;                    // zakresy wykonywane z maina (tylko w nich tworzymy klony)
+    std::vector<int> pending;                     // zakresy do przejrzenia
+    int growth = 0;
+
+    /// @brief Dzieli program na procedury i main
+    /// @return false, gdy program nie ma oczekiwanej postaci (błąd zgłosi parser)
+    bool readDefinitions(const std::vector<Token>& tokens) {
+        int n = (int)tokens.size();
+        for (int i = 0; i < n; i++) {
+            Definition def;
+            def.begin = i;
+            if (tokens[i].kind == PROCEDURE) {
+                if (i + 1 >= n || tokens[i + 1].kind != PIDENTIFIER) return false;
+                def.name_pos = i + 1;
+                def.name = tokens[i + 1].value.id->pid;
+                char type = 'N';
+                for (i += 2; i < n && tokens[i].kind != IS; i++) {
+                    switch (tokens[i].kind) {
+                    case T: type = 'T'; break;
+                    case I_CONST: type = 'I'; break;
+                    case O_VAR: type = 'O'; break;
+                    case PIDENTIFIER:
+                        def.params.push_back({tokens[i].value.id->pid, type});
+                        type = 'N';
+                        break;
+                    default: break;
+                    }
+                }
+            } else if (tokens[i].kind != PROGRAM) return false;
+            for (; i < n && tokens[i].kind != IN; i++) { // IS x , t [ a : b ] , ...
+                if (tokens[i].kind != PIDENTIFIER) continue;
+                ParamBinding local;
+                local.var = tokens[i].value.id->pid;
+                if (i + 5 < n && tokens[i + 1].kind == LBRACKET && tokens[i + 2].kind == NUM && tokens[i + 4].kind == NUM) {
+                    local.is_array = true;
+                    local.start = tokens[i + 2].value.num;
+                    local.end = tokens[i + 4].value.num;
+                    i += 5;
+                }
+                def.locals[local.var] = local;
+            }
+            def.in = i;
+            for (; i < n && tokens[i].kind != END; i++) {
+                if (tokens[i].kind == PIDENTIFIER && i + 3 < n && tokens[i + 1].kind == LBRACKET
+                    && tokens[i + 2].kind == NUM && tokens[i + 3].kind == RBRACKET) {
+                    unsigned long long index = tokens[i + 2].value.num;
+                    auto [range, fresh] = def.constIndices.try_emplace(tokens[i].value.id->pid, index, index);
+                    if (!fresh) {
+                        range->second.first = std::min(range->second.first, index);
+                        range->second.second = std::max(range->second.second, index);
+                    }
+                }
+            }
+            if (i >= n) return false;
+            def.end = i;
+            defs.push_back(def);
+        }
+        return !defs.empty();
+    }
+
+    /// @brief Wyznacza argument, z którym można na stałe związać parametr param procedury callee
+    /// @param arg nazwa argumentu w zakresie caller
+    /// @return false, gdy argument nie jest zmienną z deklaracji ani parametrem związanym w caller
+    bool bindable(const Instance& caller, const Definition& callee, const Param& param, const std::string& arg,
+                  ParamBinding& binding) const {
+        if (auto b = caller.bound.find(arg); b != caller.bound.end()) binding = b->second;
+        else if (auto l = defs[caller.def].locals.find(arg); l != defs[caller.def].locals.end()) {
+            binding = l->second;
+            binding.scope = caller.name;
+        } else return false;
+        if (binding.is_array != (param.type == 'T')) return false; // zły typ - błąd zgłosi parser
+        if (binding.is_array) { // stały indeks poza tablicą: w klonie byłby błędem, którego wersja ogólna nie zgłasza
+            auto range = callee.constIndices.find(param.name);
+            if (range != callee.constIndices.end()
+                && (range->second.first < binding.start || range->second.second > binding.end)) return false;
+        }
+        return true;
+    }
+
+    /// @brief Dopisuje zakres do przejrzenia, jeśli jeszcze go nie było
+    void reach(int k) {
+        if (reached[k]) return;
+        reached[k] = true;
+        pending.push_back(k);
+    }
+
+    /// @brief Wyznacza klony wywoływane z zakresu instances[k], tworząc nowe, gdy mieszczą się w limitach
+    void specialize(int k) {
+        const std::vector<Token>& tokens = *source;
+        const Definition& def = defs[instances[k].def];
+        for (int i = def.in + 1; i < def.end; i++) {
+            if (tokens[i].kind != PIDENTIFIER || tokens[i + 1].kind != LPAREN) continue;
+            int callee = -1;
+            for (int d = 0; d < instances[k].def; d++)
+                if (defs[d].name == tokens[i].value.id->pid && defs[d].name_pos >= 0) callee = d;
+            std::vector<std::string> args;
+            int j = i + 2;
+            for (; j < def.end && tokens[j].kind != RPAREN; j++)
+                if (tokens[j].kind == PIDENTIFIER) args.push_back(tokens[j].value.id->pid);
+            if (callee < 0 || defs[callee].params.size() != args.size()) continue; // błąd zgłosi parser
+
+            // ten sam argument dwa razy: parametry są aliasami, więc zostają wskaźnikami
+            std::map<std::string, ParamBinding> bound;
+            std::string key = defs[callee].name + "(";
+            for (size_t p = 0; p < args.size(); p++) {
+                if (std::count(args.begin(), args.end(), args[p]) > 1) continue;
+                ParamBinding binding;
+                if (!bindable(instances[k], defs[callee], defs[callee].params[p], args[p], binding)) continue;
+                key += std::to_string(p) + ":" + binding.scope + "." + binding.var + ",";
+                bound[defs[callee].params[p].name] = binding;
+            }
+            auto found = cloneOf.find(key);
+            if (found == cloneOf.end() && !bound.empty()) {
+                Definition& target = defs[callee];
+                int size = target.end - target.in;
+                if (target.clones < CLONE_MAX_PER_PROCEDURE && growth + size <= CLONE_GROWTH_TOKENS) {
+                    growth += size;
+                    instances.push_back({callee, target.name + std::to_string(++target.clones), bound, {}});
+                    reached.push_back(false);
+                    found = cloneOf.emplace(key, (int)instances.size() - 1).first;
+                }
+            }
+            if (found == cloneOf.end()) reach(callee); // wersja ogólna
+            else {
+                instances[k].calls[i] = instances[found->second].name;
+                reach(found->second);
+            }
+            i = j;
+        }
+    }
+
+    /// @brief Dopisuje do out tokeny zakresu instance z nazwą klonu i wywołaniami klonów
+    void emit(const Instance& instance, std::vector<Token>& out) {
+        const std::vector<Token>& tokens = *source;
+        const Definition& def = defs[instance.def];
+        std::map<std::string, Identifier*> created; // jeden identyfikator na nową nazwę
+        auto rename = [&](Token t, const std::string& name) {
+            Identifier*& id = created[name];
+            if (!id) id = arena.make<Identifier>(names.intern(name), (unsigned long long)t.line, names.id(name));
+            t.value.id = id;
+            return t;
+        };
+        for (int i = def.begin; i <= def.end; i++) {
+            if (i == def.name_pos && instance.name != def.name) out.push_back(rename(tokens[i], instance.name));
+            else if (auto call = instance.calls.find(i); call != instance.calls.end()) out.push_back(rename(tokens[i], call->second));
+            else out.push_back(tokens[i]);
+        }
+    }
+
+public:
+    ProcedureCloner(Arena& arena, StringPool& names) : arena(arena), names(names) {}
+
+    /// @brief Przepisuje tokeny programu, dodając klony procedur i kierując do nich wywołania
+    /// @return parametry klonów związane z argumentami
+    CloneBindings run(std::vector<Token>& tokens) {
+        defs.clear();
+        instances.clear();
+        cloneOf.clear();
+        growth = 0;
+        source = &tokens;
+        if (!readDefinitions(tokens) || defs.back().name_pos >= 0) return {};
+        for (int d = 0; d < (int)defs.size(); d++) instances.push_back({d, defs[d].name, {}, {}});
+        // od maina w głąb wywołań: procedura, której nikt nie wywołuje (np. wołana już tylko przez klony),
+        // nie dostaje klonów, bo i tak zostanie usunięta
+        reached.assign(defs.size(), false);
+        pending.clear();
+        reach((int)defs.size() - 1);
+        for (size_t next = 0; next < pending.size(); next++) specialize(pending[next]);
+
+        std::vector<std::vector<int>> byDefinition(defs.size()); // oryginał i jego klony
+        for (int k = 0; k < (int)instances.size(); k++) byDefinition[instances[k].def].push_back(k);
+        std::vector<Token> out;
+        out.reserve(tokens.size() + growth);
+        CloneBindings bindings;
+        for (const std::vector<int>& group : byDefinition) {
+            for (int k : group) {
+                emit(instances[k], out);
+                if (k >= (int)defs.size()) bindings[instances[k].name] = instances[k].bound;
+            }
+        }
+        tokens.swap(out);
+        return bindings;
+    }
+};
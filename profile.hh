@@ -0,0 +1,47 @@
+#pragma once
+#include <map>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+/// @brief Profil wykonania z poprzedniego uruchomienia programu (symulator --profile-out, kompilator --profile-use).
+/// Kompilator korzysta tylko z rekordów linii "L linia wykonania koszt": numery linii źródła nie zmieniają się
+/// między kompilacjami z różnymi opcjami, w przeciwieństwie do numerów instrukcji.
+/// Liczba wykonań linii to suma po ciągłych fragmentach jej kodu liczby wykonań najczęściej wykonywanej instrukcji
+/// fragmentu (bez pętli mnożenia i dzielenia), więc kopie rozwiniętej pętli liczą się razem.
+class ExecutionProfile {
+    std::map<int, unsigned long long> lineCounts; // linia źródła -> liczba wykonań
+
+public:
+    /// @brief Wczytuje profil z pliku
+    /// @throws std::invalid_argument gdy pliku nie da się otworzyć albo rekord jest niepoprawny
+    void load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) throw std::invalid_argument("Nie można otworzyć profilu " + path);
+        lineCounts.clear();
+        std::string line;
+        for (int lineNo = 1; std::getline(in, line); lineNo++) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            std::string kind;
+            unsigned long long id, count, cost;
+            if (!(fields >> kind >> id >> count >> cost) || (kind != "I" && kind != "L"))
+                throw std::invalid_argument("Niepoprawny rekord w profilu " + path + ", linia " + std::to_string(lineNo));
+            if (kind == "L") lineCounts[(int)id] = count;
+        }
+    }
+
+    bool empty() const {
+        return lineCounts.empty();
+    }
+
+    /// @brief Liczba wykonań linii źródła
+    /// @return false, gdy linii nie ma w profilu (nie wygenerowano z niej kodu) - wtedy zostają heurystyki statyczne
+    bool count(int line, unsigned long long& executions) const {
+        auto it = lineCounts.find(line);
+        if (it == lineCounts.end()) return false;
+        executions = it->second;
+        return true;
+    }
+};
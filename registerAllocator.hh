@@ -0,0 +1,390 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "tokenStream.hh"
+#include "symbolTable.hh"
+#include "profile.hh"
+
+/// Rejestry, w których mogą być trzymane zmienne. ra, rb, rc, rd i rh są używane przez generowane fragmenty kodu
+const char VARIABLE_REGS[] = "efg";
+
+// Przybliżone koszty maszyny wirtualnej używane przy przydziale rejestrów
+const double REG_ACCESS_SAVING = 45; // LOAD/STORE j (50) zamiast RST a + ADD r albo SWP r (5-6)
+const double SPILL_COST = 56;        // RST a, ADD r, STORE j przed wywołaniem procedury
+const double RELOAD_COST = 55;       // LOAD j, SWP r po wywołaniu procedury
+const double POINTER_SAVING = 20;       // arr[i]: RST a, ADD i, stała przesunięcia w rh, ADD h, SWP h zamiast RLOAD p
+const double POINTER_PARAM_SAVING = 130;// dla parametru T dochodzą LOAD adresu bazowego i indeksu startowego
+const double POINTER_INIT_COST = 30;    // wyliczenie adresu arr[od] przed pętlą
+
+/// @brief Wskaźnik indukcyjny: adres arr[i] dla iteratora i pętli FOR, trzymany w rejestrze
+/// i zwiększany (zmniejszany) razem z iteratorem
+struct ArrayPointer {
+    std::string array;
+    double uses = 0;            // ważona liczba odwołań arr[i]
+    bool unconditional = true;  // wszystkie odwołania są w ciele pętli poza IF i pętlami wewnętrznymi
+    char reg = 0;               // wynik przydziału (0 = adres liczony przy każdym odwołaniu)
+};
+
+/// @brief Odwołania do jednej pętli FOR w zakresie (pętle numerowane w kolejności wystąpienia w kodzie)
+struct LoopUsage {
+    std::string iteratorName;
+    int begin = 0, end = 0;     // zakres tokenów pętli (FOR ... ENDFOR)
+    double iteratorUses = 0;    // ważona liczba odwołań do iteratora (łącznie z obsługą pętli)
+    double limitUses = 0;       // ważona liczba odwołań do limitu
+    char iteratorReg = 0;       // wynik przydziału (0 = pamięć)
+    char limitReg = 0;
+    int depth = 0;              // głębokość zagnieżdżenia ciała pętli w pętlach
+    int nest = 0;               // liczba otwartych instrukcji złożonych (IF, pętle) w ciele pętli
+    std::vector<ArrayPointer> pointers; // tablice indeksowane iteratorem tej pętli
+};
+
+/// @brief Wywołanie procedury w ciele zakresu
+struct CallSite {
+    std::string callee;
+    int pos;                        // pozycja tokenu wywołania
+    double weight;                  // waga wynikająca z zagnieżdżenia w pętlach
+    std::vector<std::string> args;  // nazwy argumentów
+};
+
+/// @brief Wynik analizy jednego zakresu (procedury albo programu głównego)
+struct ScopeUsage {
+    int begin = 0, end = 0;                     // zakres tokenów ciała (IN ... END)
+    std::vector<std::string> scalars;           // lokalne zmienne skalarne w kolejności deklaracji
+    std::map<std::string, double> scalarUses;   // ważona liczba odwołań do zmiennych skalarnych
+    std::map<std::string, char> scalarRegs;     // wynik przydziału dla zmiennych skalarnych
+    std::vector<LoopUsage> loops;
+    std::vector<CallSite> calls;
+};
+
+/// @brief Przydziela rejestry e, f, g najczęściej używanym zmiennym skalarnym, iteratorom i limitom pętli FOR.
+/// Przed parsowaniem przegląda tokeny programu i liczy odwołania ważone głębokością pętli (albo liczbą wykonań linii z profilu),
+/// a na początku ciała każdego zakresu wybiera zmienne, które opłaca się trzymać w rejestrach.
+/// Zmienna w rejestrze trafia do pamięci tylko przy wywołaniu procedury, która może ją odczytać lub nadpisać rejestr.
+class RegisterAllocator {
+    std::map<std::string, ScopeUsage> scopes; // nazwa procedury -> analiza ("" dla programu głównego)
+    const ExecutionProfile* profile = nullptr;
+
+    /// @brief waga odwołania w zależności od głębokości zagnieżdżenia w pętlach
+    static double weight(int depth) {
+        return std::pow(10.0, std::min(std::max(depth, 0), 6));
+    }
+
+    /// @brief waga odwołania w tokenie t: liczba wykonań jego linii z profilu (--profile-use),
+    /// a gdy linii nie ma w profilu - szacunek z głębokości zagnieżdżenia w pętlach
+    double useWeight(const Token& t, int depth) const {
+        unsigned long long count;
+        if (profile && profile->count(t.line, count)) return (double)count;
+        return weight(depth);
+    }
+
+    /// @brief waga wstawionego wywołania zaczynającego się tokenem INLINE_BEGIN tokens[begin]. Kod wstawionej procedury
+    /// ma linie jej ciała, więc linii wywołania zwykle nie ma w profilu - wtedy bierzemy mniejszą z liczb wykonań
+    /// najbliższych linii z kodem przed wywołaniem (before, ujemne gdy nie ma) i za nim
+    double inlinedCallWeight(const std::vector<Token>& tokens, int begin, int depth, double before) const {
+        unsigned long long count;
+        if (!profile || profile->count(tokens[begin].line, count)) return useWeight(tokens[begin], depth);
+        int nested = 0;
+        for (int j = begin; j < (int)tokens.size() && tokens[j].kind != END; j++) {
+            if (tokens[j].kind == INLINE_BEGIN) nested++;
+            else if (tokens[j].kind == INLINE_END) nested--;
+            else if (nested == 0 && profile->count(tokens[j].line, count))
+                return before < 0 ? (double)count : std::min(before, (double)count);
+        }
+        return before < 0 ? weight(depth) : before;
+    }
+
+    static unsigned regBit(char reg) {
+        return 1u << (reg - 'a');
+    }
+
+    struct Candidate {
+        std::string name;
+        int begin, end;     // zakres tokenów, w którym zmienna żyje
+        double benefit;     // zysk z trzymania w rejestrze
+        bool is_hidden;     // limit pętli albo wskaźnik nie są widoczne w kodzie (nie mogą być argumentem)
+        char* result;       // gdzie zapisać przydzielony rejestr
+    };
+
+    /// @brief koszt zapisywania i odtwarzania zmiennej przy wywołaniach procedur, gdy trzymamy ją w rejestrze reg
+    double spillCost(const ScopeUsage& scope, const Candidate& c, char reg, SymbolTable& symbolTable) {
+        double cost = 0;
+        // wywołania są zapisane w kolejności tokenów, więc te w zakresie zmiennej znajdujemy wyszukiwaniem binarnym
+        auto first = std::lower_bound(scope.calls.begin(), scope.calls.end(), c.begin,
+            [](const CallSite& call, int pos) { return call.pos < pos; });
+        for (auto it = first; it != scope.calls.end() && it->pos <= c.end; ++it) {
+            const CallSite& call = *it;
+            bool clobbered = symbolTable.getClobberedRegs(call.callee) & regBit(reg);
+            bool passed = false, modified = false;
+            if (!c.is_hidden && symbolTable.procedureExists(call.callee)) {
+                std::vector<Symbol> params = symbolTable.getParameters(call.callee);
+                for (size_t k = 0; k < call.args.size(); k++) {
+                    if (call.args[k] != c.name) continue;
+                    passed = true;
+                    if (k >= params.size() || !params[k].is_I) modified = true;
+                }
+            }
+            if (passed || clobbered) cost += SPILL_COST * call.weight;
+            if (clobbered || modified) cost += RELOAD_COST * call.weight;
+        }
+        return cost;
+    }
+
+public:
+    /// @brief Przegląda tokeny programu i zlicza odwołania do zmiennych w każdym zakresie
+    /// @param tokens wszystkie tokeny programu
+    /// @param executionProfile liczby wykonań linii z poprzedniego uruchomienia albo nullptr
+    void analyze(const std::vector<Token>& tokens, const ExecutionProfile* executionProfile = nullptr) {
+        scopes.clear();
+        profile = executionProfile && !executionProfile->empty() ? executionProfile : nullptr;
+        enum { OUTSIDE, HEAD, DECLARATIONS, BODY } state = OUTSIDE;
+        ScopeUsage* cur = nullptr;
+        std::vector<int> openLoops; // indeksy otwartych pętli FOR
+        int depth = 0;
+        int pendingFor = -1;        // pętla FOR, której ciało zaczyna się od najbliższego DO
+        int nest = 0;               // liczba otwartych instrukcji złożonych
+        bool inUntil = false;       // warunek REPEAT-UNTIL trwa do średnika
+        // Tokeny wstawionej procedury mają linie jej ciała, a profil sumuje w tych liniach wszystkie wstawione kopie,
+        // więc odwołania w kopii dostają wagę miejsca wywołania (i jego głębokości): para waga, głębokość
+        std::vector<std::pair<double, int>> inlinedCalls;
+        double lastCount = -1;      // liczba wykonań ostatniej linii z kodem w zakresie (poza wstawionymi procedurami)
+        auto useAt = [&](const Token& tok) {
+            if (inlinedCalls.empty()) return useWeight(tok, depth);
+            return inlinedCalls.back().first * weight(depth - inlinedCalls.back().second);
+        };
+        int n = (int)tokens.size();
+
+        for (int i = 0; i < n; i++) {
+            const Token& t = tokens[i];
+            bool nextIsId = i + 1 < n && tokens[i + 1].kind == PIDENTIFIER;
+            switch (state) {
+            case OUTSIDE:
+                if (t.kind == PROCEDURE && nextIsId) {
+                    cur = &scopes[tokens[i + 1].value.id->pid];
+                    *cur = ScopeUsage();
+                    state = HEAD;
+                    i++;
+                } else if (t.kind == PROGRAM) {
+                    cur = &scopes[""];
+                    *cur = ScopeUsage();
+                    state = HEAD;
+                }
+                break;
+            case HEAD:
+                if (t.kind == IS) state = DECLARATIONS;
+                break;
+            case DECLARATIONS:
+                if (t.kind == PIDENTIFIER && !(i + 1 < n && tokens[i + 1].kind == LBRACKET)) {
+                    cur->scalars.push_back(t.value.id->pid);
+                    cur->scalarUses[t.value.id->pid] = 0;
+                } else if (t.kind == IN) {
+                    state = BODY;
+                    cur->begin = i;
+                    openLoops.clear();
+                    depth = 0;
+                    pendingFor = -1;
+                    inUntil = false;
+                    nest = 0;
+                    lastCount = -1;
+                }
+                break;
+            case BODY:
+                if (unsigned long long count; profile && inlinedCalls.empty() && profile->count(t.line, count))
+                    lastCount = (double)count;
+                switch (t.kind) {
+                case END:
+                    cur->end = i;
+                    state = OUTSIDE;
+                    break;
+                case FOR:
+                    if (nextIsId) {
+                        LoopUsage loop;
+                        loop.iteratorName = tokens[i + 1].value.id->pid;
+                        loop.begin = i;
+                        loop.end = n;
+                        cur->loops.push_back(loop);
+                        pendingFor = (int)cur->loops.size() - 1;
+                        i++;
+                    }
+                    break;
+                case DO:
+                    if (pendingFor >= 0) { // WHILE zwiększa głębokość już przy warunku
+                        depth++;
+                        nest++;
+                        LoopUsage& loop = cur->loops[pendingFor];
+                        loop.depth = depth;
+                        loop.nest = nest;
+                        openLoops.push_back(pendingFor);
+                        pendingFor = -1;
+                    }
+                    break;
+                case ENDFOR:
+                    if (!openLoops.empty()) {
+                        // warunek i zwiększenie iteratora są generowane na końcu ciała, w linii ENDFOR
+                        LoopUsage& loop = cur->loops[openLoops.back()];
+                        loop.iteratorUses += 3 * useAt(t); // warunek, zwiększenie i zapis iteratora
+                        loop.limitUses += useAt(t);        // warunek
+                        loop.end = i;
+                        openLoops.pop_back();
+                    }
+                    depth--;
+                    nest--;
+                    break;
+                case WHILE: case REPEAT:
+                    depth++;
+                    nest++;
+                    break;
+                case ENDWHILE:
+                    depth--;
+                    nest--;
+                    break;
+                case IF:
+                    nest++;
+                    break;
+                case ENDIF:
+                    nest--;
+                    break;
+                case UNTIL:
+                    inUntil = true;
+                    nest--;
+                    break;
+                case SEMICOLON:
+                    if (inUntil) {
+                        depth--;
+                        inUntil = false;
+                    }
+                    break;
+                case INLINE_BEGIN: // zmienne lokalne wstawionej procedury należą do obecnego zakresu
+                    inlinedCalls.push_back({inlinedCalls.empty() ? inlinedCallWeight(tokens, i, depth, lastCount) : useAt(t), depth});
+                    for (const InlineLocal& local : t.value.inline_site->locals) {
+                        if (local.is_array) continue;
+                        cur->scalars.push_back(local.name);
+                        cur->scalarUses[local.name] = 0;
+                    }
+                    break;
+                case INLINE_END:
+                    if (!inlinedCalls.empty()) inlinedCalls.pop_back();
+                    break;
+                case PIDENTIFIER: {
+                    std::string name = t.value.id->pid;
+                    if (i + 1 < n && tokens[i + 1].kind == LPAREN) { // wywołanie procedury
+                        CallSite call{name, i, useAt(t), {}};
+                        int j = i + 2;
+                        for (; j < n && tokens[j].kind != RPAREN; j++)
+                            if (tokens[j].kind == PIDENTIFIER) call.args.push_back(tokens[j].value.id->pid);
+                        cur->calls.push_back(call);
+                        i = j;
+                        break;
+                    }
+                    if (i + 3 < n && tokens[i + 1].kind == LBRACKET && tokens[i + 2].kind == PIDENTIFIER
+                        && tokens[i + 3].kind == RBRACKET) { // arr[x], gdzie x może być iteratorem otwartej pętli
+                        std::string index = tokens[i + 2].value.id->pid;
+                        for (int k = (int)openLoops.size() - 1; k >= 0; k--) {
+                            LoopUsage& loop = cur->loops[openLoops[k]];
+                            if (loop.iteratorName != index) continue;
+                            auto p = std::find_if(loop.pointers.begin(), loop.pointers.end(),
+                                [&](const ArrayPointer& ptr) { return ptr.array == name; });
+                            if (p == loop.pointers.end()) p = loop.pointers.insert(p, ArrayPointer{name});
+                            p->uses += useAt(t);
+                            p->unconditional = p->unconditional && nest == loop.nest;
+                            break;
+                        }
+                        break;
+                    }
+                    bool isIterator = false;
+                    for (int k = (int)openLoops.size() - 1; k >= 0; k--) {
+                        if (cur->loops[openLoops[k]].iteratorName == name) {
+                            cur->loops[openLoops[k]].iteratorUses += useAt(t);
+                            isIterator = true;
+                            break;
+                        }
+                    }
+                    if (!isIterator) {
+                        if (auto it = cur->scalarUses.find(name); it != cur->scalarUses.end())
+                            it->second += useAt(t);
+                    }
+                    break;
+                }
+                default:
+                    break;
+                }
+                break;
+            }
+        }
+    }
+
+    /// @brief Przydziela rejestry zmiennym zakresu procName. Wołane na początku ciała zakresu,
+    /// gdy znane są już maski rejestrów nadpisywanych przez wcześniej zdefiniowane procedury.
+    /// @param procName nazwa procedury ("" dla programu głównego)
+    /// @param symbolTable tablica symboli (parametry i maski wywoływanych procedur)
+    /// @return maska rejestrów nadpisywanych przez zakres razem z wywoływanymi procedurami
+    unsigned allocate(const std::string& procName, SymbolTable& symbolTable) {
+        auto found = scopes.find(procName);
+        if (found == scopes.end()) return 0;
+        ScopeUsage& scope = found->second;
+
+        std::vector<Candidate> candidates;
+        for (const std::string& name : scope.scalars) {
+            candidates.push_back({name, scope.begin, scope.end, REG_ACCESS_SAVING * scope.scalarUses[name], false, &scope.scalarRegs[name]});
+        }
+        for (LoopUsage& loop : scope.loops) {
+            candidates.push_back({loop.iteratorName, loop.begin, loop.end, REG_ACCESS_SAVING * loop.iteratorUses, false, &loop.iteratorReg});
+            candidates.push_back({"", loop.begin, loop.end, REG_ACCESS_SAVING * loop.limitUses, true, &loop.limitReg});
+            for (ArrayPointer& p : loop.pointers) {
+                Symbol *arr = symbolTable.getSymbol(p.array);
+                if (!arr || !arr->is_array) continue; // np. tablica wstawionej procedury, deklarowana później
+                // Wskaźnik startuje od adresu arr[od]. Gdy od < start, odejmowanie w maszynie obcina adres do zera
+                // (a parametr T do adresu bazowego), więc wskaźnik jest poprawny tylko, gdy adres nie może być obcięty
+                // albo każdy obrót pętli odwołuje się do arr[i] - wtedy od < start jest i tak odwołaniem poza tablicę.
+                bool param = arr->is_param && arr->is_T;
+                if ((param || arr->memory_address < arr->array_start) && !p.unconditional) continue;
+                double benefit = (param ? POINTER_PARAM_SAVING : POINTER_SAVING) * p.uses
+                               - weight(loop.depth) - POINTER_INIT_COST * weight(loop.depth - 1);
+                candidates.push_back({"", loop.begin, loop.end, benefit, true, &p.reg});
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [](const Candidate& x, const Candidate& y) { return x.benefit > y.benefit; });
+
+        const int regCount = sizeof(VARIABLE_REGS) - 1;
+        std::vector<std::map<int,int>> busy(regCount); // rozłączne zajęte zakresy każdego rejestru: początek -> koniec
+        unsigned mask = 0;
+        for (Candidate& c : candidates) {
+            int best = -1;
+            double bestCost = 0;
+            for (int r = 0; r < regCount; r++) {
+                // zakresy są rozłączne, więc wystarczy sprawdzić ostatni zaczynający się nie później niż c.end
+                auto next = busy[r].upper_bound(c.end);
+                if (next != busy[r].begin() && std::prev(next)->second >= c.begin) continue;
+                double cost = spillCost(scope, c, VARIABLE_REGS[r], symbolTable);
+                if (best == -1 || cost < bestCost) {
+                    best = r;
+                    bestCost = cost;
+                }
+            }
+            if (best == -1 || c.benefit <= bestCost) continue;
+            *c.result = VARIABLE_REGS[best];
+            busy[best][c.begin] = c.end;
+            mask |= regBit(VARIABLE_REGS[best]);
+        }
+
+        for (const CallSite& call : scope.calls)
+            mask |= symbolTable.getClobberedRegs(call.callee);
+        return mask;
+    }
+
+    /// @brief Zwraca rejestry przydzielone zmiennym skalarnym zakresu
+    const std::map<std::string, char>& scalarRegisters(const std::string& procName) {
+        return scopes[procName].scalarRegs;
+    }
+
+    /// @brief Zwraca wynik analizy k-tej pętli FOR w zakresie albo nullptr
+    const LoopUsage* loop(const std::string& procName, int k) {
+        auto found = scopes.find(procName);
+        if (found == scopes.end() || k >= (int)found->second.loops.size()) return nullptr;
+        return &found->second.loops[k];
+    }
+};
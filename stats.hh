@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "instruction.hh"
+
+/// @brief Statystyki jednej kompilacji (--stats): czas faz oraz liczba i koszt statyczny instrukcji
+/// wynikowego programu według rozkazu i części generatora kodu, która je wyemitowała
+class CompilerStats {
+    std::vector<std::pair<const char*, double>> phases; // nazwa fazy, czas w ms
+
+    /// @brief nazwa dopełniona spacjami do width znaków (printf liczy bajty, a nazwy faz mają polskie litery)
+    static std::string pad(const char* name, size_t width) {
+        std::string text = name;
+        size_t chars = 0;
+        for (unsigned char c : text) chars += (c & 0xC0) != 0x80;
+        if (chars < width) text.append(width - chars, ' ');
+        return text;
+    }
+
+    static void row(std::ostream& out, const char* name, unsigned long long count, unsigned long long cost, size_t total) {
+        char text[64];
+        snprintf(text, sizeof text, " %8llu %6.2f%% %12llu\n", count, total ? 100.0 * count / total : 0.0, cost);
+        out << "  " << pad(name, 20) << text;
+    }
+
+public:
+    /// @brief Wykonuje fazę kompilacji i zapisuje jej czas
+    /// @param name nazwa fazy w raporcie
+    template <typename F>
+    void phase(const char* name, F&& run) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+        phases.emplace_back(name, time.count());
+    }
+
+    /// @brief Wypisuje raport. Koszt statyczny to suma kosztów instrukcji, każdej liczonej raz
+    /// (koszt wykonania z liczbą wykonań daje symulator --profile z mapą --line-map)
+    void report(std::ostream& out, const std::vector<Instr>& program) const {
+        char text[96];
+        double total = 0;
+        out << "Czas faz kompilacji [ms]:\n";
+        for (const auto& [name, ms] : phases) {
+            snprintf(text, sizeof text, " %10.3f\n", ms);
+            out << "  " << pad(name, 28) << text;
+            total += ms;
+        }
+        snprintf(text, sizeof text, " %10.3f\n", total);
+        out << "  " << pad("razem", 28) << text;
+
+        unsigned long long opCount[(int)Op::HALT + 1] = {}, opCost[(int)Op::HALT + 1] = {};
+        unsigned long long originCount[(int)Origin::ADDRESS + 1] = {}, originCost[(int)Origin::ADDRESS + 1] = {};
+        for (const Instr& instr : program) {
+            opCount[(int)instr.op]++;
+            opCost[(int)instr.op] += instrCost(instr.op);
+            originCount[(int)instr.origin]++;
+            originCost[(int)instr.origin] += instrCost(instr.op);
+        }
+        out << "Instrukcje według rozkazu (liczba, udział, koszt statyczny):\n";
+        for (int op = 0; op <= (int)Op::HALT; op++)
+            if (opCount[op]) row(out, opName((Op)op), opCount[op], opCost[op], program.size());
+        out << "Instrukcje według części generatora kodu:\n";
+        for (int origin = 0; origin <= (int)Origin::ADDRESS; origin++)
+            row(out, originName((Origin)origin), originCount[origin], originCost[origin], program.size());
+        out << "  razem " << program.size() << " instrukcji\n";
+    }
+};
@@ -0,0 +1,369 @@
+// Superoptymalizator sekwencji pomocniczych generatora kodu (make helpers).
+// Dla każdej specyfikacji przeszukuje ciągi instrukcji rejestrowych maszyny w kolejności rosnącego kosztu
+// (algorytm Dijkstry po stanach rejestrów na zestawie wejść testowych, stany równe na tych wejściach łączymy),
+// a znaleziony ciąg sprawdza na dużej liczbie losowych i brzegowych wejść. Kontrprzykład trafia do wejść testowych
+// i wyszukiwanie zaczyna się od nowa. Wynik - najtańsze sekwencje - jest wypisywany jako nagłówek helperSequences.hh
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "instruction.hh"
+
+using namespace std;
+
+using Regs = array<unsigned long long, 8>; // ra..rh
+
+const size_t MAX_STATES = 1000000;   // limit stanów jednego wyszukiwania (większe - wynik nie jest dowodem optymalności)
+const int SEARCH_INPUTS = 6;         // początkowa liczba wejść testowych wyszukiwania
+const int VERIFY_INPUTS = 200000;    // wejścia losowe do sprawdzenia znalezionego ciągu
+const unsigned long long LIMIT = 1ull << 62; // wartości większe traktujemy jak przepełnienie (wejścia są dużo mniejsze)
+
+struct Step {
+    Op op;
+    char reg;
+};
+
+/// @brief Specyfikacja sekwencji: warunek wstępny (losowanie wejścia), warunek końcowy i rejestry, których może używać
+struct Spec {
+    const char* name;
+    const char* description;
+    string regs;                                 // rejestry, które ciąg może czytać i zmieniać (pozostałe są żywe)
+    function<Regs(mt19937_64&)> input;           // losowy stan spełniający warunek wstępny
+    function<bool(const Regs&, const Regs&)> check; // stan końcowy spełnia specyfikację
+    vector<Step> reference;                      // ręcznie napisana sekwencja (górna granica kosztu)
+};
+
+int reg(char r) {
+    return r - 'a';
+}
+
+/// @brief Wykonuje instrukcję jak maszyna wirtualna
+/// @return false przy przepełnieniu
+bool execute(Regs& s, Step step) {
+    unsigned long long& a = s[0];
+    unsigned long long& r = s[reg(step.reg)];
+    switch (step.op) {
+    case Op::ADD: a += r; break;
+    case Op::SUB: a = a > r ? a - r : 0; break;
+    case Op::SWP: swap(a, r); break;
+    case Op::RST: r = 0; break;
+    case Op::INC: r++; break;
+    case Op::DEC: if (r > 0) r--; break;
+    case Op::SHL: r <<= 1; break;
+    case Op::SHR: r >>= 1; break;
+    default: return false;
+    }
+    return a < LIMIT && r < LIMIT;
+}
+
+unsigned long long cost(const vector<Step>& steps) {
+    unsigned long long total = 0;
+    for (const Step& s : steps) total += instrCost(s.op);
+    return total;
+}
+
+/// @brief Losowa wartość: często brzegowa (0, 1, potęgi dwójki i sąsiednie), poza tym do 2^40
+unsigned long long value(mt19937_64& rng) {
+    switch (rng() % 4) {
+    case 0: return rng() % 9;
+    case 1: {
+        unsigned long long p = 1ull << (rng() % 40);
+        return p + (rng() % 3) - 1;
+    }
+    default: return rng() % (1ull << 40);
+    }
+}
+
+unsigned long long positive(mt19937_64& rng) {
+    unsigned long long v = value(rng);
+    return v ? v : 1;
+}
+
+Regs randomRegs(mt19937_64& rng) {
+    Regs s;
+    for (auto& v : s) v = value(rng);
+    return s;
+}
+
+/// @brief Czy rejestry regs mają w out te same wartości co w in
+bool same(const Regs& in, const Regs& out, const string& regs) {
+    for (char r : regs)
+        if (in[reg(r)] != out[reg(r)]) return false;
+    return true;
+}
+
+vector<Spec> specs() {
+    return {
+        // pętla mnożenia ra = rb * rc: na początku obrotu ra = suma częściowa, rb = mnożnik (> 0), rc = mnożna
+        {"MULT_BIT_TEST", "ra = 0 gdy rb parzyste; suma częściowa z ra do rd; rc i rb >> 1 bez zmian", "abcd",
+         [](mt19937_64& rng) { Regs s = randomRegs(rng); s[1] = positive(rng); return s; },
+         [](const Regs& in, const Regs& out) {
+             return out[3] == in[0] && out[2] == in[2] && out[1] >> 1 == in[1] >> 1 && (out[0] == 0) == (in[1] % 2 == 0);
+         },
+         {{Op::SWP, 'd'}, {Op::RST, 'a'}, {Op::ADD, 'b'}, {Op::SHR, 'a'}, {Op::SHL, 'a'}, {Op::SWP, 'b'}, {Op::SUB, 'b'}}},
+        {"MULT_ADD", "rd = rd + rc; ra, rc i rb >> 1 bez zmian", "abcd",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) {
+             return out[3] == in[3] + in[2] && out[0] == in[0] && out[2] == in[2] && out[1] >> 1 == in[1] >> 1;
+         },
+         {{Op::SWP, 'd'}, {Op::ADD, 'c'}, {Op::SWP, 'd'}}},
+        {"MULT_SHIFT", "rc = 2 * rc, ra = rb >> 1 (warunek końca pętli), rb = suma częściowa z rd", "abcd",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) {
+             return out[2] == 2 * in[2] && out[0] == in[1] >> 1 && out[1] == in[3];
+         },
+         {{Op::SWP, 'd'}, {Op::SHL, 'c'}, {Op::SHR, 'b'}, {Op::SWP, 'b'}}},
+        {"MULT_NEXT", "zamiana ra i rb przed kolejnym obrotem (ra = suma częściowa, rb = mnożnik)", "abc",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) { return out[0] == in[1] && out[1] == in[0] && out[2] == in[2]; },
+         {{Op::SWP, 'b'}}},
+        {"MULT_END", "wynik mnożenia z rb do ra, gdy ra = 0", "ab",
+         [](mt19937_64& rng) { Regs s = randomRegs(rng); s[0] = 0; return s; },
+         [](const Regs& in, const Regs& out) { return out[0] == in[1]; },
+         {{Op::SWP, 'b'}}},
+        // pętla mnożenia po dwóch bitach (ArithmeticKernel::ADAPTIVE): rb = mnożnik, rd = suma częściowa
+        {"MULT_DIGIT", "ra = rb % 4, rb >> 2 bez zmian, gdy ra = rb; rc, rd bez zmian", "abh",
+         [](mt19937_64& rng) { Regs s = randomRegs(rng); s[0] = s[1]; return s; },
+         [](const Regs& in, const Regs& out) { return out[0] == in[1] % 4 && out[1] >> 2 == in[1] >> 2; },
+         {{Op::SHR, 'a'}, {Op::SHR, 'a'}, {Op::SHL, 'a'}, {Op::SHL, 'a'}, {Op::SWP, 'b'}, {Op::SUB, 'b'}}},
+        // dzielenie rb przez rc: rd = bit ilorazu, rh = iloraz
+        {"DIV_ZERO_CHECK", "ra = 0 gdy rc = 0; rb i rc bez zmian", "abc",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) { return (out[0] == 0) == (in[2] == 0) && same(in, out, "bc"); },
+         {{Op::RST, 'a'}, {Op::ADD, 'c'}}},
+        {"DIV_INIT", "rd = 1, rh = 0; rb i rc bez zmian", "dh",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) { return out[3] == 1 && out[7] == 0 && same(in, out, "bc"); },
+         {{Op::RST, 'd'}, {Op::INC, 'd'}, {Op::RST, 'h'}}},
+        {"DIV_SCALE_TEST", "ra > 0 gdy 2 * rc > rb; rb, rc, rd, rh bez zmian", "abc",
+         [](mt19937_64& rng) { Regs s = randomRegs(rng); s[2] = positive(rng); return s; },
+         [](const Regs& in, const Regs& out) { return (out[0] > 0) == (2 * in[2] > in[1]) && same(in, out, "bcdh"); },
+         {{Op::RST, 'a'}, {Op::ADD, 'c'}, {Op::SHL, 'a'}, {Op::SUB, 'b'}}},
+        {"DIV_DOUBLE", "rc = 2 * rc, rd = 2 * rd; rb, rh bez zmian", "cd",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) {
+             return out[2] == 2 * in[2] && out[3] == 2 * in[3] && same(in, out, "bh");
+         },
+         {{Op::SHL, 'c'}, {Op::SHL, 'd'}}},
+        {"DIV_BIT_TEST", "ra = 0 gdy rd = 0; rb, rc, rd, rh bez zmian", "ad",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) { return (out[0] == 0) == (in[3] == 0) && same(in, out, "bcdh"); },
+         {{Op::RST, 'a'}, {Op::ADD, 'd'}}},
+        {"DIV_COMPARE", "ra > 0 gdy rc > rb; rb, rc, rd, rh bez zmian", "abc",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) { return (out[0] > 0) == (in[2] > in[1]) && same(in, out, "bcdh"); },
+         {{Op::RST, 'a'}, {Op::ADD, 'c'}, {Op::SUB, 'b'}}},
+        {"DIV_SUBTRACT", "rb = rb - rc, rh = rh + rd, gdy ra = 0 i rb >= rc; rc, rd bez zmian", "abcdh",
+         [](mt19937_64& rng) {
+             Regs s = randomRegs(rng);
+             s[0] = 0;
+             if (s[1] < s[2]) swap(s[1], s[2]);
+             return s;
+         },
+         [](const Regs& in, const Regs& out) {
+             return out[1] == in[1] - in[2] && out[7] == in[7] + in[3] && same(in, out, "cd");
+         },
+         {{Op::SWP, 'b'}, {Op::SUB, 'c'}, {Op::SWP, 'b'}, {Op::SWP, 'h'}, {Op::ADD, 'd'}, {Op::SWP, 'h'}}},
+        {"DIV_QUOTIENT_BIT", "rb = rb - rc, rh = rh + 1, gdy ra = 0 i rb >= rc; rc, rd bez zmian", "abch",
+         [](mt19937_64& rng) {
+             Regs s = randomRegs(rng);
+             s[0] = 0;
+             if (s[1] < s[2]) swap(s[1], s[2]);
+             return s;
+         },
+         [](const Regs& in, const Regs& out) {
+             return out[1] == in[1] - in[2] && out[7] == in[7] + 1 && out[2] == in[2];
+         },
+         {{Op::SWP, 'b'}, {Op::SUB, 'c'}, {Op::SWP, 'b'}, {Op::INC, 'h'}}},
+        {"DIV_HALVE", "rc = rc >> 1, rd = rd >> 1; rb, rh bez zmian", "cd",
+         [](mt19937_64& rng) { return randomRegs(rng); },
+         [](const Regs& in, const Regs& out) {
+             return out[2] == in[2] >> 1 && out[3] == in[3] >> 1 && same(in, out, "bh");
+         },
+         {{Op::SHR, 'c'}, {Op::SHR, 'd'}}},
+    };
+}
+
+/// @brief Instrukcje, które mogą wystąpić w ciągu (bez oczywiście zbędnych: SWP a, ADD a, SUB a)
+vector<Step> alphabet(const string& regs) {
+    vector<Step> steps;
+    for (char r : regs) {
+        for (Op op : {Op::RST, Op::INC, Op::DEC, Op::SHL, Op::SHR}) steps.push_back({op, r});
+        if (r == 'a') continue;
+        for (Op op : {Op::ADD, Op::SUB, Op::SWP}) steps.push_back({op, r});
+    }
+    return steps;
+}
+
+bool satisfies(const Spec& spec, const vector<Step>& steps, const Regs& in) {
+    Regs s = in;
+    for (const Step& step : steps)
+        if (!execute(s, step)) return false;
+    return spec.check(in, s);
+}
+
+/// @brief Szuka kontrprzykładu dla ciągu steps
+/// @return true i wejście, na którym ciąg nie spełnia specyfikacji
+bool counterexample(const Spec& spec, const vector<Step>& steps, mt19937_64& rng, Regs& found) {
+    for (int i = 0; i < VERIFY_INPUTS; i++) {
+        Regs in = spec.input(rng);
+        if (!satisfies(spec, steps, in)) {
+            found = in;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Result {
+    vector<Step> steps;
+    bool optimal;  // przeszukano wszystkie tańsze ciągi
+    size_t states; // odwiedzone stany ostatniego wyszukiwania
+};
+
+/// @brief Najtańszy ciąg tańszy od wzorca spełniający specyfikację na wejściach inputs
+/// @return false, gdy go nie ma. exhausted = false, gdy skończył się limit stanów (wynik nie jest wtedy dowodem)
+bool search(const Spec& spec, const vector<Regs>& inputs, unsigned long long bound, vector<Step>& found,
+            bool& exhausted, size_t& visited) {
+    vector<int> regs;
+    for (char r : spec.regs) regs.push_back(reg(r));
+    size_t width = regs.size() * inputs.size();
+    vector<Step> steps = alphabet(spec.regs);
+
+    struct Node {
+        int parent;
+        Step step;
+    };
+    vector<Node> nodes;
+    vector<unsigned long long> values; // stany węzłów: kolejne rejestry regs dla każdego wejścia
+    unordered_set<unsigned long long> seen;
+    auto hash = [&](const unsigned long long* state) {
+        unsigned long long h = 1469598103934665603ull;
+        for (size_t i = 0; i < width; i++) h = (h ^ state[i]) * 1099511628211ull + (h >> 29);
+        return h;
+    };
+
+    using Item = pair<unsigned long long, int>; // koszt, węzeł
+    priority_queue<Item, vector<Item>, greater<Item>> queue;
+    nodes.push_back({-1, {Op::HALT, 0}});
+    for (const Regs& in : inputs)
+        for (int r : regs) values.push_back(in[r]);
+    seen.insert(hash(values.data()));
+    queue.push({0, 0});
+
+    auto path = [&](int node) {
+        vector<Step> result;
+        for (; nodes[node].parent >= 0; node = nodes[node].parent) result.push_back(nodes[node].step);
+        return vector<Step>(result.rbegin(), result.rend());
+    };
+    auto stateOf = [&](int node, size_t input) {
+        Regs s = inputs[input];
+        for (size_t k = 0; k < regs.size(); k++) s[regs[k]] = values[node * width + input * regs.size() + k];
+        return s;
+    };
+
+    exhausted = true;
+    while (!queue.empty()) {
+        auto [c, node] = queue.top();
+        queue.pop();
+        bool ok = true;
+        for (size_t i = 0; i < inputs.size() && ok; i++) ok = spec.check(inputs[i], stateOf(node, i));
+        if (ok) {
+            found = path(node);
+            visited = nodes.size();
+            return true;
+        }
+        for (const Step& step : steps) {
+            unsigned long long next = c + instrCost(step.op);
+            if (next >= bound) continue;
+            vector<unsigned long long> state(width);
+            bool valid = true;
+            for (size_t i = 0; i < inputs.size() && valid; i++) {
+                Regs s = stateOf(node, i);
+                valid = execute(s, step);
+                for (size_t k = 0; k < regs.size(); k++) state[i * regs.size() + k] = s[regs[k]];
+            }
+            if (!valid || !seen.insert(hash(state.data())).second) continue;
+            if (nodes.size() >= MAX_STATES) {
+                exhausted = false;
+                continue;
+            }
+            nodes.push_back({node, step});
+            values.insert(values.end(), state.begin(), state.end());
+            queue.push({next, (int)nodes.size() - 1});
+        }
+    }
+    visited = nodes.size();
+    return false;
+}
+
+/// @brief Superoptymalizacja jednej specyfikacji: szukanie z coraz większym zestawem wejść (kontrprzykłady)
+Result optimize(const Spec& spec, mt19937_64& rng) {
+    Regs bad;
+    if (counterexample(spec, spec.reference, rng, bad)) {
+        cerr << spec.name << ": sekwencja wzorcowa nie spełnia specyfikacji\n";
+        exit(1);
+    }
+    vector<Regs> inputs;
+    for (int i = 0; i < SEARCH_INPUTS; i++) inputs.push_back(spec.input(rng));
+    unsigned long long bound = cost(spec.reference);
+    for (;;) {
+        vector<Step> found;
+        bool exhausted;
+        size_t visited;
+        if (!search(spec, inputs, bound, found, exhausted, visited)) return {spec.reference, exhausted, visited};
+        if (!counterexample(spec, found, rng, bad)) return {found, exhausted, visited}; // bez odrzuconych stanów nic tańszego nie ma
+        inputs.push_back(bad);
+    }
+}
+
+int main() {
+    mt19937_64 rng(20250101);
+    vector<Spec> all = specs();
+    vector<Result> results;
+    for (const Spec& spec : all) {
+        results.push_back(optimize(spec, rng));
+        const Result& r = results.back();
+        cerr << spec.name << ": koszt " << cost(spec.reference) << " -> " << cost(r.steps)
+             << (r.optimal ? " (optymalny)" : " (limit stanów)") << ", stanów " << r.states << "\n";
+    }
+
+    cout << "// Plik wygenerowany przez superopt (make helpers) - nie edytować ręcznie.\n"
+         << "#pragma once\n"
+         << "#include \"instruction.hh\"\n\n"
+         << "/// @brief Instrukcja sekwencji pomocniczej\n"
+         << "struct HelperStep {\n    Op op;\n    char reg;\n};\n\n"
+         << "/// @brief Sekwencja pomocnicza generatora kodu znaleziona przez superoptymalizator (superopt.cc)\n"
+         << "struct HelperSequence {\n"
+         << "    const char* name;\n"
+         << "    const HelperStep* steps;\n"
+         << "    unsigned length;\n"
+         << "    unsigned cost;\n"
+         << "    bool optimal; // przeszukano wszystkie tańsze ciągi\n"
+         << "};\n\n"
+         << "enum class Helper {\n";
+    for (const Spec& spec : all) cout << "    " << spec.name << ",\n";
+    cout << "};\n\n";
+    for (size_t i = 0; i < all.size(); i++) {
+        cout << "// " << all[i].description << "\n"
+             << "inline constexpr HelperStep " << all[i].name << "_STEPS[] = {";
+        for (size_t k = 0; k < results[i].steps.size(); k++)
+            cout << (k ? ", " : "") << "{Op::" << opName(results[i].steps[k].op) << ", '" << results[i].steps[k].reg << "'}";
+        cout << "};\n";
+    }
+    cout << "\ninline constexpr HelperSequence HELPER_SEQUENCES[] = {\n";
+    for (size_t i = 0; i < all.size(); i++)
+        cout << "    {\"" << all[i].name << "\", " << all[i].name << "_STEPS, " << results[i].steps.size() << ", "
+             << cost(results[i].steps) << ", " << (results[i].optimal ? "true" : "false") << "},\n";
+    cout << "};\n\n"
+         << "inline const HelperSequence& helperSequence(Helper helper) {\n"
+         << "    return HELPER_SEQUENCES[(int)helper];\n"
+         << "}\n";
+    return 0;
+}
@@ -5,6 +5,13 @@
 #include <iostream>
 #include <climits>
 #include <vector>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+#include "arena.hh"
+#include "memoryLayout.hh"
+#include "procedureCloner.hh"
 
 struct Symbol {
     std::string name;
@@ -13,11 +20,43 @@ struct Symbol {
     unsigned long long array_start; // Początek zakresu tablicy (np. -10)
     unsigned long long array_end;
     bool is_param = false;          // jeśli true to ładujemy adres
+    bool is_bound = false;          // parametr klonu procedury związany z argumentem o stałym adresie (nie wskaźnik)
     bool is_I = false;              // I oznacza zmienną stałą w procedurze t.j. nie można jej modyfikować
     bool is_O = false;              // O oznacza zmienną OUT w procedurze t.j. ma początkowo nieokreśloną wartość
     bool is_T = false;              // T oznacza table w procedurach
     bool is_initialized = false;    // tylko dla zmiennych (nie dla tablic)
     bool is_iterator = false;       // czy jest iteratorem pętli FOR
+    char reg = 0;                   // rejestr, w którym trzymana jest zmienna skalarna (0 jeśli tylko w pamięci)
+};
+
+/// @brief Bloki pamięci, do których program może sięgać pośrednio (RLOAD, RSTORE): tablice i zmienne,
+/// których adres przekazano do procedury. Pozostałe komórki są czytane i zapisywane tylko przez LOAD i STORE
+class IndirectMemory {
+    std::map<unsigned long long, unsigned long long> blocks; // początek -> koniec (bez końca), rozłączne i niesąsiadujące
+
+public:
+    /// @brief Dodaje blok [begin, begin + size), scalając go z blokami, które zachodzi lub z którymi sąsiaduje
+    /// (ramki procedur nakładają się, więc bloki różnych zakresów mogą się pokrywać; contains sprawdza tylko
+    /// najbliższy blok, dlatego muszą pozostać rozłączne)
+    void add(unsigned long long begin, unsigned long long size = 1) {
+        if (size == 0) return;
+        unsigned long long end = begin + size;
+        auto it = blocks.upper_bound(begin);
+        if (it != blocks.begin() && std::prev(it)->second >= begin) --it;
+        while (it != blocks.end() && it->first <= end) {
+            begin = std::min(begin, it->first);
+            end = std::max(end, it->second);
+            it = blocks.erase(it);
+        }
+        blocks[begin] = end;
+    }
+
+    bool contains(unsigned long long address) const {
+        auto it = blocks.upper_bound(address);
+        if (it == blocks.begin()) return false;
+        --it;
+        return address >= it->first && address < it->second;
+    }
 };
 
 struct ForLoopInfo {
@@ -27,6 +66,14 @@ struct ForLoopInfo {
     unsigned long long startLabel;  // Etykieta początku pętli (skok powrotny)
     unsigned long long endLabel;    // Etykieta końca pętli (skok wyjścia)
     bool is_downto;                 // true jeśli DOWNTO, false jeśli TO
+    char iteratorReg = 0;           // rejestr iteratora (0 jeśli w pamięci)
+    char limitReg = 0;              // rejestr limitu (0 jeśli w pamięci)
+    std::map<std::string, char> pointerRegs; // tablica -> rejestr z adresem tablica[iterator]
+    bool boundsKnown = false;       // czy FROM i TO są znane w czasie kompilacji
+    unsigned long long trips = 0;   // liczba obrotów pętli, gdy granice są znane
+    bool limitStored = true;        // false, gdy limit jest stałą generowaną przy każdym porównaniu
+    unsigned long long limit = 0;   // wartość limitu, gdy limitStored == false
+    unsigned long long bodyStart = 0; // numer pierwszej instrukcji ciała pętli
 };
 
 struct Procedure {
@@ -35,50 +82,116 @@ struct Procedure {
     unsigned long long startLable;          // Numer linii w VM, gdzie procedura się zaczyna
     // Lista parametrów w kolejności deklaracji - potrzebne do walidacji wywołania
     std::vector<Symbol> parameters;          //SKOPIOWAĆ BO PRZY LEAVE SCOPE USUNA SIE
-    std::map<std::string, bool> initialized; // Zapisujemy które zmienne są inicjalizowane w procedurze w razie dalszego przekazywania do innych procedur
+    std::unordered_map<NameId, bool> initialized; // Zapisujemy które zmienne są inicjalizowane w procedurze w razie dalszego przekazywania do innych procedur
+    unsigned clobberedRegs = 0;              // maska rejestrów zmiennych nadpisywanych przez procedurę i procedury przez nią wywoływane
 }; 
 
 class SymbolTable {
-    std::vector<std::map<std::string, Symbol>> scopes; // stos scope'ów procedur i maina
-    std::map<std::string, Procedure> procedures;       // mapujemy nazwy do procedur (nazwy procedur nie mogą się powtórzyć)
+    StringPool& names;                                 // nazwy kompilacji (klucze tablic symboli)
+    Arena& arena;                                      // pamięć na informacje o pętlach FOR
+    std::vector<std::unordered_map<NameId, Symbol>> scopes; // stos scope'ów procedur i maina (klucz - numer nazwy w names)
+    std::unordered_map<NameId, Procedure> procedures;       // mapujemy nazwy do procedur (nazwy procedur nie mogą się powtórzyć)
     std::vector<ForLoopInfo*> forStack;                // stack iteratorów pętli FOR
     unsigned long long memory_offset = 0;              // globalny offset pamięci
     const unsigned long long MEMORY_END = LLONG_MAX/2; // Koniec pamięci VM
-    std::string currProcedure = "";                    // nazwa obecnej procedury
+    NameId currProcedure{};                            // nazwa obecnej procedury (NameId{} - main)
+    IndirectMemory indirect;                           // tablice i zmienne, których adres przekazano do procedury
+    std::map<std::string, FramePlan> layout;           // ramki zakresów z MemoryLayout (puste - przydział po kolei)
+    FramePlan* frame = nullptr;                        // ramka obecnego zakresu
+    CloneBindings bindings;                            // parametry klonów procedur związane z argumentami
+    unsigned long long dynamicNext = 0;                // następna wolna komórka obszaru dynamicznego ramki
+
+    /// @brief Wybiera ramkę zakresu procName z planu rozmieszczenia pamięci
+    void selectFrame(std::string_view procName){
+        auto it = layout.find(std::string(procName));
+        frame = it == layout.end() ? nullptr : &it->second;
+        if (frame) dynamicNext = frame->dynamicBase;
+    }
+
+    /// @brief Przydziela size komórek zmiennej name: adres z planu, obszar dynamiczny ramki albo pamięć nad ramkami
+    /// @return adres pierwszej komórki
+    unsigned long long allocate(const std::string& name, unsigned long long size){
+        if (frame) {
+            if (auto it = frame->fixed.find(name); it != frame->fixed.end()) {
+                unsigned long long address = it->second;
+                frame->fixed.erase(it); // kolejne zmienne o tej nazwie (np. wstawionych procedur) już nie z planu
+                return address;
+            }
+            if (size <= frame->dynamicEnd - dynamicNext) {
+                unsigned long long address = dynamicNext;
+                dynamicNext += size;
+                return address;
+            }
+        }
+        if (size > MEMORY_END || memory_offset > MEMORY_END - size) throw std::overflow_error("Run out of memory for variable: " + name);
+        unsigned long long address = memory_offset;
+        memory_offset += size;
+        return address;
+    }
 
 public:
+    SymbolTable(StringPool& names, Arena& arena) : names(names), arena(arena) {}
+
+    /// @brief Ustawia rozmieszczenie pamięci wyznaczone przez MemoryLayout. Zmienne spoza planu trafiają nad wszystkie ramki
+    void setLayout(const std::map<std::string, FramePlan>& plans){
+        layout = plans;
+        for (const auto& [name, plan] : layout) memory_offset = std::max(memory_offset, plan.end);
+    }
+
+    /// @brief Ustawia parametry klonów z ProcedureCloner i wyznacza adresy ich argumentów z planu rozmieszczenia pamięci.
+    /// Bez planu (--no-layout, olbrzymie tablice) parametry klonów zostają wskaźnikami jak w oryginale
+    void setBindings(const CloneBindings& clones){
+        bindings.clear();
+        for (const auto& [clone, params] : clones) {
+            for (const auto& [param, binding] : params) {
+                auto plan = layout.find(binding.scope);
+                if (plan == layout.end()) continue;
+                auto address = plan->second.fixed.find(binding.var);
+                if (address == plan->second.fixed.end()) continue;
+                ParamBinding& b = bindings[clone][param] = binding;
+                b.address = address->second;
+            }
+        }
+    }
+
     /// @brief Tworzy nowy zakres widoczności (scope) na stosie
     void enterScope(){
         scopes.emplace_back(); // Nowy scope lokalny
+        if (currProcedure == NameId{}) selectFrame(""); // main (procedury wybierają ramkę w createProcedure)
     }
 
     /// @brief Usuwa aktualny zakres widoczności ze stosu i czyści nazwę obecnej procedury
     void leaveScope(){
         scopes.pop_back(); // Wychodzimy ze scopu lokalnego
-        currProcedure = "";
+        currProcedure = NameId{};
     }
 
     /// @brief Sprawdza czy procedura o podanej nazwie została już zadeklarowana
     /// @param procName nazwa procedury
     /// @return true jeśli procedura istnieje, w przeciwnym razie false
-    bool procedureExists(const std::string& procName){
-        if (auto search = procedures.find(procName); search != procedures.end())
-            return true;
-        else return false;
+    bool procedureExists(std::string_view procName){
+        return procedures.find(names.id(procName)) != procedures.end();
     }
 
     /// @brief Zwraca nazwę aktualnie przetwarzanej procedury
     /// @return nazwa procedury
     std::string currentProcedure(){
-        return currProcedure;
+        return names.text(currProcedure);
+    }
+
+    /// @brief Zwraca nazwę aktualnie przetwarzanej procedury jako wskaźnik ważny do końca kompilacji (np. do komentarzy w kodzie wynikowym)
+    /// @return nazwa procedury
+    const char* currentProcedureName(){
+        return procedures[currProcedure].name.c_str();
     }
 
     /// @brief Pobiera etykietę startową (adres kodu) danej procedury
     /// @param procName nazwa procedury
     /// @return numer linii startowej procedury
-    unsigned long long getProcedureLable(const std::string& procName){
-        if(!procedureExists(procName)) throw std::invalid_argument("Getting lable of unexisting procedure " + procName);
-        return procedures[procName].startLable;
+    unsigned long long getProcedureLable(std::string_view procName){
+        auto it = procedures.find(names.id(procName));
+        if (it == procedures.end()) throw std::invalid_argument("Getting lable of unexisting procedure " + std::string(procName));
+        return it->second.startLable;
     }
 
     /// @brief Pobiera adres w pamięci zmiennej przechowującej adres powrotu obecnej procedury
@@ -91,47 +204,84 @@ public:
     /// @param procName nazwa procedury
     /// @param startLable etykieta początku kodu procedury
     /// @return adres pamięci zarezerwowany dla adresu powrotu
-    unsigned long long createProcedure(const std::string& procName, unsigned long long startLable){
-        if (procedures.find(procName) != procedures.end()){
+    unsigned long long createProcedure(std::string_view procName, unsigned long long startLable){
+        NameId key = names.id(procName);
+        if (procedures.find(key) != procedures.end()){
             throw std::invalid_argument("Procedure already declared");
         }
+        selectFrame(procName);
         Procedure proc;
-        proc.returnAddressVar = memory_offset;
-        memory_offset++;
+        proc.returnAddressVar = allocate("", 1);
         proc.name = procName;
         proc.startLable = startLable;
-        procedures.emplace(procName, std::move(proc)); // albo procedures[procName] = proc;
-        currProcedure = procName;
-        return proc.returnAddressVar;
+        unsigned long long returnAddress = proc.returnAddressVar;
+        procedures.emplace(key, std::move(proc)); // albo procedures[key] = proc;
+        currProcedure = key;
+        return returnAddress;
+    }
+
+    /// @brief Zwraca maskę rejestrów (bit reg-'a'), które procedura może nadpisać swoimi zmiennymi
+    /// @param procName nazwa procedury
+    unsigned getClobberedRegs(std::string_view procName){
+        auto it = procedures.find(names.id(procName));
+        if (it == procedures.end()) return 0;
+        return it->second.clobberedRegs;
+    }
+
+    /// @brief Ustawia maskę rejestrów nadpisywanych przez obecną procedurę
+    /// @param mask maska rejestrów (bit reg-'a')
+    void setClobberedRegs(unsigned mask){
+        if (auto it = procedures.find(currProcedure); it != procedures.end())
+            it->second.clobberedRegs = mask;
+    }
+
+    /// @brief Zwraca zmienne obecnego zakresu trzymane w rejestrach (łącznie z aktywnymi iteratorami)
+    std::vector<Symbol*> registerVariables(){
+        std::vector<Symbol*> result;
+        for (auto& [name, sym] : scopes.back())
+            if (sym.reg) result.push_back(&sym);
+        std::sort(result.begin(), result.end(), [](const Symbol* x, const Symbol* y) { return x->name < y->name; });
+        return result;
+    }
+
+    /// @brief Zwraca stos aktualnie otwartych pętli FOR
+    const std::vector<ForLoopInfo*>& activeLoops() const {
+        return forStack;
     }
 
     /// @brief Wyszukuje symbol (zmienną lub tablicę) w aktualnym zakresie
     /// @param name nazwa symbolu
     /// @return wskaźnik na strukturę Symbol lub nullptr
-    Symbol* getSymbol(std::string name) {
+    Symbol* getSymbol(NameId name) {
         if (auto search = scopes.back().find(name); search != scopes.back().end())
             return &search->second;
         else return nullptr;
     }
 
+    /// @brief Wyszukuje symbol po nazwie tekstowej (np. z Inlinera albo RegisterAllocator)
+    Symbol* getSymbol(std::string_view name) {
+        return getSymbol(names.id(name));
+    }
+
     /// @brief Sprawdza czy parametr procedury jest zainicjalizowany i propaguje inicjalizację na argument wywołania
     /// @param procName nazwa procedury
     /// @param paramName nazwa parametru formalnego
     /// @param arg wskaźnik na symbol argumentu przekazywanego do procedury
     /// @return true jeśli parametr jest oznaczony jako zainicjalizowany
-    bool isParameterInitialized(std::string procName, std::string paramName, Symbol *arg){
-        bool isInit = procedures[procName].initialized[paramName];
-        if(isInit && currProcedure != "") procedures[currProcedure].initialized[arg->name] = true;
+    bool isParameterInitialized(std::string_view procName, std::string_view paramName, Symbol *arg){
+        bool isInit = procedures[names.id(procName)].initialized[names.id(paramName)];
+        if(isInit && currProcedure != NameId{}) procedures[currProcedure].initialized[names.id(arg->name)] = true;
         return isInit;
     }
 
     /// @brief Oznacza zmienną lub parametr jako zainicjalizowany
     /// @param name nazwa zmiennej
-    void markInitialized(std::string name){
-        Symbol* sym = getSymbol(name);
+    void markInitialized(std::string_view name){
+        NameId key = names.id(name);
+        Symbol* sym = getSymbol(key);
         if(sym->is_array) return;
-        if(sym->is_param){
-            procedures[currProcedure].initialized[name] = true;
+        if(sym->is_param || sym->is_bound){
+            procedures[currProcedure].initialized[key] = true;
         }
         sym->is_initialized = true;
     }
@@ -139,24 +289,24 @@ public:
     /// @brief Zwraca adres pamięci zmiennej skalarnej. Rzuca błąd jeśli to tablica.
     /// @param name nazwa zmiennej
     /// @return adres w pamięci wirtualnej
-    unsigned long long getAddressVar(const std::string& name)
+    unsigned long long getAddressVar(std::string_view name)
     {
-        auto it = scopes.back().find(name);
+        auto it = scopes.back().find(names.id(name));
         if (it == scopes.back().end())
-            throw std::invalid_argument("Variable \"" + name + "\" not defined");
-        if (it->second.is_array) throw std::invalid_argument(name +" is an array not variable");
+            throw std::invalid_argument("Variable \"" + std::string(name) + "\" not defined");
+        if (it->second.is_array) throw std::invalid_argument(std::string(name) +" is an array not variable");
         return it->second.memory_address;
     }
 
     /// @brief Zwraca adres bazowy tablicy. Rzuca błąd jeśli to zmienna skalarna.
     /// @param name nazwa tablicy
     /// @return adres początkowy tablicy w pamięci
-    unsigned long long getAddressArr(const std::string& name)
+    unsigned long long getAddressArr(std::string_view name)
     {
-        auto it = scopes.back().find(name);
+        auto it = scopes.back().find(names.id(name));
         if (it == scopes.back().end())
-            throw std::invalid_argument("Array \"" + name + "\" not defined");
-        if (!it->second.is_array) throw std::invalid_argument(name +" is a variable not an array");
+            throw std::invalid_argument("Array \"" + std::string(name) + "\" not defined");
+        if (!it->second.is_array) throw std::invalid_argument(std::string(name) +" is a variable not an array");
         return it->second.memory_address;
     }
 
@@ -164,24 +314,24 @@ public:
     /// @param name nazwa tablicy
     /// @param index stała wartość indeksu
     /// @return obliczony adres pamięci elementu tablicy
-    unsigned long long getArrayElementAddress(const std::string& name, unsigned long long index) const {
-        auto it = scopes.back().find(name);
+    unsigned long long getArrayElementAddress(std::string_view name, unsigned long long index) const {
+        auto it = scopes.back().find(names.id(name));
         if (it == scopes.back().end())
-            throw std::invalid_argument("Array \"" + name + "\" not defined");
+            throw std::invalid_argument("Array \"" + std::string(name) + "\" not defined");
         const Symbol& s = it->second;
         if (!s.is_array)
-            throw std::invalid_argument("Trying to access \"" + name + "\" through index but \"" + name + "\" is not an array");
+            throw std::invalid_argument("Trying to access \"" + s.name + "\" through index but \"" + s.name + "\" is not an array");
         if (index < s.array_start || index > s.array_end)
-            throw std::out_of_range("Index " + std::to_string(index) + " not in range for array \"" + name + "\"");
+            throw std::out_of_range("Index " + std::to_string(index) + " not in range for array \"" + s.name + "\"");
         return s.memory_address + (index - s.array_start);
     }
 
     /// @brief Pobiera listę parametrów zdefiniowanych dla danej procedury
     /// @param name nazwa procedury
     /// @return wektor symboli parametrów
-    std::vector<Symbol> getParameters(const std::string& name){
-        if (auto search = procedures.find(name); search != procedures.end()){
-            return procedures[name].parameters;
+    const std::vector<Symbol>& getParameters(std::string_view name){
+        if (auto search = procedures.find(names.id(name)); search != procedures.end()){
+            return search->second.parameters;
         }
         else{
             throw std::invalid_argument("Procedure not declared");
@@ -191,16 +341,14 @@ public:
     /// @brief Waliduje zgodność liczby i istnienia argumentów przy wywołaniu procedury
     /// @param name nazwa wywoływanej procedury
     /// @param args wektor nazw zmiennych przekazywanych jako argumenty
-    void setArguments(const std::string& name, std::vector<const char*> args){
-        std::vector<Symbol> params = procedures[name].parameters;
+    void setArguments(std::string_view name, const std::vector<const char*>& args){
+        const std::vector<Symbol>& params = procedures[names.id(name)].parameters;
         int argsSize = args.size();
-        if((int)params.size() != argsSize) throw std::invalid_argument("Wrong number of arguments at call for procedure " + name);
+        if((int)params.size() != argsSize) throw std::invalid_argument("Wrong number of arguments at call for procedure " + std::string(name));
 
         for (int i = 0; i < argsSize; i++){
-            std::string argName = args[i];
-            Symbol* arg = getSymbol(argName);
-            if(arg == nullptr) throw std::invalid_argument("Trying to call procedure " + name + "with undeclared variable " + name);
-            Symbol param = params.at(i);
+            Symbol* arg = getSymbol(std::string_view(args[i]));
+            if(arg == nullptr) throw std::invalid_argument("Trying to call procedure " + std::string(name) + "with undeclared variable " + std::string(name));
         }
     }
 
@@ -210,30 +358,36 @@ public:
     void declareParameter(const std::string& name, char type)
     {
         if (exists(name)) throw std::invalid_argument("Double variable declaration: " + name);
-        if (memory_offset + 1 > MEMORY_END) throw std::overflow_error("Run out of memory for variable: " + name);
-        
+
         Symbol s;
         s.name = name;
-        s.memory_address = memory_offset;
-        s.is_param = true;
         s.is_array = (type == 'T');
-
         if(type == 'I') s.is_I = true;
         else if(type == 'O') s.is_O = true;
-        else if(type == 'T'){
-             s.is_T = true;
-             memory_offset++; //adres dla indeksu startowego
+
+        const ParamBinding* binding = nullptr;
+        if (auto clone = bindings.find(names.text(currProcedure)); clone != bindings.end())
+            if (auto b = clone->second.find(name); b != clone->second.end()) binding = &b->second;
+        if (binding) { // parametr klonu: zmienna lub tablica wołającego pod stałym adresem
+            s.memory_address = binding->address;
+            s.is_bound = true;
+            s.array_start = binding->start;
+            s.array_end = binding->end;
+            s.is_initialized = !s.is_O;
+        } else {
+            s.memory_address = allocate(name, type == 'T' ? 2 : 1); // dla T: adres tablicy i indeks startowy
+            s.is_param = true;
+            s.is_T = (type == 'T');
         }
 
         if (procedures.find(currProcedure) != procedures.end()) {
             procedures[currProcedure].parameters.push_back(s);
-            procedures[currProcedure].initialized[name] = false;
+            procedures[currProcedure].initialized[names.id(name)] = false;
         } else {
             throw std::runtime_error("Internal error: procedure not found");
         }
 
-        scopes.back().emplace(name, std::move(s));
-        ++memory_offset;
+        scopes.back().emplace(names.id(name), std::move(s));
     }
 
     /// @brief Rejestruje nową zmienną lokalną w obecnym zakresie i alokuje pamięć
@@ -241,13 +395,11 @@ public:
     void declareVariable(const std::string& name)
     {
         if (exists(name)) throw std::invalid_argument("Double variable declaration: " + name);
-        if (memory_offset + 1 > MEMORY_END) throw std::overflow_error("Run out of memory for variable: " + name);
         Symbol s;
         s.name = name;
-        s.memory_address = memory_offset;
+        s.memory_address = allocate(name, 1);
         s.is_array = false;
-        scopes.back().emplace(name, std::move(s));
-        ++memory_offset;
+        scopes.back().emplace(names.id(name), std::move(s));
     }
 
     /// @brief Rejestruje iterator pętli oraz ukrytą zmienną limitu
@@ -257,22 +409,19 @@ public:
     ForLoopInfo* declareIterator(const std::string& name, bool is_downto)
     {
         if (exists(name)) throw std::invalid_argument("Double variable declaration: " + name);
-        if (memory_offset + 1 > MEMORY_END) throw std::overflow_error("Run out of memory for variable: " + name);
 
         Symbol s;
         s.name = name;
-        s.memory_address = memory_offset;
+        s.memory_address = allocate(name, 2); // iterator i ukryty limit
         s.is_array = false;
         s.is_iterator = true;
         s.is_initialized = true;
-        scopes.back().emplace(name, std::move(s));
 
-        ForLoopInfo *for_info = new ForLoopInfo();
+        ForLoopInfo *for_info = arena.make<ForLoopInfo>();
         for_info->iteratorName = name;
-        for_info->iteratorAddr = memory_offset;
-        ++memory_offset;
-        for_info->limitAddr = memory_offset;
-        ++memory_offset;
+        for_info->iteratorAddr = s.memory_address;
+        for_info->limitAddr = s.memory_address + 1;
+        scopes.back().emplace(names.id(name), std::move(s));
         for_info->is_downto = is_downto;
 
         forStack.push_back(for_info);
@@ -281,8 +430,7 @@ public:
 
     /// @brief Usuwa iterator z obecnego zakresu (używane po zakończeniu generowania pętli)
     void removeIterator(){
-        std::string name = forStack.back()->iteratorName;
-        if (auto search = scopes.back().find(name); search != scopes.back().end()){
+        if (auto search = scopes.back().find(names.id(forStack.back()->iteratorName)); search != scopes.back().end()){
             scopes.back().erase(search);
         }
         forStack.pop_back();
@@ -296,25 +444,35 @@ public:
     {
         if(start > end) throw std::invalid_argument("Start index of array \"" + name + "\" greater then end index: " + std::to_string(start) + " > " + std::to_string(end));
         unsigned long long tSize = end-start+1;
-        if (memory_offset + tSize > MEMORY_END) throw std::overflow_error("Run out of memory for variable: " + name);
         Symbol sym;
         sym.name = name;
-        sym.memory_address = memory_offset;
-        memory_offset = memory_offset + tSize;
+        sym.memory_address = allocate(name, tSize);
         sym.is_array = true;
         sym.array_start = start;
         sym.array_end = end;
         sym.is_initialized = true;
-        const auto [variable, success] = scopes.back().insert({name, sym});
+        indirect.add(sym.memory_address, tSize);
+        const auto [variable, success] = scopes.back().insert({names.id(name), sym});
         if(!success) throw std::invalid_argument("Double declaration " + name);
     }
     
+    /// @brief Oznacza zmienną, której adres trafia do rejestru (np. przekazaną do procedury): może być czytana
+    /// i zapisywana przez RLOAD i RSTORE
+    void markIndirect(unsigned long long address){
+        indirect.add(address);
+    }
+
+    /// @brief Komórki pamięci dostępne pośrednio (dla usuwania martwych zapisów)
+    const IndirectMemory& indirectMemory() const {
+        return indirect;
+    }
+
     /// @brief Sprawdza czy zmienna istnieje w obecnym zakresie widoczności
     /// @param name nazwa zmiennej
     /// @return true jeśli zmienna istnieje
-    bool exists(const std::string& name)
+    bool exists(std::string_view name)
     {
-        if (auto search = scopes.back().find(name); search != scopes.back().end())
+        if (auto search = scopes.back().find(names.id(name)); search != scopes.back().end())
             return true;
         else
             return false;
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+
+#include "machine.hh"
+
+using namespace std;
+
+// Liczba i koszt wykonań instrukcji albo linii kodu źródłowego
+struct ProfileEntry {
+    unsigned long long id;    // numer instrukcji albo linii źródła
+    unsigned long long count; // liczba wykonań (dla linii: suma po ciągłych fragmentach jej kodu)
+    unsigned long long cost;
+};
+
+void print_usage() {
+    cerr << "Sposób użycia: symulator [opcje] program.mr\n"
+         << "Opcje:\n"
+         << "  --profile              wypisuje na stderr najdroższe instrukcje i linie źródła\n"
+         << "  --profile-out=plik     zapisuje pełny profil (liczba wykonań i koszt każdej instrukcji i linii)\n"
+         << "  --lines=plik           mapa instrukcja -> linia źródła z opcji kompilatora --line-map\n"
+         << "  --top=n                liczba pozycji w raporcie --profile (domyślnie 20)\n";
+}
+
+// Linia źródła instrukcji z mapy kompilatora
+struct SourceLine {
+    unsigned long long line;
+    bool innerLoop; // instrukcja pętli mnożenia albo dzielenia (oznaczona w mapie '*')
+};
+
+/// @brief wczytuje mapę linii źródła: jedna liczba na instrukcję, z '*' dla instrukcji pętli mnożenia i dzielenia
+vector<SourceLine> read_line_map(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("nie można otworzyć mapy linii " + path);
+    vector<SourceLine> lines;
+    for (string word; in >> word; ) {
+        size_t digits = word.find_first_not_of("0123456789");
+        if (digits == 0 || (digits != string::npos && word.substr(digits) != "*"))
+            throw runtime_error("niepoprawny wpis w mapie linii: " + word);
+        lines.push_back({stoull(word), digits != string::npos});
+    }
+    return lines;
+}
+
+/// @brief Zlicza wykonania i koszt instrukcji pogrupowane po liniach źródła. Kod linii może być rozdzielony na kilka
+/// ciągłych fragmentów (kopie rozwiniętej pętli, warunek WHILE powtórzony na końcu ciała), więc liczba wykonań linii
+/// to suma po fragmentach liczby wykonań najczęściej wykonywanej instrukcji fragmentu, z pominięciem pętli mnożenia
+/// i dzielenia. Linie, z których powstał kod, ale który się nie wykonał, mają zerową liczbę wykonań
+vector<ProfileEntry> line_profile(const Machine& vm, const vector<SourceLine>& lines) {
+    map<unsigned long long, ProfileEntry> byLine;
+    const vector<unsigned long long>& counts = vm.counts();
+    unsigned long long fragmentCount = 0;
+    for (size_t k = 0; k < counts.size() && k < lines.size(); k++) {
+        ProfileEntry& entry = byLine.emplace(lines[k].line, ProfileEntry{lines[k].line, 0, 0}).first->second;
+        if (!lines[k].innerLoop) fragmentCount = max(fragmentCount, counts[k]);
+        if (k + 1 == counts.size() || k + 1 == lines.size() || lines[k + 1].line != lines[k].line) {
+            entry.count += fragmentCount;
+            fragmentCount = 0;
+        }
+        entry.cost += counts[k] * instrCost(vm.instructions()[k].op);
+    }
+    vector<ProfileEntry> result;
+    for (const auto& [line, entry] : byLine) result.push_back(entry);
+    return result;
+}
+
+void print_top(ostream& out, const char* title, vector<ProfileEntry> entries, size_t top, unsigned long long total,
+               const Machine* vm) {
+    sort(entries.begin(), entries.end(), [](const ProfileEntry& x, const ProfileEntry& y) { return x.cost > y.cost; });
+    out << title << "\n";
+    char row[160];
+    for (size_t i = 0; i < entries.size() && i < top && entries[i].count > 0; i++) {
+        const ProfileEntry& e = entries[i];
+        string text;
+        if (vm) {
+            const Instr& instr = vm->instructions()[e.id];
+            text = opName(instr.op);
+            if (hasRegArg(instr.op)) text += string(" ") + instr.reg;
+            else if (hasNumArg(instr.op)) text += " " + to_string(instr.arg);
+        }
+        snprintf(row, sizeof row, "%8llu %-12s %14llu %16llu %6.2f%%\n", e.id, text.c_str(), e.count, e.cost,
+                 total ? 100.0 * e.cost / total : 0.0);
+        out << row;
+    }
+}
+
+/// @brief Uruchamia program maszyny wirtualnej i wypisuje koszt wykonania (w formacie zewnętrznej maszyny),
+/// a na życzenie profil wykonania: liczbę wykonań i koszt każdej instrukcji i linii kodu źródłowego
+int main(int argc, char const* argv[]) {
+    bool profile = false;
+    string profileOut, linesPath, programPath;
+    size_t top = 20;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--profile") profile = true;
+        else if (arg.rfind("--profile-out=", 0) == 0) profileOut = arg.substr(14);
+        else if (arg.rfind("--lines=", 0) == 0) linesPath = arg.substr(8);
+        else if (arg.rfind("--top=", 0) == 0) top = stoul(arg.substr(6));
+        else if (arg.rfind("--", 0) == 0 || !programPath.empty()) {
+            print_usage();
+            return 1;
+        }
+        else programPath = arg;
+    }
+    if (programPath.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    Machine vm;
+    vector<SourceLine> lines;
+    try {
+        ifstream program(programPath);
+        if (!program) throw runtime_error("nie można otworzyć programu " + programPath);
+        vm.load(program);
+        if (!linesPath.empty()) lines = read_line_map(linesPath);
+    } catch (const exception& e) {
+        cerr << "Błąd: " << e.what() << "\n";
+        return 1;
+    }
+
+    int status = 0;
+    try {
+        vm.run(cin, cout);
+        cout << "Skończono program (koszt: " << vm.cost() << "; w tym i/o: " << vm.inputOutputCost() << ").\n";
+    } catch (const exception& e) {
+        cerr << "Błąd wykonania: " << e.what() << " (koszt do tej pory: " << vm.cost() << ")\n";
+        status = 2;
+    }
+    cout << "liczba rozkazów: " << vm.instructions().size() << "\n";
+
+    vector<ProfileEntry> instructions;
+    for (size_t k = 0; k < vm.counts().size(); k++)
+        if (vm.counts()[k]) instructions.push_back({k, vm.counts()[k], vm.counts()[k] * instrCost(vm.instructions()[k].op)});
+    vector<ProfileEntry> byLine = line_profile(vm, lines);
+
+    if (profile) {
+        cerr << "\n";
+        print_top(cerr, "instrukcja   rozkaz       wykonania            koszt  udział", instructions, top, vm.cost(), &vm);
+        if (!byLine.empty()) {
+            cerr << "\n";
+            print_top(cerr, "   linia                wykonania            koszt  udział", byLine, top, vm.cost(), nullptr);
+        }
+    }
+    if (!profileOut.empty()) {
+        ofstream out(profileOut);
+        if (!out) {
+            cerr << "Błąd: nie można zapisać profilu " << profileOut << "\n";
+            return 1;
+        }
+        out << "# I instrukcja wykonania koszt\n";
+        for (const ProfileEntry& e : instructions) out << "I " << e.id << " " << e.count << " " << e.cost << "\n";
+        out << "# L linia wykonania koszt\n";
+        for (const ProfileEntry& e : byLine) out << "L " << e.id << " " << e.count << " " << e.cost << "\n";
+    }
+    return status;
+}
@@ -3,8 +3,10 @@
 # KONFIGURACJA 
 COMPILER="./kompilator" # KOMENDA DO KOMPILACJI
 VM="./mw2025-p/maszyna-wirtualna-cln"  # ŚCIEŻKA DO MASZYNY
+[ -x "$VM" ] || VM="./symulator"       # bez zewnętrznej maszyny: symulator z repozytorium (make symulator)
 TEST_DIR="./test_programs" # FOLDER NA PROGRAMY TESTOWE .IMP
 PERF_DIR="./tests"         # FOLDER NA PLIKI Z CASE'AMI DO TESTÓW
+[ -d "$TEST_DIR" ] || { TEST_DIR="./bench/corpus/programs"; PERF_DIR="./bench/corpus/tests"; } # korpus z repozytorium
 OUT_DIR="./out"            # FOLDER NA SKOMPILOWANE PROGRAMY
 TIMEOUT_SEC="5s"           # CZAS PO KTÓRYM PROGRAM SIĘ TIMEOUTUJE
 
@@ -73,7 +75,7 @@ for test_file in "$PERF_DIR"/*; do
     current_expects=""
 
     run_test_case() {
-        if [ -z "$current_expects" ]; then return; fi
+        if [ -z "$current_expects" ] && [ -z "$current_inputs" ]; then return; fi # przypadek może nic nie wypisywać
 
         test_count=$((test_count + 1))
 
@@ -135,10 +137,10 @@ for test_file in "$PERF_DIR"/*; do
         elif [[ "$line" =~ ^\> ]]; then
             val=${line#> }; current_expects="$current_expects $val"
         elif [[ -z "$line" ]]; then
-            if [ ! -z "$current_expects" ]; then run_test_case; current_inputs=""; current_expects=""; fi
+            run_test_case; current_inputs=""; current_expects=""
         fi
     done
-    if [ ! -z "$current_expects" ]; then run_test_case; fi
+    run_test_case
 
     avg_cost=0
     if [ "$test_count" -gt 0 ]; then avg_cost=$((total_cost / test_count)); fi
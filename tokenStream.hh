@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+
+#include "parser.hh"
+
+/// @brief Token wczytany przez lekser wraz z wartością semantyczną i numerem linii
+struct Token {
+    int kind;       // rodzaj tokenu z parser.hh (np. PIDENTIFIER)
+    YYSTYPE value;  // wartość semantyczna (num, id)
+    int line;       // linia w kodzie źródłowym
+};
+
+/// @brief Przechowuje cały plik w postaci tokenów. Pozwala przeanalizować program przed parsowaniem
+/// (np. przydział rejestrów), a potem podaje parserowi te same tokeny po kolei.
+class TokenStream {
+    std::vector<Token> tokens;
+    size_t next = 0; // indeks następnego tokenu dla parsera
+
+public:
+    /// @brief wczytuje wszystkie tokeny z leksera aż do końca pliku
+    /// @param lexer funkcja lexer(YYSTYPE* lval, int* lineno) ustawiająca wartość semantyczną i numer linii tokenu
+    /// i zwracająca jego rodzaj (0 na końcu pliku)
+    template <class Lexer>
+    void read(Lexer lexer) {
+        tokens.clear();
+        next = 0;
+        YYSTYPE lval{};
+        int lineno = 0;
+        int kind;
+        while ((kind = lexer(&lval, &lineno)) != 0) {
+            tokens.push_back({kind, lval, lineno});
+        }
+    }
+
+    /// @brief podaje parserowi kolejny token i ustawia jego wartość oraz numer linii
+    /// @return rodzaj tokenu albo 0 na końcu pliku
+    int nextToken(YYSTYPE* lval, int* lineno) {
+        if (next >= tokens.size()) return 0;
+        const Token& t = tokens[next++];
+        *lval = t.value;
+        *lineno = t.line;
+        return t.kind;
+    }
+
+    /// @brief Indeks ostatniego tokenu podanego parserowi
+    int position() const {
+        return (int)next - 1;
+    }
+
+    /// @brief Szuka wstecz od ostatnio podanego tokenu najbliższego tokenu rodzaju kind (np. WHILE otwierającego pętlę)
+    /// @return indeks tokenu albo -1
+    int findBackward(int kind) const {
+        for (int i = position(); i >= 0; i--)
+            if (tokens[i].kind == kind) return i;
+        return -1;
+    }
+
+    const std::vector<Token>& all() const {
+        return tokens;
+    }
+
+    /// @brief Tokeny do przekształcenia przed parsowaniem (np. wstawianie procedur)
+    std::vector<Token>& all() {
+        return tokens;
+    }
+};